@@ -54,6 +54,12 @@ enum ScoringType {
   DOT_PRODUCT
 };
 
+//! Order in which a set of features is propagated down a vocabulary tree
+enum DescentType {
+  DEPTH_FIRST,  //!< each feature goes down to its leaf before the next one
+  BREADTH_FIRST //!< all the features go down one level at a time
+};
+
 /**
  * Vector of words to represent images
  */
@@ -0,0 +1,469 @@
+/**
+ * File: ChunkedVector.h
+ * Date: October 2026
+ * Description: append-only sequence stored in a few contiguous chunks
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_CHUNKED_VECTOR__
+#define __D_T_CHUNKED_VECTOR__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Sequence that grows by appending chunks of doubling capacity. The items
+ * are never moved once written, so growing costs no copy and the sequence
+ * is read as a handful of contiguous arrays. Copies are compacted into a
+ * single chunk.
+ *
+ * One thread may append items while others read the sequence: readers see
+ * the items appended before they took its size (with size, begin or
+ * operator[]). Any other modification needs exclusive access.
+ *
+ * The first chunk can also be an array that the sequence does not own, such
+ * as a mapped file (see attach)
+ * @param T type of the items (default constructible and copyable)
+ */
+template<class T>
+class DLL_EXPORT ChunkedVector {
+protected:
+  //! Contiguous array of items
+  struct Chunk {
+    T* data;
+    size_t capacity;
+    //! The chunk is deleted with the sequence
+    bool owned;
+  };
+
+  //! Array of chunks. When it is full, it is replaced by a larger copy, and
+  //! the old one is kept for the readers that may still use it
+  struct Directory {
+    std::unique_ptr<Chunk[]> chunks;
+    size_t capacity;
+    size_t n_chunks;
+    std::unique_ptr<Directory> previous;
+  };
+
+public:
+  //! Type of the items
+  using value_type = T;
+
+  /**
+   * Forward iterator over the items that the sequence had when the
+   * iteration began, chunk after chunk
+   */
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator()
+        : m_chunks(nullptr), m_chunk(0), m_remaining(0), m_ptr(nullptr), m_end(nullptr) {}
+
+    inline reference operator*() const { return *m_ptr; }
+    inline pointer operator->() const { return m_ptr; }
+
+    inline const_iterator& operator++() {
+      if (++m_ptr == m_end)
+        setChunk(m_chunk + 1);
+      return *this;
+    }
+
+    inline const_iterator operator++(int) {
+      const_iterator it = *this;
+      ++(*this);
+      return it;
+    }
+
+    inline bool operator==(const const_iterator& it) const { return m_ptr == it.m_ptr; }
+    inline bool operator!=(const const_iterator& it) const { return m_ptr != it.m_ptr; }
+
+  protected:
+    friend class ChunkedVector<T>;
+
+    /**
+     * Points to the first item of a chunk, or to nothing if all the items
+     * were iterated
+     * @param chunk index of the chunk
+     */
+    inline void setChunk(const size_t chunk) {
+      m_chunk = chunk;
+      if (m_remaining > 0) {
+        const size_t n = std::min(m_chunks[chunk].capacity, m_remaining);
+        m_ptr = m_chunks[chunk].data;
+        m_end = m_ptr + n;
+        m_remaining -= n;
+      }
+      else {
+        m_ptr = m_end = nullptr;
+      }
+    }
+
+    //! Chunks iterated
+    const Chunk* m_chunks;
+    //! Current chunk
+    size_t m_chunk;
+    //! Items after the current chunk
+    size_t m_remaining;
+    //! Current item and end of the current chunk
+    const T* m_ptr;
+    const T* m_end;
+  };
+
+  /**
+   * Creates an empty sequence
+   */
+  ChunkedVector()
+      : m_size(0), m_directory(nullptr), m_capacity(0), m_current(0), m_current_begin(0) {}
+
+  /**
+   * Copies a sequence into a single chunk
+   * @param v
+   */
+  ChunkedVector(const ChunkedVector<T>& v)
+      : ChunkedVector() {
+    *this = v;
+  }
+
+  /**
+   * Takes the items of a sequence, which is left empty
+   * @param v
+   */
+  ChunkedVector(ChunkedVector<T>&& v) noexcept
+      : ChunkedVector() {
+    swap(v);
+  }
+
+  /**
+   * Releases the memory
+   */
+  ~ChunkedVector() { clear(); }
+
+  /**
+   * Copies a sequence into a single chunk
+   * @param v
+   * @return this
+   */
+  ChunkedVector<T>& operator=(const ChunkedVector<T>& v) {
+    if (this != &v) {
+      clear();
+      const size_t n = v.size();
+      reserve(n);
+
+      const_iterator it = v.begin();
+      for (size_t i = 0; i < n; ++i, ++it) {
+        push_back(*it);
+      }
+    }
+    return *this;
+  }
+
+  /**
+   * Takes the items of a sequence, which is left empty
+   * @param v
+   * @return this
+   */
+  ChunkedVector<T>& operator=(ChunkedVector<T>&& v) noexcept {
+    if (this != &v) {
+      clear();
+      swap(v);
+    }
+    return *this;
+  }
+
+  /**
+   * Returns the number of items
+   * @return size
+   */
+  inline size_t size() const { return m_size.load(std::memory_order_acquire); }
+
+  /**
+   * Checks if there are no items
+   * @return true iff size() == 0
+   */
+  inline bool empty() const { return size() == 0; }
+
+  /**
+   * Returns the number of items that fit without allocating
+   * @return capacity
+   */
+  inline size_t capacity() const { return m_capacity; }
+
+  /**
+   * Returns an item. It takes time logarithmic in the size
+   * @param i index of the item (< size())
+   * @return item
+   */
+  inline const T& operator[](const size_t i) const {
+    const Chunk* chunks = m_directory.load(std::memory_order_acquire)->chunks.get();
+
+    size_t offset = i;
+    while (offset >= chunks->capacity) {
+      offset -= chunks->capacity;
+      ++chunks;
+    }
+    return chunks->data[offset];
+  }
+
+  /**
+   * Returns an item to modify. No other thread may be reading it
+   * @param i index of the item (< size())
+   * @return item
+   */
+  inline T& operator[](const size_t i) {
+    return const_cast<T&>(static_cast<const ChunkedVector<T>&>(*this)[i]);
+  }
+
+  /**
+   * Appends an item and makes it visible to the readers
+   * @param item
+   */
+  inline void push_back(const T& item) {
+    nextItem() = item;
+    m_size.store(m_size.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /**
+   * Appends an item, moving it, and makes it visible to the readers
+   * @param item
+   */
+  inline void push_back(T&& item) {
+    nextItem() = std::move(item);
+    m_size.store(m_size.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /**
+   * Appends a range of items
+   * @param first
+   * @param last
+   */
+  template<class It>
+  void append(It first, It last) {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  /**
+   * Ensures that n items fit in total, adding at most one chunk
+   * @param n number of items
+   */
+  void reserve(const size_t n) {
+    if (n > m_capacity)
+      addChunk(n - m_capacity);
+  }
+
+  /**
+   * Replaces the items with an array that the sequence does not own, which
+   * becomes its first chunk. The array is not copied, so it must outlive the
+   * sequence or its next clear. The items appended later go to new chunks
+   * @param data items
+   * @param n number of items
+   */
+  void attach(T* data, const size_t n) {
+    clear();
+    if (n > 0) {
+      addChunk(n, data);
+      m_size.store(n, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Removes all the items and releases the memory
+   */
+  void clear() {
+    Directory* directory = m_directory.load(std::memory_order_relaxed);
+    if (directory != nullptr) {
+      for (size_t c = 0; c < directory->n_chunks; ++c) {
+        if (directory->chunks[c].owned)
+          delete[] directory->chunks[c].data;
+      }
+      delete directory;
+    }
+
+    m_size.store(0, std::memory_order_relaxed);
+    m_directory.store(nullptr, std::memory_order_relaxed);
+    m_capacity = m_current = m_current_begin = 0;
+  }
+
+  /**
+   * Exchanges the items of two sequences
+   * @param v
+   */
+  void swap(ChunkedVector<T>& v) noexcept {
+    const size_t size = m_size.load(std::memory_order_relaxed);
+    m_size.store(v.m_size.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    v.m_size.store(size, std::memory_order_relaxed);
+
+    Directory* directory = m_directory.load(std::memory_order_relaxed);
+    m_directory.store(v.m_directory.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    v.m_directory.store(directory, std::memory_order_relaxed);
+
+    std::swap(m_capacity, v.m_capacity);
+    std::swap(m_current, v.m_current);
+    std::swap(m_current_begin, v.m_current_begin);
+  }
+
+  /**
+   * Returns an iterator to the first item
+   * @return iterator
+   */
+  inline const_iterator begin() const {
+    const_iterator it;
+    it.m_remaining = m_size.load(std::memory_order_acquire);
+    if (it.m_remaining > 0) {
+      it.m_chunks = m_directory.load(std::memory_order_acquire)->chunks.get();
+      it.setChunk(0);
+    }
+    return it;
+  }
+
+  /**
+   * Returns an iterator past the last item
+   * @return iterator
+   */
+  inline const_iterator end() const { return const_iterator(); }
+
+  /**
+   * Returns an iterator to the first item for which pred is false, given
+   * that the items for which it is true come first. It takes time
+   * logarithmic in the size
+   * @param pred
+   * @return iterator, which iterates the items that the sequence had when
+   *   the search began
+   */
+  template<class Predicate>
+  const_iterator partition_point(Predicate pred) const {
+    size_t remaining = m_size.load(std::memory_order_acquire);
+    if (remaining == 0)
+      return end();
+
+    const Chunk* chunks = m_directory.load(std::memory_order_acquire)->chunks.get();
+
+    // skip the chunks whose last item satisfies pred
+    size_t chunk = 0;
+    size_t n = std::min(chunks[0].capacity, remaining);
+    while (pred(chunks[chunk].data[n - 1])) {
+      remaining -= n;
+      if (remaining == 0)
+        return end();
+
+      ++chunk;
+      n = std::min(chunks[chunk].capacity, remaining);
+    }
+
+    const_iterator it;
+    it.m_chunks = chunks;
+    it.m_chunk = chunk;
+    it.m_ptr = std::partition_point(chunks[chunk].data, chunks[chunk].data + n, pred);
+    it.m_end = chunks[chunk].data + n;
+    it.m_remaining = remaining - n;
+    return it;
+  }
+
+protected:
+  //! Capacity of the first chunk when it is not reserved
+  static constexpr size_t MIN_CHUNK_SIZE = 4;
+
+  //! Capacity of the first directory
+  static constexpr size_t MIN_DIRECTORY_SIZE = 4;
+
+  /**
+   * Adds a new chunk after the last one
+   * @param capacity items of the chunk
+   * @param data if given, items of the chunk, which is not owned. Otherwise
+   *   the chunk is allocated
+   */
+  void addChunk(const size_t capacity, T* data = nullptr) {
+    Directory* directory = m_directory.load(std::memory_order_relaxed);
+
+    if (directory == nullptr || directory->n_chunks == directory->capacity) {
+      std::unique_ptr<Directory> larger(new Directory);
+      larger->capacity = directory == nullptr ? MIN_DIRECTORY_SIZE : 2 * directory->capacity;
+      larger->chunks.reset(new Chunk[larger->capacity]);
+      larger->n_chunks = 0;
+
+      if (directory != nullptr) {
+        std::copy(directory->chunks.get(), directory->chunks.get() + directory->n_chunks,
+                  larger->chunks.get());
+        larger->n_chunks = directory->n_chunks;
+        larger->previous.reset(directory);
+      }
+
+      directory = larger.release();
+      m_directory.store(directory, std::memory_order_release);
+    }
+
+    // the readers do not access the new chunk until an item in it is
+    // published
+    Chunk& chunk = directory->chunks[directory->n_chunks];
+    chunk.data = data != nullptr ? data : new T[capacity];
+    chunk.capacity = capacity;
+    chunk.owned = data == nullptr;
+    ++directory->n_chunks;
+
+    m_capacity += capacity;
+  }
+
+  /**
+   * Returns the slot of the next item to append, adding a chunk if needed.
+   * The readers do not see it until the size is increased
+   * @return item
+   */
+  inline T& nextItem() {
+    const size_t n = m_size.load(std::memory_order_relaxed);
+    if (n == m_capacity)
+      addChunk(std::max<size_t>(MIN_CHUNK_SIZE, m_capacity));
+
+    Chunk* chunks = m_directory.load(std::memory_order_relaxed)->chunks.get();
+    if (n - m_current_begin == chunks[m_current].capacity) {
+      m_current_begin = n;
+      ++m_current;
+    }
+
+    return chunks[m_current].data[n - m_current_begin];
+  }
+
+protected:
+  //! Number of items, published after they are written
+  std::atomic<size_t> m_size;
+
+  //! Current directory of chunks. Only the current chunk may be partially
+  //! filled, and the ones after it are empty
+  std::atomic<Directory*> m_directory;
+
+  //! Number of items that fit in the chunks
+  size_t m_capacity;
+
+  //! Chunk where the next item is written
+  size_t m_current;
+
+  //! Index of the first item of the current chunk
+  size_t m_current_begin;
+};
+
+template<class T>
+constexpr size_t ChunkedVector<T>::MIN_CHUNK_SIZE;
+
+template<class T>
+constexpr size_t ChunkedVector<T>::MIN_DIRECTORY_SIZE;
+
+} // namespace DBoW2
+
+#endif
@@ -12,10 +12,14 @@
 #include "DBoW2/TemplatedVocabulary.h"
 #include "DBoW2/TemplatedDatabase.h"
 #include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
 #include "DBoW2/FeatureVector.h"
+#include "DBoW2/FlatFeatureVector.h"
 #include "DBoW2/QueryResults.h"
 #include "DBoW2/FBRIEF.h"
 #include "DBoW2/FORB.h"
+#include "DBoW2/FORBArray.h"
+#include "DBoW2/FFloat.h"
 
 //! ORB Vocabulary
 using OrbVocabulary = DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>;
@@ -23,6 +27,21 @@ using OrbVocabulary = DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2
 //! ORB Database
 using OrbDatabase = DBoW2::TemplatedDatabase<DBoW2::FORB::TDescriptor, DBoW2::FORB>;
 
+//! ORB Vocabulary of descriptors stored in arrays
+using OrbArrayVocabulary = DBoW2::TemplatedVocabulary<DBoW2::FORBArray::TDescriptor, DBoW2::FORBArray>;
+
+//! ORB Database of descriptors stored in arrays
+using OrbArrayDatabase = DBoW2::TemplatedDatabase<DBoW2::FORBArray::TDescriptor, DBoW2::FORBArray>;
+
+//! Functions for 128-D float descriptors (SIFT)
+using FFloat128 = DBoW2::FFloat<128>;
+
+//! Vocabulary of 128-D float descriptors
+using Float128Vocabulary = DBoW2::TemplatedVocabulary<FFloat128::TDescriptor, FFloat128>;
+
+//! Database of 128-D float descriptors
+using Float128Database = DBoW2::TemplatedDatabase<FFloat128::TDescriptor, FFloat128>;
+
 //! BRIEF Vocabulary
 using BriefVocabulary = DBoW2::TemplatedVocabulary<DBoW2::FBRIEF::TDescriptor, DBoW2::FBRIEF>;
 
@@ -0,0 +1,186 @@
+/**
+ * File: DatabaseJournal.h
+ * Date: October 2026
+ * Description: append-only journal of the changes of a database
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_DATABASE_JOURNAL__
+#define __D_T_DATABASE_JOURNAL__
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
+#include "DBoW2/FlatFeatureVector.h"
+#include "DBoW2/QueryResults.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Append-only file of the changes made to a database, numbered in sequence.
+ * The records are buffered and written in batches, with one fsync per batch,
+ * so the cost of durability depends on the number of changes and not on the
+ * size of the database. Each record has a checksum: after a crash, the file
+ * is read up to the last complete record and the rest is discarded
+ */
+class DLL_EXPORT DatabaseJournal {
+public:
+  //! Types of change
+  enum RecordType {
+    ADD_ENTRY = 1,
+    ERASE_ENTRY = 2,
+    COMPACT = 3
+  };
+
+  //! Change of a database
+  struct Record {
+    //! Type of change
+    RecordType type;
+    //! Number of the change in the database
+    uint64_t sequence;
+    //! Vectors of the added entry (ADD_ENTRY)
+    BowVector bow_vector;
+    FlatFeatureVector feature_vector;
+    //! Erased entry (ERASE_ENTRY)
+    EntryId entry_id;
+    //! The entries were renumbered (COMPACT)
+    bool renumber;
+  };
+
+  /**
+   * Opens a journal, creating the file if it does not exist. The incomplete
+   * records at the end of the file are removed. Throws a std::string if the
+   * file cannot be opened or is not a journal
+   * @param filename
+   * @param records_per_sync number of records written to disk at once. The
+   *   ones not written yet are lost if the process crashes
+   */
+  explicit DatabaseJournal(const std::string& filename, const unsigned int records_per_sync = 1);
+
+  /**
+   * Writes the pending records and closes the file
+   */
+  ~DatabaseJournal();
+
+  DatabaseJournal(const DatabaseJournal&) = delete;
+  DatabaseJournal& operator=(const DatabaseJournal&) = delete;
+
+  /**
+   * Reads all the records, from the oldest one. The pending ones are
+   * written first
+   * @param fn function called with each record
+   */
+  void replay(const std::function<void(const Record&)>& fn);
+
+  /**
+   * Appends the record of an added entry
+   * @param sequence number of the change
+   * @param bow_vector bow vector of the entry
+   * @param feature_vector feature vector of the entry
+   */
+  void appendAddEntry(const uint64_t sequence, const BowVector& bow_vector, const FlatFeatureVector& feature_vector);
+
+  /**
+   * Appends the record of an added entry, the same one as with a BowVector
+   * @param sequence number of the change
+   * @param bow_vector flat bow vector of the entry
+   * @param feature_vector feature vector of the entry
+   */
+  void appendAddEntry(const uint64_t sequence, const FlatBowVector& bow_vector,
+                      const FlatFeatureVector& feature_vector);
+
+  /**
+   * Appends the record of an erased entry
+   * @param sequence number of the change
+   * @param entry_id erased entry
+   */
+  void appendEraseEntry(const uint64_t sequence, const EntryId entry_id);
+
+  /**
+   * Appends the record of a compaction
+   * @param sequence number of the change
+   * @param renumber the entries were renumbered
+   */
+  void appendCompact(const uint64_t sequence, const bool renumber);
+
+  /**
+   * Writes the pending records and waits until they are on disk. Throws a
+   * std::string if they cannot be written
+   */
+  void sync();
+
+  /**
+   * Removes all the records, for example once they are saved in a snapshot
+   * of the database
+   */
+  void clear();
+
+protected:
+  /**
+   * Starts a record in the pending buffer
+   * @param type type of change
+   * @param sequence number of the change
+   * @return offset of the record in the buffer
+   */
+  size_t beginRecord(const RecordType type, const uint64_t sequence);
+
+  /**
+   * Completes the last record with its size and checksum, and writes the
+   * pending ones if there are enough. If they cannot be written, the last
+   * record is removed and a std::string is thrown
+   * @param begin offset of the record in the buffer
+   */
+  void endRecord(const size_t begin);
+
+  /**
+   * Reads the record at the current position of the file
+   * @param record (out)
+   * @param available bytes of the file from the current position
+   * @param record_size (out) bytes of the record in the file
+   * @return false if there is no complete and valid record
+   */
+  bool readRecord(Record& record, const uint64_t available, uint64_t& record_size);
+
+  /**
+   * Moves the position of the file
+   * @param offset bytes from the beginning of the file
+   */
+  void seek(const uint64_t offset);
+
+protected:
+  //! Name of the file
+  std::string m_filename;
+
+  //! File
+  FILE* m_file;
+
+  //! Size of the records in the file, including its header
+  uint64_t m_size;
+
+  //! Records not written yet
+  std::vector<unsigned char> m_pending;
+
+  //! Number of records not written yet
+  unsigned int m_n_pending;
+
+  //! Number of records written at once
+  unsigned int m_records_per_sync;
+
+  //! Payload of the last record read
+  std::vector<unsigned char> m_buffer;
+};
+
+} // namespace DBoW2
+
+#endif
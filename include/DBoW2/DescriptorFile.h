@@ -0,0 +1,190 @@
+/**
+ * File: DescriptorFile.h
+ * Date: October 2026
+ * Description: compact files of training descriptors
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_DESCRIPTOR_FILE__
+#define __D_T_DESCRIPTOR_FILE__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Sequence of images whose descriptors are read one image at a time, in
+ * their raw representation (F::toBytes). It is used to create vocabularies
+ * from more descriptors than fit in memory
+ */
+class DLL_EXPORT DescriptorSource {
+public:
+  virtual ~DescriptorSource() {}
+
+  /**
+   * Returns the size of the raw descriptors
+   * @return bytes per descriptor
+   */
+  virtual unsigned int descriptorSize() const = 0;
+
+  /**
+   * Goes back to the first image
+   */
+  virtual void rewind() = 0;
+
+  /**
+   * Reads the descriptors of the next image. Throws a std::string if they
+   * cannot be read
+   * @param descriptors (out) raw descriptors of the image, stored
+   *   contiguously
+   * @return false if there are no more images
+   */
+  virtual bool nextImage(std::vector<unsigned char>& descriptors) = 0;
+};
+
+/**
+ * Writer of descriptor files. A file is a header followed by the images,
+ * each one stored as its number of descriptors and its raw descriptors.
+ * Files are not portable between platforms with different byte orders
+ */
+class DLL_EXPORT DescriptorFileWriter {
+public:
+  /**
+   * Creates a file, replacing it if it exists. Throws a std::string if it
+   * cannot be created
+   * @param filename
+   * @param descriptor_size bytes per raw descriptor (F::byte_size)
+   */
+  DescriptorFileWriter(const std::string& filename, const unsigned int descriptor_size);
+
+  /**
+   * Closes the file if it is still open. Errors are ignored
+   */
+  ~DescriptorFileWriter();
+
+  DescriptorFileWriter(const DescriptorFileWriter&) = delete;
+  DescriptorFileWriter& operator=(const DescriptorFileWriter&) = delete;
+
+  /**
+   * Appends an image
+   * @param descriptors n raw descriptors, stored contiguously
+   * @param n number of descriptors
+   */
+  void addImage(const unsigned char* descriptors, const unsigned int n);
+
+  /**
+   * Appends an image
+   * @param F class of descriptor functions, which gives the raw descriptors
+   * @param descriptors descriptors of the image
+   */
+  template<class F, class TDescriptor>
+  void addImage(const std::vector<TDescriptor>& descriptors) {
+    m_buffer.resize(descriptors.size() * m_descriptor_size);
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+      F::toBytes(descriptors[i], m_buffer.data() + i * m_descriptor_size);
+    }
+    addImage(m_buffer.data(), descriptors.size());
+  }
+
+  /**
+   * Writes the counts of the header and closes the file. Throws a
+   * std::string if the file cannot be written
+   */
+  void close();
+
+  /**
+   * Returns the number of images written
+   * @return images
+   */
+  inline uint64_t nImages() const { return m_n_images; }
+
+  /**
+   * Returns the number of descriptors written
+   * @return descriptors
+   */
+  inline uint64_t nDescriptors() const { return m_n_descriptors; }
+
+protected:
+  //! Name of the file
+  std::string m_filename;
+
+  //! File, or nullptr once closed
+  FILE* m_file;
+
+  //! Bytes per descriptor
+  unsigned int m_descriptor_size;
+
+  //! Counts written
+  uint64_t m_n_images, m_n_descriptors;
+
+  //! Raw descriptors of the last image given as objects
+  std::vector<unsigned char> m_buffer;
+};
+
+/**
+ * Reader of the files written by DescriptorFileWriter
+ */
+class DLL_EXPORT DescriptorFileReader : public DescriptorSource {
+public:
+  /**
+   * Opens a file. Throws a std::string if it cannot be opened or is not a
+   * descriptor file
+   * @param filename
+   */
+  explicit DescriptorFileReader(const std::string& filename);
+
+  /**
+   * Closes the file
+   */
+  ~DescriptorFileReader();
+
+  DescriptorFileReader(const DescriptorFileReader&) = delete;
+  DescriptorFileReader& operator=(const DescriptorFileReader&) = delete;
+
+  virtual unsigned int descriptorSize() const { return m_descriptor_size; }
+
+  virtual void rewind();
+
+  virtual bool nextImage(std::vector<unsigned char>& descriptors);
+
+  /**
+   * Returns the number of images of the file
+   * @return images
+   */
+  inline uint64_t nImages() const { return m_n_images; }
+
+  /**
+   * Returns the number of descriptors of the file
+   * @return descriptors
+   */
+  inline uint64_t nDescriptors() const { return m_n_descriptors; }
+
+protected:
+  //! Name of the file
+  std::string m_filename;
+
+  //! File
+  FILE* m_file;
+
+  //! Bytes per descriptor
+  unsigned int m_descriptor_size;
+
+  //! Counts of the header
+  uint64_t m_n_images, m_n_descriptors;
+
+  //! Images read since the beginning
+  uint64_t m_n_read;
+};
+
+} // namespace DBoW2
+
+#endif
@@ -33,6 +33,9 @@ public:
   //! Descriptor length (in bits)
   static constexpr int L = 256;
 
+  //! Size of the raw representation of a descriptor (in bytes)
+  static constexpr int byte_size = L / 8;
+
   //! Descriptor type
   using TDescriptor = std::bitset<L>;
   //! Pointer to a single descriptor
@@ -53,6 +56,39 @@ public:
    */
   static double distance(const TDescriptor& a, const TDescriptor& b);
 
+  /**
+   * Calculates the distance between two descriptors given as raw bytes
+   * @param a byte_size bytes
+   * @param b byte_size bytes
+   * @return distance
+   */
+  static double distance(const unsigned char* a, const unsigned char* b);
+
+  /**
+   * Calculates the distances between a descriptor and a set of descriptors
+   * given as raw bytes
+   * @param a byte_size bytes
+   * @param b n descriptors of byte_size bytes, stored contiguously
+   * @param n number of descriptors in b
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d);
+
+  /**
+   * Copies the raw representation of a descriptor. Bit i of the descriptor
+   * is stored in the bit (i % 8) of the byte i / 8
+   * @param a descriptor
+   * @param buf (out) buffer of byte_size bytes
+   */
+  static void toBytes(const TDescriptor& a, unsigned char* buf);
+
+  /**
+   * Creates a descriptor from its raw representation (see toBytes)
+   * @param a (out) descriptor
+   * @param buf buffer of byte_size bytes
+   */
+  static void fromBytes(TDescriptor& a, const unsigned char* buf);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -32,6 +32,9 @@ class DLL_EXPORT FClass {
   class TDescriptor;
   typedef const TDescriptor* pDescriptor;
 
+  //! Size of the raw representation of a descriptor (in bytes)
+  static const int byte_size;
+
   /**
    * Calculates the mean value of a set of descriptors
    * @param descriptors
@@ -49,6 +52,39 @@ class DLL_EXPORT FClass {
    */
   static double distance(const TDescriptor& a, const TDescriptor& b);
 
+  /**
+   * Calculates the distance between two descriptors given as raw bytes.
+   * Must return the same value as distance() on the original descriptors
+   * @param a byte_size bytes
+   * @param b byte_size bytes
+   * @return distance
+   */
+  static double distance(const unsigned char* a, const unsigned char* b);
+
+  /**
+   * Calculates the distances between a descriptor and a set of descriptors
+   * given as raw bytes
+   * @param a byte_size bytes
+   * @param b n descriptors of byte_size bytes, stored contiguously
+   * @param n number of descriptors in b
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d);
+
+  /**
+   * Copies the raw representation of a descriptor
+   * @param a descriptor
+   * @param buf (out) buffer of byte_size bytes
+   */
+  static void toBytes(const TDescriptor& a, unsigned char* buf);
+
+  /**
+   * Creates a descriptor from its raw representation
+   * @param a (out) descriptor
+   * @param buf buffer of byte_size bytes
+   */
+  static void fromBytes(TDescriptor& a, const unsigned char* buf);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -0,0 +1,313 @@
+/**
+ * File: FFloat.h
+ * Date: October 2026
+ * Description: functions for descriptors made of D floats
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_F_FLOAT__
+#define __D_T_F_FLOAT__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "DBoW2/FClass.h"
+#include "DBoW2/FloatDistance.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Functions to manipulate descriptors made of D floats (e.g. SIFT or SURF
+ * descriptors), stored in fixed-size arrays. The distance is the squared
+ * Euclidean distance, and the mean is the element-wise average. Both are
+ * computed by the FloatDistance kernels
+ * @param D number of elements of a descriptor
+ */
+template<int D>
+class DLL_EXPORT FFloat : protected FClass {
+public:
+  static_assert(D > 0, "descriptors must have at least one element");
+
+  //! Descriptor length (in floats)
+  static constexpr int L = D;
+
+  //! Size of the raw representation of a descriptor (in bytes)
+  static constexpr int byte_size = D * sizeof(float);
+
+  //! Descriptor type
+  using TDescriptor = std::array<float, D>;
+  //! Pointer to a single descriptor
+  using pDescriptor = const TDescriptor*;
+
+  /**
+   * Calculates the mean value of a set of descriptors
+   * @param descriptors
+   * @param mean mean descriptor (zeros if there are no descriptors)
+   */
+  static void meanValue(const std::vector<pDescriptor>& descriptors, TDescriptor& mean);
+
+  /**
+   * Calculates the squared Euclidean distance between two descriptors
+   * @param a
+   * @param b
+   * @return distance
+   */
+  static double distance(const TDescriptor& a, const TDescriptor& b);
+
+  /**
+   * Calculates the distance between two descriptors given as raw bytes
+   * @param a byte_size bytes
+   * @param b byte_size bytes
+   * @return distance
+   */
+  static double distance(const unsigned char* a, const unsigned char* b);
+
+  /**
+   * Calculates the distances between a descriptor and a set of descriptors
+   * given as raw bytes
+   * @param a byte_size bytes
+   * @param b n descriptors of byte_size bytes, stored contiguously
+   * @param n number of descriptors in b
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d);
+
+  /**
+   * Copies the raw representation of a descriptor (the floats in the byte
+   * order of the machine)
+   * @param a descriptor
+   * @param buf (out) buffer of byte_size bytes
+   */
+  static void toBytes(const TDescriptor& a, unsigned char* buf);
+
+  /**
+   * Creates a descriptor from its raw representation
+   * @param a (out) descriptor
+   * @param buf buffer of byte_size bytes
+   */
+  static void fromBytes(TDescriptor& a, const unsigned char* buf);
+
+  /**
+   * Returns a string version of the descriptor, with enough digits to read
+   * back the same floats
+   * @param a descriptor
+   * @return string version
+   */
+  static std::string toString(const TDescriptor& a);
+
+  /**
+   * Returns a descriptor from a string
+   * @param a descriptor
+   * @param s string version
+   */
+  static void fromString(TDescriptor& a, const std::string& s);
+
+  /**
+   * Returns the descriptors of the rows of an OpenCV matrix. A continuous
+   * matrix is copied at once. Throws a std::string if the rows are not
+   * descriptors of D floats
+   * @param mat NxD CV_32F matrix
+   * @param descriptors (out) N descriptors
+   */
+  static void fromMat32F(const cv::Mat& mat, std::vector<TDescriptor>& descriptors);
+
+  /**
+   * Returns a mat with the descriptors in float format
+   * @param descriptors
+   * @param mat (out) NxD 32F matrix
+   */
+  static void toMat32F(const std::vector<TDescriptor>& descriptors, cv::Mat& mat);
+
+protected:
+  //! Number of raw descriptors that distances() copies at once
+  static constexpr unsigned int chunk_size = D >= 1024 ? 1 : 1024 / D;
+
+  /**
+   * Copies raw descriptors to floats. Raw bytes (the storage of a search
+   * layout or a mapped file) are never read through a float pointer, even
+   * if they are aligned, since that would break the strict aliasing rule
+   * @param p n * byte_size bytes
+   * @param n number of descriptors
+   * @param floats (out) n * D floats
+   */
+  static void copyFloats(const unsigned char* p, const unsigned int n, float* floats);
+};
+
+// --------------------------------------------------------------------------
+
+template<int D>
+constexpr int FFloat<D>::L;
+
+template<int D>
+constexpr int FFloat<D>::byte_size;
+
+template<int D>
+constexpr unsigned int FFloat<D>::chunk_size;
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::meanValue(const std::vector<pDescriptor>& descriptors, TDescriptor& mean) {
+  static_assert(sizeof(TDescriptor) == byte_size, "std::array has an unexpected size");
+  static_assert(std::is_trivially_copyable<TDescriptor>::value, "std::array must be trivially copyable");
+
+  if (descriptors.empty()) {
+    mean.fill(0.f);
+    return;
+  }
+  else if (descriptors.size() == 1) {
+    mean = *descriptors[0];
+    return;
+  }
+
+  std::vector<const float*> vectors(descriptors.size());
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    vectors[i] = descriptors[i]->data();
+  }
+
+  FloatDistance::mean(vectors.data(), vectors.size(), D, mean.data());
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+double FFloat<D>::distance(const TDescriptor& a, const TDescriptor& b) {
+  return FloatDistance::distance(a.data(), b.data(), D);
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+double FFloat<D>::distance(const unsigned char* a, const unsigned char* b) {
+  TDescriptor fa, fb;
+  copyFloats(a, 1, fa.data());
+  copyFloats(b, 1, fb.data());
+  return FloatDistance::distance(fa.data(), fb.data(), D);
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d) {
+  TDescriptor fa;
+  copyFloats(a, 1, fa.data());
+
+  float fb[chunk_size * D];
+  float buf[chunk_size];
+  for (unsigned int i = 0; i < n; i += chunk_size) {
+    const unsigned int m = std::min(n - i, chunk_size);
+    copyFloats(b + (size_t)i * byte_size, m, fb);
+    FloatDistance::distances(fa.data(), fb, D, m, buf);
+    for (unsigned int j = 0; j < m; ++j) {
+      d[i + j] = buf[j];
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::toBytes(const TDescriptor& a, unsigned char* buf) {
+  memcpy(buf, a.data(), byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::fromBytes(TDescriptor& a, const unsigned char* buf) {
+  memcpy(a.data(), buf, byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+std::string FFloat<D>::toString(const TDescriptor& a) {
+  std::stringstream ss;
+  ss.precision(std::numeric_limits<float>::max_digits10);
+  for (int i = 0; i < D; ++i) {
+    ss << a[i] << " ";
+  }
+
+  return ss.str();
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::fromString(TDescriptor& a, const std::string& s) {
+  a.fill(0.f);
+
+  std::stringstream ss(s);
+  for (int i = 0; i < D; ++i) {
+    float v;
+    ss >> v;
+
+    if (!ss.fail())
+      a[i] = v;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::fromMat32F(const cv::Mat& mat, std::vector<TDescriptor>& descriptors) {
+  if (mat.empty()) {
+    descriptors.clear();
+    return;
+  }
+
+  if (mat.cols != D || mat.type() != CV_32F)
+    throw std::string("Float descriptors must be rows of ") + std::to_string(D) + " floats (CV_32F)";
+
+  descriptors.resize(mat.rows);
+
+  if (mat.isContinuous()) {
+    memcpy(descriptors.data(), mat.ptr<float>(), (size_t)mat.rows * byte_size);
+  }
+  else {
+    for (int i = 0; i < mat.rows; ++i) {
+      fromBytes(descriptors[i], mat.ptr<unsigned char>(i));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::toMat32F(const std::vector<TDescriptor>& descriptors, cv::Mat& mat) {
+  if (descriptors.empty()) {
+    mat.release();
+    return;
+  }
+
+  mat.create(descriptors.size(), D, CV_32F);
+  memcpy(mat.ptr<float>(), descriptors.data(), descriptors.size() * byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+template<int D>
+void FFloat<D>::copyFloats(const unsigned char* p, const unsigned int n, float* floats) {
+  memcpy(floats, p, (size_t)n * byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
+
+#endif
@@ -32,6 +32,9 @@ public:
   //! Descriptor length (in bytes)
   static constexpr int L = 32;
 
+  //! Size of the raw representation of a descriptor (in bytes)
+  static constexpr int byte_size = L;
+
   //! Descriptor type
   using TDescriptor = cv::Mat;
   //! Pointer to a single descriptor
@@ -46,12 +49,44 @@ public:
 
   /**
    * Calculates the distance between two descriptors
-   * @param a
-   * @param b
+   * @param a 1xN CV_8U matrix (N is a multiple of 8, usually FORB::L)
+   * @param b 1xN CV_8U matrix
    * @return distance
    */
   static double distance(const TDescriptor& a, const TDescriptor& b);
 
+  /**
+   * Calculates the distance between two descriptors given as raw bytes
+   * @param a byte_size bytes
+   * @param b byte_size bytes
+   * @return distance
+   */
+  static double distance(const unsigned char* a, const unsigned char* b);
+
+  /**
+   * Calculates the distances between a descriptor and a set of descriptors
+   * given as raw bytes
+   * @param a byte_size bytes
+   * @param b n descriptors of byte_size bytes, stored contiguously
+   * @param n number of descriptors in b
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d);
+
+  /**
+   * Copies the raw representation of a descriptor
+   * @param a descriptor
+   * @param buf (out) buffer of byte_size bytes
+   */
+  static void toBytes(const TDescriptor& a, unsigned char* buf);
+
+  /**
+   * Creates a descriptor from its raw representation
+   * @param a (out) descriptor
+   * @param buf buffer of byte_size bytes
+   */
+  static void fromBytes(TDescriptor& a, const unsigned char* buf);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -0,0 +1,144 @@
+/**
+ * File: FORBArray.h
+ * Date: October 2026
+ * Description: functions for ORB descriptors stored in fixed-size arrays
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_FORB_ARRAY__
+#define __D_T_FORB_ARRAY__
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "DBoW2/FClass.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Functions to manipulate ORB descriptors stored in arrays of 64-bit words
+ * instead of cv::Mat. A descriptor is a trivially copyable value without
+ * any allocation, which holds the 32 bytes of the ORB descriptor in the same
+ * order. The raw representation is the same as the one of FORB, so the
+ * vocabularies of both classes are interchangeable
+ */
+class DLL_EXPORT FORBArray : protected FClass {
+public:
+  //! Descriptor length (in bytes)
+  static constexpr int L = 32;
+
+  //! Size of the raw representation of a descriptor (in bytes)
+  static constexpr int byte_size = L;
+
+  //! Descriptor type
+  using TDescriptor = std::array<uint64_t, L / 8>;
+  //! Pointer to a single descriptor
+  using pDescriptor = const TDescriptor*;
+
+  /**
+   * Calculates the mean value of a set of descriptors. Each bit is set if
+   * it is set in at least half of the descriptors, as in FORB
+   * @param descriptors
+   * @param mean mean descriptor
+   */
+  static void meanValue(const std::vector<pDescriptor>& descriptors, TDescriptor& mean);
+
+  /**
+   * Calculates the distance between two descriptors
+   * @param a
+   * @param b
+   * @return distance
+   */
+  static double distance(const TDescriptor& a, const TDescriptor& b);
+
+  /**
+   * Calculates the distance between two descriptors given as raw bytes
+   * @param a byte_size bytes
+   * @param b byte_size bytes
+   * @return distance
+   */
+  static double distance(const unsigned char* a, const unsigned char* b);
+
+  /**
+   * Calculates the distances between a descriptor and a set of descriptors
+   * given as raw bytes
+   * @param a byte_size bytes
+   * @param b n descriptors of byte_size bytes, stored contiguously
+   * @param n number of descriptors in b
+   * @param d (out) n distances
+   */
+  static void distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d);
+
+  /**
+   * Copies the raw representation of a descriptor
+   * @param a descriptor
+   * @param buf (out) buffer of byte_size bytes
+   */
+  static void toBytes(const TDescriptor& a, unsigned char* buf);
+
+  /**
+   * Creates a descriptor from its raw representation
+   * @param a (out) descriptor
+   * @param buf buffer of byte_size bytes
+   */
+  static void fromBytes(TDescriptor& a, const unsigned char* buf);
+
+  /**
+   * Returns a string version of the descriptor, the same one as FORB's
+   * @param a descriptor
+   * @return string version
+   */
+  static std::string toString(const TDescriptor& a);
+
+  /**
+   * Returns a descriptor from a string
+   * @param a descriptor
+   * @param s string version
+   */
+  static void fromString(TDescriptor& a, const std::string& s);
+
+  /**
+   * Returns the descriptors of the rows of an OpenCV matrix, as given by
+   * the ORB extractor. A continuous matrix is copied at once. Throws a
+   * std::string if the rows are not ORB descriptors
+   * @param mat NxL CV_8U matrix
+   * @param descriptors (out) N descriptors
+   */
+  static void fromMat8U(const cv::Mat& mat, std::vector<TDescriptor>& descriptors);
+
+  /**
+   * Returns a matrix with the descriptor in OpenCV format
+   * @param descriptors vector of N descriptors
+   * @param mat (out) NxL CV_8U matrix
+   */
+  static void toMat8U(const std::vector<TDescriptor>& descriptors, cv::Mat& mat);
+
+  /**
+   * Returns a matrix that refers to the descriptors without copying them.
+   * It is valid while the vector is not modified
+   * @param descriptors vector of N descriptors
+   * @return NxL CV_8U matrix
+   */
+  static cv::Mat wrapMat8U(const std::vector<TDescriptor>& descriptors);
+
+  /**
+   * Returns a mat with the descriptors in float format
+   * @param descriptors
+   * @param mat (out) Nx(L*8) 32F matrix
+   */
+  static void toMat32F(const std::vector<TDescriptor>& descriptors, cv::Mat& mat);
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * File: FileSync.h
+ * Date: October 2026
+ * Description: waits until the data written to files are on disk
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_FILE_SYNC__
+#define __D_T_FILE_SYNC__
+
+#include <cstdio>
+#include <string>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Functions to make the files written by the vocabularies and the databases
+ * (checkpoints, snapshots and journals) durable before they are relied on
+ */
+class DLL_EXPORT FileSync {
+public:
+  /**
+   * Writes the buffer of an open file and waits until its data are on disk
+   * @param file
+   * @return true iff it succeeded
+   */
+  static bool flush(FILE* file);
+
+  /**
+   * Waits until a file written by other means is on disk. Throws a
+   * std::string if it cannot be synced
+   * @param filename
+   */
+  static void sync(const std::string& filename);
+};
+
+} // namespace DBoW2
+
+#endif
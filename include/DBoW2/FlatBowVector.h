@@ -0,0 +1,104 @@
+/**
+ * File: FlatBowVector.h
+ * Date: October 2026
+ * Description: bag of words vector stored in a sorted array
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_FLAT_BOW_VECTOR__
+#define __D_T_FLAT_BOW_VECTOR__
+
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "DBoW2/BowVector.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Vector of words to represent images, with the same content as a BowVector
+ * but stored in a contiguous array of (word id, value) pairs sorted by id.
+ * It is built by appending the words in any order and sorting them once at
+ * the end, instead of inserting them one by one in a tree
+ */
+class DLL_EXPORT FlatBowVector : public std::vector<std::pair<WordId, WordValue>> {
+public:
+  /**
+   * Constructor
+   */
+  FlatBowVector();
+
+  /**
+   * Creates the vector with the words of a bow vector
+   * @param v
+   */
+  explicit FlatBowVector(const BowVector& v);
+
+  /**
+   * Destructor
+   */
+  ~FlatBowVector();
+
+  /**
+   * Copies the words to a bow vector
+   * @param v (out)
+   */
+  void toBowVector(BowVector& v) const;
+
+  /**
+   * Appends a word at the end of the vector, even if it breaks the order of
+   * the ids or the word exists. The vector must be sorted before using it
+   * @param id word id
+   * @param v value of the word
+   */
+  inline void append(const WordId id, const WordValue v) {
+    this->push_back(value_type(id, v));
+  }
+
+  /**
+   * Sorts the words appended by id, and merges the ones with the same id by
+   * adding their values in the order they were appended. The result is the
+   * same as calling BowVector::addWeight with each word
+   */
+  void sort();
+
+  /**
+   * Returns the first word whose id is not lower than the given one
+   * @param id word id
+   * @return iterator to the word, or end()
+   */
+  const_iterator lower_bound(const WordId id) const;
+  iterator lower_bound(const WordId id);
+
+  /**
+   * Looks for a word
+   * @param id word id
+   * @return iterator to the word, or end() if it does not exist
+   */
+  const_iterator find(const WordId id) const;
+  iterator find(const WordId id);
+
+  /**
+   * Normalizes the values in the vector
+   * @param norm_type norm used
+   */
+  void normalize(const LNorm norm_type);
+
+  /**
+   * Prints the content of the bow vector
+   * @param out stream
+   * @param v
+   */
+  friend std::ostream& operator<<(std::ostream& out, const FlatBowVector& v);
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * File: FlatFeatureVector.h
+ * Date: October 2026
+ * Description: feature vector stored in a single buffer
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_FLAT_FEATURE_VECTOR__
+#define __D_T_FLAT_FEATURE_VECTOR__
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "DBoW2/BowVector.h"
+#include "DBoW2/FeatureVector.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Vector of nodes with indexes of local features, with the same content as a
+ * FeatureVector but stored in three arrays of one buffer: the node ids in
+ * ascending order, the offset of the first feature of each node (plus the
+ * total number of features), and the feature indexes of all the nodes. It
+ * is iterated as a FeatureVector: it->first is the node id, and it->second
+ * the range of its feature indexes. The buffer can also be an array that
+ * the vector does not own, such as a mapped file (see attach)
+ */
+class DLL_EXPORT FlatFeatureVector {
+public:
+  //! Feature indexes of a node
+  class FeatureRange {
+  public:
+    using const_iterator = const unsigned int*;
+
+    FeatureRange()
+        : m_begin(nullptr), m_end(nullptr) {}
+
+    FeatureRange(const unsigned int* begin, const unsigned int* end)
+        : m_begin(begin), m_end(end) {}
+
+    inline const_iterator begin() const { return m_begin; }
+    inline const_iterator end() const { return m_end; }
+    inline const unsigned int* data() const { return m_begin; }
+    inline size_t size() const { return m_end - m_begin; }
+    inline bool empty() const { return m_begin == m_end; }
+    inline unsigned int operator[](const size_t i) const { return m_begin[i]; }
+
+  protected:
+    const unsigned int* m_begin;
+    const unsigned int* m_end;
+  };
+
+  //! Node id and its feature indexes
+  using value_type = std::pair<NodeId, FeatureRange>;
+
+  //! Iterator over the nodes, in ascending order of id
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = FlatFeatureVector::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator()
+        : m_v(nullptr), m_i(0) {}
+
+    const_iterator(const FlatFeatureVector* v, const size_t i)
+        : m_v(v), m_i(i) { update(); }
+
+    inline reference operator*() const { return m_value; }
+    inline pointer operator->() const { return &m_value; }
+
+    inline const_iterator& operator++() {
+      ++m_i;
+      update();
+      return *this;
+    }
+
+    inline const_iterator operator++(int) {
+      const_iterator it = *this;
+      ++(*this);
+      return it;
+    }
+
+    inline bool operator==(const const_iterator& it) const { return m_i == it.m_i; }
+    inline bool operator!=(const const_iterator& it) const { return m_i != it.m_i; }
+
+  protected:
+    //! Points the value to the current node
+    inline void update() {
+      if (m_v != nullptr && m_i < m_v->size())
+        m_value = value_type(m_v->nodeIds()[m_i], m_v->features(m_i));
+    }
+
+    const FlatFeatureVector* m_v;
+    size_t m_i;
+    value_type m_value;
+  };
+
+  /**
+   * Empty constructor
+   */
+  FlatFeatureVector();
+
+  /**
+   * Creates the vector with the nodes of a feature vector
+   * @param fv
+   */
+  explicit FlatFeatureVector(const FeatureVector& fv);
+
+  /**
+   * Copies the nodes of a vector into a buffer of its own
+   * @param v
+   */
+  FlatFeatureVector(const FlatFeatureVector& v);
+
+  /**
+   * Takes the buffer of a vector, which is left empty
+   * @param v
+   */
+  FlatFeatureVector(FlatFeatureVector&& v) noexcept;
+
+  /**
+   * Copies the nodes of a vector into a buffer of its own
+   * @param v
+   * @return this
+   */
+  FlatFeatureVector& operator=(const FlatFeatureVector& v);
+
+  /**
+   * Takes the buffer of a vector, which is left empty
+   * @param v
+   * @return this
+   */
+  FlatFeatureVector& operator=(FlatFeatureVector&& v) noexcept;
+
+  /**
+   * Copies the nodes to a feature vector
+   * @param fv (out)
+   */
+  void toFeatureVector(FeatureVector& fv) const;
+
+  /**
+   * Replaces the content with the one of (node id, feature index) pairs
+   * sorted by node id. The features of each node keep their order
+   * @param entries
+   */
+  void assign(const std::vector<std::pair<NodeId, unsigned int>>& entries);
+
+  /**
+   * Allocates room for some nodes and features, to be filled through
+   * nodeIds, offsets and features. The node ids must be written in ascending
+   * order, with offsets()[0] = 0 and offsets()[n_nodes] = n_features
+   * @param n_nodes
+   * @param n_features
+   */
+  void resize(const size_t n_nodes, const size_t n_features);
+
+  /**
+   * Replaces the content with an array that the vector does not own, with
+   * the node ids, the offsets and the feature indexes in the same layout as
+   * the buffer. The array is not copied, so it must outlive the vector or
+   * its next change. Copies of the vector own their buffer
+   * @param data array of 2 * n_nodes + 1 + n_features values, or none if
+   *   n_nodes is 0
+   * @param n_nodes
+   */
+  void attach(unsigned int* data, const size_t n_nodes);
+
+  /**
+   * Removes all the nodes
+   */
+  void clear();
+
+  /**
+   * Returns the number of nodes
+   * @return number of nodes
+   */
+  inline size_t size() const { return m_n_nodes; }
+
+  /**
+   * Checks if there are no nodes
+   * @return true iff it is empty
+   */
+  inline bool empty() const { return m_n_nodes == 0; }
+
+  /**
+   * Returns the number of feature indexes of all the nodes
+   * @return number of features
+   */
+  inline size_t featureCount() const { return empty() ? 0 : offsets()[m_n_nodes]; }
+
+  inline const_iterator begin() const { return const_iterator(this, 0); }
+  inline const_iterator end() const { return const_iterator(this, m_n_nodes); }
+
+  /**
+   * Looks for a node
+   * @param id node id
+   * @return iterator to the node, or end() if it does not exist
+   */
+  const_iterator find(const NodeId id) const;
+
+  /**
+   * Returns the features of the i-th node
+   * @param i node index (< size())
+   * @return feature indexes
+   */
+  inline FeatureRange features(const size_t i) const {
+    const unsigned int* offsets = this->offsets();
+    return FeatureRange(features() + offsets[i], features() + offsets[i + 1]);
+  }
+
+  /**
+   * Arrays of the vector: node ids (size()), offsets of the features of
+   * each node (size() + 1, or none if it is empty) and feature indexes
+   * (featureCount())
+   */
+  inline const NodeId* nodeIds() const { return m_values; }
+  inline NodeId* nodeIds() { return m_values; }
+  inline const unsigned int* offsets() const { return m_values + m_n_nodes; }
+  inline unsigned int* offsets() { return m_values + m_n_nodes; }
+  inline const unsigned int* features() const { return m_values + (empty() ? 0 : 2 * m_n_nodes + 1); }
+  inline unsigned int* features() { return m_values + (empty() ? 0 : 2 * m_n_nodes + 1); }
+
+  /**
+   * Returns the number of values of the buffer (node ids, offsets and
+   * feature indexes)
+   * @return number of values
+   */
+  inline size_t valueCount() const { return empty() ? 0 : 2 * m_n_nodes + 1 + featureCount(); }
+
+  /**
+   * Checks if two vectors have the same nodes and features
+   * @param v
+   * @return true iff they are equal
+   */
+  inline bool operator==(const FlatFeatureVector& v) const {
+    return m_n_nodes == v.m_n_nodes && std::equal(m_values, m_values + valueCount(), v.m_values);
+  }
+
+  inline bool operator!=(const FlatFeatureVector& v) const { return !(*this == v); }
+
+  /**
+   * Sends a string version of the feature vector through the stream, in the
+   * same format as the one of FeatureVector
+   * @param out stream
+   * @param v feature vector
+   */
+  friend std::ostream& operator<<(std::ostream& out, const FlatFeatureVector& v);
+
+protected:
+  //! Number of nodes
+  size_t m_n_nodes;
+
+  //! Node ids, offsets and feature indexes, in this order: m_data, or an
+  //! attached array
+  unsigned int* m_values;
+
+  //! Buffer owned by the vector (empty if an array is attached)
+  std::vector<unsigned int> m_data;
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * File: FloatDistance.h
+ * Date: October 2026
+ * Description: squared Euclidean distance kernels with run-time dispatch
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_FLOAT_DISTANCE__
+#define __D_T_FLOAT_DISTANCE__
+
+#include <cstddef>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Squared Euclidean (L2) distance and mean of vectors of floats.
+ * Several implementations (kernels) are compiled in. The fastest one that
+ * the CPU supports is selected once at startup. All the kernels add up the
+ * terms in the same order, so they return exactly the same values
+ */
+class DLL_EXPORT FloatDistance {
+public:
+  //! Implementations of the distance
+  enum Kernel {
+    GENERIC, //!< portable code
+    AVX2,    //!< 256-bit registers
+    AVX512   //!< 512-bit registers (AVX-512F)
+  };
+
+  /**
+   * Returns the squared L2 distance between two vectors
+   * @param a n floats
+   * @param b n floats
+   * @param n length of the vectors
+   * @return squared distance
+   */
+  static inline float distance(const float* a, const float* b, const size_t n) {
+    return m_distance(a, b, n);
+  }
+
+  /**
+   * Computes the squared L2 distances between a vector and a set of vectors
+   * stored contiguously
+   * @param a n floats
+   * @param b k * n floats
+   * @param n length of the vectors
+   * @param k number of vectors in b
+   * @param d (out) k distances, d[i] is the distance between a and b + i * n
+   */
+  static inline void distances(const float* a, const float* b, const size_t n,
+                               const unsigned int k, float* d) {
+    m_distances(a, b, n, k, d);
+  }
+
+  /**
+   * Computes the mean of a set of vectors. The sums are done in double
+   * precision, adding the vectors in the given order
+   * @param vectors k pointers to vectors of n floats
+   * @param k number of vectors (> 0)
+   * @param n length of the vectors
+   * @param mean (out) n floats
+   */
+  static inline void mean(const float* const* vectors, const size_t k, const size_t n,
+                          float* mean) {
+    m_mean(vectors, k, n, mean);
+  }
+
+  /**
+   * Returns the squared L2 distance computed with the given kernel
+   * @param kernel kernel to use (must be supported)
+   * @param a n floats
+   * @param b n floats
+   * @param n length of the vectors
+   * @return squared distance
+   */
+  static float distance(const Kernel kernel, const float* a, const float* b, const size_t n);
+
+  /**
+   * Computes the squared L2 distances with the given kernel
+   * @param kernel kernel to use (must be supported)
+   * @param a n floats
+   * @param b k * n floats
+   * @param n length of the vectors
+   * @param k number of vectors in b
+   * @param d (out) k distances
+   */
+  static void distances(const Kernel kernel, const float* a, const float* b, const size_t n,
+                        const unsigned int k, float* d);
+
+  /**
+   * Computes the mean of a set of vectors with the given kernel
+   * @param kernel kernel to use (must be supported)
+   * @param vectors k pointers to vectors of n floats
+   * @param k number of vectors (> 0)
+   * @param n length of the vectors
+   * @param mean (out) n floats
+   */
+  static void mean(const Kernel kernel, const float* const* vectors, const size_t k,
+                   const size_t n, float* mean);
+
+  /**
+   * Returns the kernel in use
+   * @return kernel
+   */
+  static Kernel getKernel();
+
+  /**
+   * Selects the kernel to use
+   * @note This is not thread safe, and it is meant for tests and benchmarks
+   * @param kernel kernel to use. Throws if the CPU does not support it
+   */
+  static void setKernel(const Kernel kernel);
+
+  /**
+   * Returns whether the kernel is compiled in and supported by the CPU
+   * @param kernel
+   * @return true iff the kernel can be used
+   */
+  static bool isSupported(const Kernel kernel);
+
+  /**
+   * Returns the fastest kernel supported by the CPU
+   * @return kernel
+   */
+  static Kernel detectKernel();
+
+  /**
+   * Returns the name of a kernel
+   * @param kernel
+   * @return name
+   */
+  static const char* getKernelName(const Kernel kernel);
+
+protected:
+  //! Signature of the kernels of distance
+  typedef float (*DistanceFunction)(const float*, const float*, size_t);
+
+  //! Signature of the kernels of distances
+  typedef void (*DistancesFunction)(const float*, const float*, size_t, unsigned int, float*);
+
+  //! Signature of the kernels of mean
+  typedef void (*MeanFunction)(const float* const*, size_t, size_t, float*);
+
+  //! Kernel in use
+  static Kernel m_kernel;
+
+  //! Implementation of distance in use
+  static DistanceFunction m_distance;
+
+  //! Implementation of distances in use
+  static DistancesFunction m_distances;
+
+  //! Implementation of mean in use
+  static MeanFunction m_mean;
+};
+
+} // namespace DBoW2
+
+#endif
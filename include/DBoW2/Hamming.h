@@ -0,0 +1,152 @@
+/**
+ * File: Hamming.h
+ * Date: October 2026
+ * Description: Hamming distance kernels with run-time dispatch
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_HAMMING__
+#define __D_T_HAMMING__
+
+#include <cstddef>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Hamming distance between bit strings stored as raw bytes.
+ * Several implementations (kernels) are compiled in. The fastest one that
+ * the CPU supports is selected once at startup. It also computes the
+ * bitwise majority of a set of bit strings, their mean in Hamming space
+ */
+class DLL_EXPORT Hamming {
+public:
+  //! Implementations of the distance
+  enum Kernel {
+    GENERIC, //!< portable bit counting (no special instruction)
+    POPCNT,  //!< scalar POPCNT instruction
+    AVX2,    //!< AVX2 nibble lookup table (vpshufb)
+    AVX512   //!< AVX-512 VPOPCNTDQ
+  };
+
+  /**
+   * Returns the Hamming distance between two bit strings
+   * @param a n bytes
+   * @param b n bytes
+   * @param n length of the strings in bytes
+   * @return number of different bits
+   */
+  static inline unsigned int distance(const unsigned char* a, const unsigned char* b,
+                                      const size_t n) {
+    return m_distance(a, b, n);
+  }
+
+  /**
+   * Computes the Hamming distances between a bit string and a set of bit
+   * strings stored contiguously
+   * @param a n bytes
+   * @param b k * n bytes
+   * @param n length of the strings in bytes
+   * @param k number of strings in b
+   * @param d (out) k distances, d[i] is the distance between a and b + i * n
+   */
+  static inline void distances(const unsigned char* a, const unsigned char* b,
+                               const size_t n, const unsigned int k, unsigned int* d) {
+    m_distances(a, b, n, k, d);
+  }
+
+  /**
+   * Computes the bitwise majority of a set of bit strings: each bit of the
+   * result is set iff it is set in at least threshold strings. The bits are
+   * counted with bit-sliced counters, 16 strings at a time
+   * @param strings k pointers to strings of n bytes
+   * @param k number of strings
+   * @param n length of the strings in bytes
+   * @param threshold minimum number of strings with a bit set (> 0)
+   * @param out (out) n bytes
+   */
+  static void majority(const unsigned char* const* strings, const size_t k, const size_t n,
+                       const size_t threshold, unsigned char* out);
+
+  /**
+   * Returns the Hamming distance computed with the given kernel
+   * @param kernel kernel to use (must be supported)
+   * @param a n bytes
+   * @param b n bytes
+   * @param n length of the strings in bytes
+   * @return number of different bits
+   */
+  static unsigned int distance(const Kernel kernel, const unsigned char* a, const unsigned char* b,
+                               const size_t n);
+
+  /**
+   * Computes the Hamming distances with the given kernel
+   * @param kernel kernel to use (must be supported)
+   * @param a n bytes
+   * @param b k * n bytes
+   * @param n length of the strings in bytes
+   * @param k number of strings in b
+   * @param d (out) k distances
+   */
+  static void distances(const Kernel kernel, const unsigned char* a, const unsigned char* b,
+                        const size_t n, const unsigned int k, unsigned int* d);
+
+  /**
+   * Returns the kernel in use
+   * @return kernel
+   */
+  static Kernel getKernel();
+
+  /**
+   * Selects the kernel to use
+   * @note This is not thread safe, and it is meant for tests and benchmarks
+   * @param kernel kernel to use. Throws if the CPU does not support it
+   */
+  static void setKernel(const Kernel kernel);
+
+  /**
+   * Returns whether the kernel is compiled in and supported by the CPU
+   * @param kernel
+   * @return true iff the kernel can be used
+   */
+  static bool isSupported(const Kernel kernel);
+
+  /**
+   * Returns the fastest kernel supported by the CPU
+   * @return kernel
+   */
+  static Kernel detectKernel();
+
+  /**
+   * Returns the name of a kernel
+   * @param kernel
+   * @return name
+   */
+  static const char* getKernelName(const Kernel kernel);
+
+protected:
+  //! Signature of the kernels of distance
+  typedef unsigned int (*DistanceFunction)(const unsigned char*, const unsigned char*, size_t);
+
+  //! Signature of the kernels of distances
+  typedef void (*DistancesFunction)(const unsigned char*, const unsigned char*, size_t,
+                                    unsigned int, unsigned int*);
+
+  //! Kernel in use
+  static Kernel m_kernel;
+
+  //! Implementation of distance in use
+  static DistanceFunction m_distance;
+
+  //! Implementation of distances in use
+  static DistancesFunction m_distances;
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * File: MappedFile.h
+ * Date: October 2026
+ * Description: file mapped in memory
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_MAPPED_FILE__
+#define __D_T_MAPPED_FILE__
+
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Whole file mapped in memory, copy-on-write. The pages are read from the
+ * page cache on demand, and they are shared by all the processes that map
+ * the same file until they are written. Writes are private and never reach
+ * the file
+ */
+class DLL_EXPORT MappedFile {
+public:
+  /**
+   * Maps a file. Throws a std::string if it cannot be mapped
+   * @param filename
+   */
+  explicit MappedFile(const std::string& filename);
+
+  /**
+   * Unmaps the file
+   */
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * Returns the contents of the file
+   * @return pointer to size() bytes, aligned to a page
+   */
+  inline unsigned char* data() const { return m_data; }
+
+  /**
+   * Returns the size of the file
+   * @return bytes
+   */
+  inline size_t size() const { return m_size; }
+
+protected:
+  //! Contents of the file
+  unsigned char* m_data;
+
+  //! Size of the file
+  size_t m_size;
+
+#ifdef _WIN32
+  //! Mapping handle
+  void* m_mapping;
+#endif
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,326 @@
+/**
+ * File: QueryScoring.h
+ * Date: October 2026
+ * Description: scoring functions of database queries
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_QUERY_SCORING__
+#define __D_T_QUERY_SCORING__
+
+#include <cmath>
+
+#include "DBoW2/BowVector.h"
+#include "DBoW2/QueryResults.h"
+#include "DBoW2/ScoringObject.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+// For query functions
+static constexpr int MIN_COMMON_WORDS = 5;
+
+/*
+ * A query scoring accumulates a partial score per database entry from the
+ * postings of the query words (add). Then it gives the value that ranks
+ * each scored entry (rank), and completes the results selected (complete).
+ * They are created for each query vector:
+ *
+ *   Score: partial score of an entry, T() when the entry is not scored yet
+ *   Word: query word, with what its postings need
+ *   ASCENDING: if true, the lower the rank the better
+ *   Scoring(const BowVector& vec, const WeightingType weighting)
+ *   Word word(const WordValue qvalue) const
+ *   void add(Score& score, const Word& word, const WordValue dvalue) const
+ *   bool rank(const Score& score, double& value) const
+ *     (returns false if the entry must be discarded)
+ *   void complete(const Score& score, Result& result) const
+ *     (result.Score holds the rank)
+ */
+
+// --------------------------------------------------------------------------
+
+/**
+ * L1 scoring. Partial scores are in [-2 best .. 0 worst]
+ */
+class DLL_EXPORT L1QueryScoring {
+public:
+  using Score = double;
+  using Word = WordValue;
+  static constexpr bool ASCENDING = true;
+
+  L1QueryScoring(const BowVector&, const WeightingType) {}
+
+  inline Word word(const WordValue qvalue) const { return qvalue; }
+
+  inline void add(Score& score, const Word& qvalue, const WordValue dvalue) const {
+    score += fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    value = score;
+    return true;
+  }
+
+  inline void complete(const Score&, Result& result) const {
+    // complete and scale score to [0 worst .. 1 best]
+    // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|)
+    //    for all i | v_i != 0 and w_i != 0
+    // (Nister, 2006)
+    // scaled_||v - w||_{L1} = 1 - 0.5 * ||v - w||_{L1}
+    result.Score = -result.Score / 2.0;
+  }
+};
+
+// --------------------------------------------------------------------------
+
+/**
+ * L2 scoring. Partial scores are in [-1 best .. 0 worst]
+ */
+class DLL_EXPORT L2QueryScoring {
+public:
+  using Score = double;
+  using Word = WordValue;
+  static constexpr bool ASCENDING = true;
+
+  L2QueryScoring(const BowVector&, const WeightingType) {}
+
+  inline Word word(const WordValue qvalue) const { return qvalue; }
+
+  inline void add(Score& score, const Word& qvalue, const WordValue dvalue) const {
+    score += -qvalue * dvalue; // minus sign for sorting trick
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    value = score;
+    return true;
+  }
+
+  inline void complete(const Score&, Result& result) const {
+    // complete and scale score to [0 worst .. 1 best]
+    // ||v - w||_{L2} = sqrt( 2 - 2 * Sum(v_i * w_i)
+    //    for all i | v_i != 0 and w_i != 0 )
+    // (Nister, 2006)
+    if (result.Score <= -1.0) // rounding error
+      result.Score = 1.0;
+    else
+      result.Score = 1.0 - sqrt(1.0 + result.Score); // [0..1]
+                                                     // the + sign is ok, it is due to - sign in
+                                                     // value = - qvalue * dvalue
+  }
+};
+
+// --------------------------------------------------------------------------
+
+/**
+ * Chi square scoring. Partial scores are in [-2 best .. 0 worst]; we have
+ * to add +2 to them to obtain the chi square score. The query vector is
+ * not supposed to be normalized
+ */
+class DLL_EXPORT ChiSquareQueryScoring {
+public:
+  //! Score with the sums of the values of the words in common
+  struct Score {
+    double score;
+    int n_words;
+    double sum_q;
+    double sum_d;
+
+    Score()
+        : score(0), n_words(0), sum_q(0), sum_d(0) {}
+  };
+
+  using Word = WordValue;
+  static constexpr bool ASCENDING = true;
+
+  ChiSquareQueryScoring(const BowVector&, const WeightingType) {}
+
+  inline Word word(const WordValue qvalue) const { return qvalue; }
+
+  inline void add(Score& score, const Word& qvalue, const WordValue dvalue) const {
+    // (v-w)^2/(v+w) - v - w = -4 vw/(v+w)
+    // we move the 4 out
+    double value = 0;
+    if (qvalue + dvalue != 0.0) // words may have weight zero
+      value = -qvalue * dvalue / (qvalue + dvalue);
+
+    score.score += value;
+    score.n_words += 1;
+    score.sum_q += qvalue;
+    score.sum_d += dvalue;
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    value = score.score;
+    return score.n_words >= MIN_COMMON_WORDS;
+  }
+
+  inline void complete(const Score& score, Result& result) const {
+    result.nWords = score.n_words;
+    result.sumCommonVi = score.sum_q;
+    result.sumCommonWi = score.sum_d;
+    result.expectedChiScore = 2 * score.sum_d / (1 + score.sum_d);
+
+    // complete and scale score to [0 worst .. 1 best]
+    // this takes the 4 into account
+    result.Score = -2. * result.Score; // [0..1]
+
+    result.chiScore = result.Score;
+  }
+};
+
+// --------------------------------------------------------------------------
+
+/**
+ * KL divergence scoring. Partial scores are in [-X worst .. 0 best .. X
+ * worst], but we cannot make sure which ones are better without
+ * calculating the complete score, which is in [0 best .. X worst] and
+ * cannot be scaled
+ */
+class DLL_EXPORT KLQueryScoring {
+public:
+  //! KL score with the terms that the words in common take off the
+  //! complete score
+  struct Score {
+    double score;
+    double common;
+
+    Score()
+        : score(0), common(0) {}
+  };
+
+  //! Query value with its term in the complete score of an entry that
+  //! lacks the word
+  struct Word {
+    WordValue value;
+    double missing;
+  };
+
+  static constexpr bool ASCENDING = true;
+
+  KLQueryScoring(const BowVector& vec, const WeightingType)
+      : m_missing(0) {
+    BowVector::const_iterator vit;
+    for (vit = vec.begin(); vit != vec.end(); ++vit) {
+      m_missing += word(vit->second).missing;
+    }
+  }
+
+  inline Word word(const WordValue qvalue) const {
+    Word w;
+    w.value = qvalue;
+    w.missing = 0;
+    if (qvalue != 0)
+      w.missing = qvalue * (log(qvalue) - GeneralScoring::LOG_EPS);
+    return w;
+  }
+
+  inline void add(Score& score, const Word& word, const WordValue wi) const {
+    const WordValue& vi = word.value;
+
+    double value = 0;
+    if (vi != 0 && wi != 0)
+      value = vi * log(vi / wi);
+
+    score.score += value;
+    score.common += word.missing;
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    // complete the score with the words the entry lacks. They are not
+    // added one by one, so the score can differ from the one of a sum in
+    // the order of the query words by rounding
+    value = score.score + (m_missing - score.common);
+    return true;
+  }
+
+  inline void complete(const Score&, Result&) const {}
+
+protected:
+  //! Term of the complete score of an entry that lacks all the query words
+  double m_missing;
+};
+
+// --------------------------------------------------------------------------
+
+/**
+ * Bhattacharyya scoring. Scores are already in [0..1]
+ */
+class DLL_EXPORT BhattacharyyaQueryScoring {
+public:
+  //! Score with the number of words in common
+  struct Score {
+    double score;
+    int n_words;
+
+    Score()
+        : score(0), n_words(0) {}
+  };
+
+  using Word = WordValue;
+  static constexpr bool ASCENDING = false;
+
+  BhattacharyyaQueryScoring(const BowVector&, const WeightingType) {}
+
+  inline Word word(const WordValue qvalue) const { return qvalue; }
+
+  inline void add(Score& score, const Word& qvalue, const WordValue dvalue) const {
+    score.score += sqrt(qvalue * dvalue);
+    score.n_words += 1;
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    value = score.score;
+    return score.n_words >= MIN_COMMON_WORDS;
+  }
+
+  inline void complete(const Score& score, Result& result) const {
+    result.nWords = score.n_words;
+    result.bhatScore = score.score;
+  }
+};
+
+// --------------------------------------------------------------------------
+
+/**
+ * Dot product scoring. Scores are the greater the better, and cannot be
+ * scaled
+ */
+class DLL_EXPORT DotProductQueryScoring {
+public:
+  using Score = double;
+  using Word = WordValue;
+  static constexpr bool ASCENDING = false;
+
+  DotProductQueryScoring(const BowVector&, const WeightingType weighting)
+      : m_binary(weighting == BINARY) {}
+
+  inline Word word(const WordValue qvalue) const { return qvalue; }
+
+  inline void add(Score& score, const Word& qvalue, const WordValue dvalue) const {
+    if (m_binary)
+      score += 1;
+    else
+      score += qvalue * dvalue;
+  }
+
+  inline bool rank(const Score& score, double& value) const {
+    value = score;
+    return true;
+  }
+
+  inline void complete(const Score&, Result&) const {}
+
+protected:
+  //! Words are counted instead of multiplied
+  bool m_binary;
+};
+
+} // namespace DBoW2
+
+#endif
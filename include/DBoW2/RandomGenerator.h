@@ -0,0 +1,121 @@
+/**
+ * File: RandomGenerator.h
+ * Date: October 2026
+ * Description: seedable generator of random numbers (xoshiro256**)
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_RANDOM_GENERATOR__
+#define __D_T_RANDOM_GENERATOR__
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Generator of 64-bit random numbers with the xoshiro256** algorithm.
+ * The same seed gives the same sequence on any platform. Independent
+ * streams can be derived with split, e.g. one per subtree of a vocabulary
+ * being built in parallel. It satisfies UniformRandomBitGenerator
+ */
+class DLL_EXPORT RandomGenerator {
+public:
+  //! Type of the numbers
+  typedef uint64_t result_type;
+
+  /**
+   * Creates a generator
+   * @param seed
+   */
+  explicit RandomGenerator(const uint64_t seed = 0);
+
+  /**
+   * Restarts the sequence from a seed
+   * @param seed
+   */
+  void seed(const uint64_t seed);
+
+  /**
+   * Returns a new generator whose sequence is independent of this one.
+   * It advances this generator
+   * @return generator
+   */
+  RandomGenerator split();
+
+  /**
+   * Returns the state of the generator, e.g. to save it in a checkpoint
+   * @param state (out) state
+   */
+  void getState(uint64_t state[4]) const;
+
+  /**
+   * Sets the state of the generator, which goes on with the sequence that
+   * the state was taken from
+   * @param state state given by getState
+   */
+  void setState(const uint64_t state[4]);
+
+  /**
+   * Returns the next number
+   * @return random number in [min(), max()]
+   */
+  inline uint64_t operator()() {
+    const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+    const uint64_t t = m_state[1] << 17;
+
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 45);
+
+    return result;
+  }
+
+  /**
+   * Returns the next number as a double
+   * @return random number in [0, 1)
+   */
+  inline double uniform() {
+    // the 53 upper bits fill the mantissa
+    return (double)((*this)() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  /**
+   * Returns the smallest number generated
+   * @return 0
+   */
+  static constexpr uint64_t min() { return 0; }
+
+  /**
+   * Returns the largest number generated
+   * @return 2^64 - 1
+   */
+  static constexpr uint64_t max() { return UINT64_MAX; }
+
+protected:
+  /**
+   * Rotates the bits of a number to the left
+   * @param x number
+   * @param k bits to rotate (0 < k < 64)
+   * @return rotated number
+   */
+  static inline uint64_t rotl(const uint64_t x, const int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+protected:
+  //! State of the generator
+  uint64_t m_state[4];
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * File: ScoreAccumulator.h
+ * Date: October 2026
+ * Description: dense accumulator of partial scores of database entries
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_SCORE_ACCUMULATOR__
+#define __D_T_SCORE_ACCUMULATOR__
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "DBoW2/QueryResults.h"
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+/**
+ * Array of partial scores indexed by entry id, reused between queries.
+ * Each query touches only the entries it scores: they are recorded in a
+ * list, and the array is reset in constant time by changing the stamp that
+ * marks the valid values
+ * @param T type of the partial score (default constructible)
+ */
+template<class T>
+class DLL_EXPORT ScoreAccumulator {
+public:
+  /**
+   * Creates an empty accumulator
+   */
+  ScoreAccumulator()
+      : m_first(0), m_stamp(0) {}
+
+  /**
+   * Starts a new query, forgetting the scores of the previous one
+   * @param n_entries number of entries that can be scored
+   * @param first id of the first entry that can be scored
+   */
+  void reset(const size_t n_entries, const EntryId first = 0) {
+    m_first = first;
+
+    if (m_values.size() < n_entries) {
+      m_values.resize(n_entries);
+      m_stamps.resize(n_entries, 0);
+    }
+
+    m_touched.clear();
+
+    if (++m_stamp == 0) {
+      // the stamps wrapped around
+      std::fill(m_stamps.begin(), m_stamps.end(), 0);
+      m_stamp = 1;
+    }
+  }
+
+  /**
+   * Returns the partial score of an entry, which is T() the first time it
+   * is accessed in the current query
+   * @param entry_id (in [first, first + n_entries) given to reset)
+   * @return score
+   */
+  inline T& operator[](const EntryId entry_id) {
+    const size_t i = entry_id - m_first;
+    if (m_stamps[i] != m_stamp) {
+      m_stamps[i] = m_stamp;
+      m_values[i] = T();
+      m_touched.push_back(entry_id);
+    }
+    return m_values[i];
+  }
+
+  /**
+   * Returns the entries scored in the current query
+   * @return entry ids, in order of first access
+   */
+  inline const std::vector<EntryId>& touched() const { return m_touched; }
+
+  /**
+   * Forgets some of the entries scored in the current query
+   * @param pred function that returns true for the entries to forget
+   */
+  template<class Predicate>
+  void removeTouched(Predicate pred) {
+    m_touched.erase(std::remove_if(m_touched.begin(), m_touched.end(), pred), m_touched.end());
+  }
+
+protected:
+  //! Partial scores
+  std::vector<T> m_values;
+
+  //! Stamp of the query that wrote each score
+  std::vector<unsigned int> m_stamps;
+
+  //! Entries scored in the current query
+  std::vector<EntryId> m_touched;
+
+  //! Id of the entry of the first score
+  EntryId m_first;
+
+  //! Stamp of the current query
+  unsigned int m_stamp;
+};
+
+} // namespace DBoW2
+
+#endif
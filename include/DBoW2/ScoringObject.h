@@ -10,6 +10,7 @@
 #define __D_T_SCORING_OBJECT__
 
 #include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
 
 #ifdef _MSC_VER
 #define DLL_EXPORT __declspec(dllexport)
@@ -33,6 +34,15 @@ public:
    */
   virtual double score(const BowVector& v, const BowVector& w) const = 0;
 
+  /**
+   * Computes the score between two flat vectors. The result is the same as
+   * the one of the bow vectors with the same words
+   * @param v
+   * @param w
+   * @return score
+   */
+  virtual double score(const FlatBowVector& v, const FlatBowVector& w) const = 0;
+
   /**
    * Returns whether a vector must be normalized before scoring according
    * to the scoring scheme
@@ -68,6 +78,15 @@ public                                                                       \
      */                                                                      \
     virtual double score(const BowVector& v, const BowVector& w) const;      \
                                                                              \
+    /**                                                                      \
+     * Computes score between two flat vectors                               \
+     * @param v                                                              \
+     * @param w                                                              \
+     * @return score between v and w                                         \
+     */                                                                      \
+    virtual double score(const FlatBowVector& v,                             \
+                         const FlatBowVector& w) const;                      \
+                                                                             \
     /**                                                                      \
      * Says if a vector must be normalized according to the scoring function \
      * @param norm (out) if true, norm to use                                \
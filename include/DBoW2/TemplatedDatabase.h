@@ -9,18 +9,33 @@
 #ifndef __D_T_TEMPLATED_DATABASE__
 #define __D_T_TEMPLATED_DATABASE__
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 #include <numeric>
 #include <fstream>
+#include <limits>
+#include <memory>
 #include <string>
 #include <list>
 #include <set>
 
+#include "DBoW2/ChunkedVector.h"
+#include "DBoW2/DatabaseJournal.h"
+#include "DBoW2/FileSync.h"
+#include "DBoW2/MappedFile.h"
 #include "DBoW2/TemplatedVocabulary.h"
 #include "DBoW2/QueryResults.h"
+#include "DBoW2/QueryScoring.h"
+#include "DBoW2/ScoreAccumulator.h"
 #include "DBoW2/ScoringObject.h"
 #include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
+#include "DBoW2/FlatFeatureVector.h"
 #include "DBoW2/FeatureVector.h"
+#include "DBoW2/ThreadPool.h"
 
 #ifdef _MSC_VER
 #define DLL_EXPORT __declspec(dllexport)
@@ -30,11 +45,19 @@
 
 namespace DBoW2 {
 
-// For query functions
-static constexpr int MIN_COMMON_WORDS = 5;
+// Id given by compact to the erased entries
+static constexpr EntryId ERASED_ENTRY = std::numeric_limits<EntryId>::max();
+
+// Minimum number of entries of a shard in parallel queries
+static constexpr int MIN_SHARD_ENTRIES = 4096;
 
 /**
- * Generic Database
+ * Generic Database.
+ *
+ * One thread may add entries while other threads query the database or
+ * retrieve features, without locks. Each query sees the entries that were
+ * added before it started. The other modifications (e.g. clear, load or
+ * setVocabulary) need exclusive access
  * @param TDescriptor class of descriptor
  * @param F class of descriptor functions
  */
@@ -119,7 +142,8 @@ public:
    * Allocates some memory for the direct and inverted indexes
    * @param nd number of expected image entries in the database 
    * @param ni number of expected words per image
-   * @note Use 0 to ignore a parameter
+   * @note Use 0 to ignore a parameter. The inverted index is reserved only
+   *   if both are given
    */
   void allocate(const int nd = 0, const int ni = 0);
 
@@ -142,12 +166,74 @@ public:
   EntryId add(const BowVector& vec, const FeatureVector& fec = FeatureVector());
 
   /**
-   * Empties the database
+   * Adds an entry to the database from a flat bow vector and returns its
+   * index
+   * @param vec flat bow vector
+   * @param fec feature vector to add the entry. Only necessary if using the
+   *   direct index
+   * @return id of new entry
+   */
+  EntryId add(const FlatBowVector& vec, const FeatureVector& fec = FeatureVector());
+
+  /**
+   * Adds an entry to the database from a flat feature vector and returns
+   * its index
+   * @param vec bow vector
+   * @param fec flat feature vector. Only necessary if using the direct index
+   * @return id of new entry
+   */
+  EntryId add(const BowVector& vec, const FlatFeatureVector& fec);
+
+  /**
+   * Adds an entry to the database from flat vectors and returns its index
+   * @param vec flat bow vector
+   * @param fec flat feature vector. Only necessary if using the direct index
+   * @return id of new entry
+   */
+  EntryId add(const FlatBowVector& vec, const FlatFeatureVector& fec);
+
+  /**
+   * Erases an entry. It is not returned by the queries from now on, but its
+   * id and its data are kept until the database is compacted. It can be
+   * called while other threads query the database, by the thread that
+   * adds entries. Throws a std::string if the entry does not exist
+   * @param id entry id (must be < size())
+   */
+  void erase(const EntryId id);
+
+  /**
+   * Checks if an entry was erased
+   * @param id entry id (must be < size())
+   * @return true iff the entry was erased
+   */
+  inline bool isErased(const EntryId id) const;
+
+  /**
+   * Returns the number of erased entries
+   * @return number of erased entries, included in size()
+   */
+  inline unsigned int numErased() const;
+
+  /**
+   * Removes the data of the erased entries. Their postings are removed
+   * from the inverted index and their features from the direct index. If
+   * the entries are renumbered, the remaining ones get consecutive ids in
+   * the same order and the erased ones are forgotten; otherwise the ids do
+   * not change. It needs exclusive access to the database
+   * @param renumber if true, the ids are renumbered
+   * @return new id of each old entry id, or ERASED_ENTRY for the erased
+   *   entries
+   */
+  std::vector<EntryId> compact(const bool renumber = false);
+
+  /**
+   * Empties the database and closes its journal
    */
   inline void clear();
 
   /**
-   * Returns the number of entries in the database 
+   * Returns the number of entries in the database, including the erased
+   * ones until they are renumbered
    * @return number of entries in the database
    */
   inline unsigned int size() const;
@@ -169,7 +255,7 @@ public:
    * @param features query features
    * @param ret (out) query results
    * @param max_results number of results to return. <= 0 means all
-   * @param max_id only entries with id <= max_id are returned in ret. 
+   * @param max_id only entries with id < max_id are returned in ret. 
    *   < 0 means all
    */
   void query(const std::vector<TDescriptor>& features, QueryResults& ret,
@@ -180,19 +266,76 @@ public:
    * @param vec bow vector already normalized
    * @param ret results
    * @param max_results number of results to return. <= 0 means all
-   * @param max_id only entries with id <= max_id are returned in ret. 
+   * @param max_id only entries with id < max_id are returned in ret. 
    *   < 0 means all
    */
   void query(const BowVector& vec, QueryResults& ret,
              int max_results = 1, int max_id = -1) const;
 
+  /**
+   * Queries the database with a vector, splitting the entries into shards of
+   * consecutive ids that are scored in parallel. The best results of each
+   * shard are merged, so they are the same as those of query
+   * @param vec bow vector already normalized
+   * @param ret results
+   * @param max_results number of results to return. <= 0 means all
+   * @param max_id only entries with id < max_id are returned in ret.
+   *   < 0 means all
+   * @param pool threads to use
+   */
+  void query(const BowVector& vec, QueryResults& ret,
+             int max_results, int max_id, ThreadPool& pool) const;
+
+  /**
+   * Queries the database with several vectors at once. The queries that
+   * share a word read its row of the inverted index once. The results are
+   * the same as those of query
+   * @param vecs bow vectors already normalized
+   * @param rets (out) results of each vector
+   * @param max_results number of results to return per vector. <= 0 means
+   *   all
+   * @param max_id only entries with id < max_id are returned. < 0 means all
+   */
+  void queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                  int max_results = 1, int max_id = -1) const;
+
+  /**
+   * Queries the database with several vectors at once, running blocks of
+   * vectors in parallel
+   * @param vecs bow vectors already normalized
+   * @param rets (out) results of each vector
+   * @param max_results number of results to return per vector. <= 0 means
+   *   all
+   * @param max_id only entries with id < max_id are returned. < 0 means all
+   * @param pool threads to use
+   */
+  void queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                  int max_results, int max_id, ThreadPool& pool) const;
+
   /**
    * Returns the a feature vector associated with a database entry
    * @param id entry id (must be < size())
-   * @return const reference to map of nodes and their associated features in
-   *   the given entry
+   * @return copy of the nodes and their associated features in the given
+   *   entry
+   */
+  FeatureVector retrieveFeatures(EntryId id) const;
+
+  /**
+   * Returns the feature vector associated with a database entry as it is
+   * stored, without copying it
+   * @param id entry id (must be < size())
+   * @return const reference to the nodes and their associated features in
+   *   the given entry, which are iterated as the ones of a FeatureVector
    */
-  const FeatureVector& retrieveFeatures(EntryId id) const;
+  const FlatFeatureVector& retrieveFlatFeatures(EntryId id) const;
+
+  /**
+   * Copies the feature vector associated with a database entry
+   * @param id entry id (must be < size())
+   * @param fv (out) map of nodes and their associated features in the given
+   *   entry
+   */
+  void retrieveFeatures(EntryId id, FeatureVector& fv) const;
 
   /**
    * Stores the database in a file
@@ -201,11 +344,71 @@ public:
   void save(const std::string& filename) const;
 
   /**
-   * Loads the database from a file
+   * Loads the database from a file saved with save or saveToMappedFile
    * @param filename
    */
   void load(const std::string& filename);
 
+  /**
+   * Saves the database into a binary file in the mapped format: an array of
+   * postings per word, the direct index as arrays of offsets and the erased
+   * entries. The file can be loaded only on a machine with the same byte
+   * order. No entries can be added while it is saved
+   * @param filename
+   * @param embed_vocabulary if true, the vocabulary is stored in the file
+   *   too. Otherwise, the database that loads the file must already have the
+   *   same vocabulary
+   */
+  void saveToMappedFile(const std::string& filename, const bool embed_vocabulary = true) const;
+
+  /**
+   * Loads the database by mapping a file saved with saveToMappedFile. The
+   * inverted index and the embedded vocabulary are not copied: queries read
+   * them from the file, whose pages are loaded on demand. Entries can be
+   * added and erased as usual, and the file is not modified
+   * @param filename
+   */
+  void loadFromMappedFile(const std::string& filename);
+
+  /**
+   * Starts journaling the changes of the database (add, erase and compact)
+   * into a file, to recover them after a crash. The changes in the file that
+   * are newer than the database are applied first, so the journal must be
+   * opened right after loading the last checkpoint of the database. clear,
+   * load and setVocabulary close the journal
+   * @param filename journal file, created if it does not exist
+   * @param records_per_sync number of changes written to disk at once. The
+   *   ones not written yet are lost if the process crashes
+   */
+  void openJournal(const std::string& filename, const unsigned int records_per_sync = 1);
+
+  /**
+   * Writes the pending changes to the journal and waits until they are on
+   * disk
+   */
+  void syncJournal();
+
+  /**
+   * Writes the pending changes to the journal and closes it
+   */
+  void closeJournal();
+
+  /**
+   * Saves the database with saveToMappedFile, replacing the file only once
+   * it is complete, and empties the journal, whose changes are in the file
+   * from now on
+   * @param filename
+   */
+  void checkpoint(const std::string& filename);
+
+  /**
+   * Returns the number of changes (adds, erases and compactions) made to the
+   * database since it was created. It is saved with the database, and it
+   * tells which changes of a journal the database already has
+   * @return sequence number of the last change
+   */
+  inline uint64_t getSequence() const;
+
   /** 
    * Stores the database in the given file storage structure
    * @param fs
@@ -223,29 +426,125 @@ public:
                     const std::string& name = "database");
 
 protected:
-  //! Query with L1 scoring
-  void queryL1(const BowVector& vec, QueryResults& ret,
-               const int max_results, const int max_id) const;
+  /**
+   * Adds an entry to the database and returns its index
+   * @param TBowVector BowVector or FlatBowVector
+   * @param vec bow vector
+   * @param fec feature vector of the entry, which is moved to the direct
+   *   index
+   * @return id of new entry
+   */
+  template<class TBowVector>
+  EntryId addEntry(const TBowVector& vec, FlatFeatureVector&& fec);
+
+  /* The query functions score only the entries with id < n_entries. The
+   * Scoring classes are defined in QueryScoring.h */
+
+  /**
+   * Returns the number of entries that a query sees: the ones added before
+   * it started
+   * @param max_id only entries with id < max_id are seen. < 0 means all
+   * @return number of entries
+   */
+  inline int getQueryEntries(const int max_id) const;
+
+  /**
+   * Queries the database with a vector
+   * @param Scoring query scoring
+   * @param vec bow vector
+   * @param ret (out) results
+   * @param max_results number of results to return. <= 0 means all
+   * @param n_entries number of entries to score
+   */
+  template<class Scoring>
+  void queryWith(const BowVector& vec, QueryResults& ret,
+                 const int max_results, const int n_entries) const;
+
+  /**
+   * Queries the database with a vector, scoring shards of entries in
+   * parallel
+   * @param Scoring query scoring
+   * @param vec bow vector
+   * @param ret (out) results
+   * @param max_results number of results to return. <= 0 means all
+   * @param n_entries number of entries to score
+   * @param n_shards number of shards
+   * @param pool threads to use
+   */
+  template<class Scoring>
+  void queryShardedWith(const BowVector& vec, QueryResults& ret, const int max_results,
+                        const int n_entries, const int n_shards, ThreadPool& pool) const;
 
-  //! Query with L2 scoring
-  void queryL2(const BowVector& vec, QueryResults& ret,
-               const int max_results, const int max_id) const;
+  /**
+   * Queries the database with several vectors at once
+   * @param vecs bow vectors
+   * @param rets (out) results of each vector, already sized
+   * @param max_results number of results to return per vector
+   * @param max_id only entries with id < max_id are returned
+   * @param pool if given, threads to use
+   */
+  void queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                  const int max_results, const int max_id, ThreadPool* pool) const;
 
-  //! Query with Chi square scoring
-  void queryChiSquare(const BowVector& vec, QueryResults& ret,
-                      const int max_results, const int max_id) const;
+  /**
+   * Queries the database with several vectors at once, split into blocks.
+   * The accumulators of a block cover a range of entries at a time, so that
+   * large databases do not shrink the blocks
+   * @param Scoring query scoring
+   * @param vecs bow vectors
+   * @param rets (out) results of each vector, already sized
+   * @param max_results number of results to return per vector
+   * @param n_entries number of entries to score
+   * @param pool if given, the blocks run in parallel
+   */
+  template<class Scoring>
+  void queryBatchWith(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                      const int max_results, const int n_entries, ThreadPool* pool) const;
 
-  //! Query with Bhattacharyya scoring
-  void queryBhattacharyya(const BowVector& vec, QueryResults& ret,
-                          const int max_results, const int max_id) const;
+  /**
+   * Queries the database with a block of vectors. The words are sorted so
+   * that each row of the inverted index is read once for all the vectors
+   * that have its word. The entries are scored by ranges, and the results
+   * of the ranges are merged
+   * @param Scoring query scoring
+   * @param vecs bow vectors
+   * @param rets (out) results of each vector
+   * @param begin first vector of the block
+   * @param end last vector of the block + 1
+   * @param max_results number of results to return per vector
+   * @param n_entries number of entries to score
+   * @param range_size number of entries scored at a time
+   */
+  template<class Scoring>
+  void queryBlock(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                  const size_t begin, const size_t end,
+                  const int max_results, const int n_entries, const int range_size) const;
 
-  //! Query with KL divergence scoring
-  void queryKL(const BowVector& vec, QueryResults& ret,
-               const int max_results, const int max_id) const;
+  /**
+   * Selects and completes the results of a query from its partial scores
+   * @param Scoring query scoring
+   * @param scoring scoring of the query vector
+   * @param scores partial scores
+   * @param ret (out) results
+   * @param max_results number of results to return. <= 0 means all
+   */
+  template<class Scoring>
+  void getResults(const Scoring& scoring, ScoreAccumulator<typename Scoring::Score>& scores,
+                  QueryResults& ret, const int max_results) const;
 
-  //! Query with dot product scoring
-  void queryDotProduct(const BowVector& vec, QueryResults& ret,
-                       const int max_results, const int max_id) const;
+  /**
+   * Selects and completes the results of a query from its partial scores
+   * @param Scoring query scoring
+   * @param scoring scoring of the query vector
+   * @param scores partial scores
+   * @param ret (out) results
+   * @param max_results number of results to return. <= 0 means all
+   * @param candidates (out) pairs of <rank, entry id> of the results
+   */
+  template<class Scoring>
+  void getResults(const Scoring& scoring, ScoreAccumulator<typename Scoring::Score>& scores,
+                  QueryResults& ret, const int max_results,
+                  std::vector<std::pair<double, EntryId>>& candidates) const;
 
 protected:
   /* Inverted file declaration */
@@ -279,20 +578,141 @@ protected:
     inline bool operator==(const EntryId eid) const { return entry_id == eid; }
   };
 
-  //! Row of InvertedFile
-  using IFRow = std::list<IFPair>;
+  //! Row of InvertedFile, stored in a few contiguous chunks
+  using IFRow = ChunkedVector<IFPair>;
   // IFRows are sorted in ascending entry_id order
 
   //! Inverted index
   using InvertedFile = std::vector<IFRow>;
   // InvertedFile[word_id] --> inverted file of that word
 
+  /**
+   * Returns the score accumulator of the calling thread, ready for a query.
+   * It is kept between queries, so they do not allocate memory
+   * @param T type of the partial score
+   * @param n_entries number of entries that can be scored
+   * @return accumulator
+   */
+  template<class T>
+  ScoreAccumulator<T>& getScoreAccumulator(const int n_entries) const;
+
+  /**
+   * Returns score accumulators of the calling thread, ready for a block of
+   * queries. They are kept between queries
+   * @param T type of the partial score
+   * @param n_queries number of accumulators
+   * @param n_entries number of entries that can be scored
+   * @param first id of the first entry that can be scored
+   * @return accumulators (at least n_queries)
+   */
+  template<class T>
+  std::vector<ScoreAccumulator<T>>& getScoreAccumulators(const size_t n_queries, const int n_entries,
+                                                         const EntryId first) const;
+
+  /**
+   * Selects the candidates with the best scores. Ties are broken by entry
+   * id, the lowest first. It takes linear time plus the sorting of the
+   * selected candidates
+   * @param candidates (in/out) pairs of <score, entry id>. The best ones
+   *   are left, sorted from best to worst
+   * @param max_results number of candidates to select. <= 0 means all
+   * @param ascending if true, the lower the score the better
+   */
+  static void selectBest(std::vector<std::pair<double, EntryId>>& candidates,
+                         const int max_results, const bool ascending);
+
+  /**
+   * Compares two candidates in the order of selectBest
+   * @param a pair of <score, entry id>
+   * @param b pair of <score, entry id>
+   * @param ascending if true, the lower the score the better
+   * @return true iff a is better than b
+   */
+  static inline bool isBetter(const std::pair<double, EntryId>& a, const std::pair<double, EntryId>& b,
+                              const bool ascending);
+
+  /**
+   * Removes the erased entries from the ones scored by a query
+   * @param T type of the partial score
+   * @param scores accumulator of the query
+   */
+  template<class T>
+  void removeErased(ScoreAccumulator<T>& scores) const;
+
   /* Direct file declaration */
 
   //! Direct index
-  using DirectFile = std::vector<FeatureVector>;
+  using DirectFile = ChunkedVector<FlatFeatureVector>;
   // DirectFile[entry_id] --> [ directentry, ... ]
 
+  /* Entry states declaration */
+
+  //! State of an entry, which can change while queries read it
+  struct EntryState {
+    //! The entry was erased
+    std::atomic<bool> erased;
+
+    EntryState()
+        : erased(false) {}
+
+    EntryState(const EntryState& state)
+        : erased(state.erased.load(std::memory_order_relaxed)) {}
+
+    EntryState& operator=(const EntryState& state) {
+      erased.store(state.erased.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      return *this;
+    }
+  };
+
+  //! States of the entries
+  using EntryStates = ChunkedVector<EntryState>;
+  // EntryStates[entry_id] --> state
+
+  /* Mapped file declaration */
+
+  //! Header of the files saved with saveToMappedFile. It is followed by
+  //! arrays aligned to 64 bytes
+  struct MappedHeader {
+    //! "DBoW2MDB"
+    char magic[8];
+    //! Version of the format
+    uint32_t version;
+    //! 0x01020304 in the byte order of the writer
+    uint32_t byte_order;
+    //! Bytes per posting (sizeof(IFPair))
+    uint32_t posting_size;
+    //! Scoring type, weighting type and number of words of the vocabulary
+    int32_t scoring, weighting;
+    uint32_t n_words;
+    //! Number of entries and direct index parameters
+    uint32_t n_entries;
+    int32_t use_di, di_levels;
+    //! Number of postings, and of nodes and values (see
+    //! FlatFeatureVector::valueCount) in the direct index
+    uint64_t n_postings, n_nodes, n_values;
+    //! Size of the file in bytes
+    uint64_t size;
+    //! Offset and size of the embedded vocabulary (0 if it is not embedded)
+    uint64_t vocabulary, vocabulary_size;
+    //! Offsets of the arrays from the beginning of the file:
+    //! first posting of each word (n_words + 1), postings, erased flag of
+    //! each entry, first node of each entry in the direct index
+    //! (n_entries + 1), first value of each entry (n_entries + 1), values.
+    //! The values of an entry are the buffer of its FlatFeatureVector, which
+    //! is attached to them when the file is loaded. The direct index arrays
+    //! are empty if it is not used
+    uint64_t rows, postings, erased, entry_nodes, entry_values, values;
+    //! Number of changes made to the database (see getSequence)
+    uint64_t sequence;
+  };
+
+  /**
+   * Checks if a file was saved with saveToMappedFile
+   * @param filename
+   * @return true iff the file starts with the mapped format signature
+   */
+  static bool isMappedFile(const std::string& filename);
+
 protected:
   //! Associated vocabulary
   TemplatedVocabulary<TDescriptor, F>* m_voc;
@@ -306,18 +726,34 @@ protected:
   //! Inverted file (must have size() == |words|)
   InvertedFile m_ifile;
 
+  //! File that the inverted file refers to, if it was loaded from a mapped
+  //! file
+  std::shared_ptr<MappedFile> m_file;
+
   //! Direct file (resized for allocation)
   DirectFile m_dfile;
 
-  //! Number of valid entries in m_dfile
-  int m_nentries;
+  //! States of the entries
+  EntryStates m_states;
+
+  //! Number of entries, published when their data are complete
+  std::atomic<int> m_nentries;
+
+  //! Number of erased entries
+  std::atomic<int> m_nerased;
+
+  //! Number of changes made to the database
+  uint64_t m_sequence;
+
+  //! Journal of the changes, if any
+  std::unique_ptr<DatabaseJournal> m_journal;
 };
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 TemplatedDatabase<TDescriptor, F>::TemplatedDatabase(const bool use_di, const int di_levels)
-    : m_voc(nullptr), m_use_di(use_di), m_dilevels(di_levels), m_nentries(0) {
+    : m_voc(nullptr), m_use_di(use_di), m_dilevels(di_levels), m_nentries(0), m_nerased(0), m_sequence(0) {
 }
 
 // --------------------------------------------------------------------------
@@ -366,12 +802,16 @@ TemplatedDatabase<TDescriptor, F>::~TemplatedDatabase() {
 template<class TDescriptor, class F>
 TemplatedDatabase<TDescriptor, F>& TemplatedDatabase<TDescriptor, F>::operator=(const TemplatedDatabase<TDescriptor, F>& db) {
   if (this != &db) {
+    // setVocabulary clears the database, so it goes first
+    setVocabulary(*db.m_voc);
     m_dfile = db.m_dfile;
     m_dilevels = db.m_dilevels;
     m_ifile = db.m_ifile;
-    m_nentries = db.m_nentries;
+    m_states = db.m_states;
+    m_nentries.store(db.m_nentries.load(std::memory_order_acquire), std::memory_order_relaxed);
+    m_nerased.store(db.m_nerased.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sequence = db.m_sequence;
     m_use_di = db.m_use_di;
-    setVocabulary(*db.m_voc);
   }
   return *this;
 }
@@ -388,9 +828,9 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const std::vector<TDescriptor>& f
     return add(v, *fvec);
   }
   else if (m_use_di) {
-    FeatureVector fv;
+    FlatFeatureVector fv;
     m_voc->transform(features, v, fv, m_dilevels);
-    return add(v, fv);
+    return addEntry(v, std::move(fv));
   }
   else if (fvec != nullptr) {
     m_voc->transform(features, v, *fvec, m_dilevels);
@@ -406,21 +846,50 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const std::vector<TDescriptor>& f
 
 template<class TDescriptor, class F>
 EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector& v, const FeatureVector& fv) {
-  EntryId entry_id = m_nentries++;
+  return addEntry(v, FlatFeatureVector(fv));
+}
 
-  BowVector::const_iterator vit;
-  std::vector<unsigned int>::const_iterator iit;
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+EntryId TemplatedDatabase<TDescriptor, F>::add(const FlatBowVector& v, const FeatureVector& fv) {
+  return addEntry(v, FlatFeatureVector(fv));
+}
+
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector& v, const FlatFeatureVector& fv) {
+  return addEntry(v, FlatFeatureVector(fv));
+}
+
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+EntryId TemplatedDatabase<TDescriptor, F>::add(const FlatBowVector& v, const FlatFeatureVector& fv) {
+  return addEntry(v, FlatFeatureVector(fv));
+}
+
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class TBowVector>
+EntryId TemplatedDatabase<TDescriptor, F>::addEntry(const TBowVector& v, FlatFeatureVector&& fv) {
+  const EntryId entry_id = m_nentries.load(std::memory_order_relaxed);
+
+  if (m_journal)
+    m_journal->appendAddEntry(m_sequence + 1, v, fv);
+  ++m_sequence;
+
+  typename TBowVector::const_iterator vit;
 
   if (m_use_di) {
     // update direct file
-    if (entry_id == m_dfile.size()) {
-      m_dfile.push_back(fv);
-    }
-    else {
-      m_dfile[entry_id] = fv;
-    }
+    m_dfile.push_back(std::move(fv));
   }
 
+  m_states.push_back(EntryState());
+
   // update inverted file
   for (vit = v.begin(); vit != v.end(); ++vit) {
     const WordId& word_id = vit->first;
@@ -430,6 +899,9 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector& v, const Feature
     ifrow.push_back(IFPair(entry_id, word_weight));
   }
 
+  // the queries see the entry from now on
+  m_nentries.store(entry_id + 1, std::memory_order_release);
+
   return entry_id;
 }
 
@@ -470,8 +942,13 @@ inline void TemplatedDatabase<TDescriptor, F>::clear() {
   // resize vectors
   m_ifile.resize(0);
   m_ifile.resize(m_voc->size());
-  m_dfile.resize(0);
-  m_nentries = 0;
+  m_file.reset();
+  m_dfile.clear();
+  m_states.clear();
+  m_nentries.store(0, std::memory_order_relaxed);
+  m_nerased.store(0, std::memory_order_relaxed);
+  m_sequence = 0;
+  m_journal.reset();
 }
 
 // --------------------------------------------------------------------------
@@ -479,19 +956,19 @@ inline void TemplatedDatabase<TDescriptor, F>::clear() {
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::allocate(const int nd, const int ni) {
   // m_ifile already contains |words| items
-  if (ni > 0) {
+  // nd * ni postings, spread over all the words
+  if (nd > 0 && ni > 0 && !m_ifile.empty()) {
+    const size_t n_postings = (size_t)nd * ni;
+    const size_t row_size = (n_postings + m_ifile.size() - 1) / m_ifile.size();
+
     typename std::vector<IFRow>::iterator rit;
     for (rit = m_ifile.begin(); rit != m_ifile.end(); ++rit) {
-      int n = (int)rit->size();
-      if (ni > n) {
-        rit->resize(ni);
-        rit->resize(n);
-      }
+      rit->reserve(row_size);
     }
   }
 
-  if (m_use_di && (int)m_dfile.size() < nd) {
-    m_dfile.resize(nd);
+  if (m_use_di && nd > 0) {
+    m_dfile.reserve(nd);
   }
 }
 
@@ -499,7 +976,117 @@ void TemplatedDatabase<TDescriptor, F>::allocate(const int nd, const int ni) {
 
 template<class TDescriptor, class F>
 inline unsigned int TemplatedDatabase<TDescriptor, F>::size() const {
-  return m_nentries;
+  return m_nentries.load(std::memory_order_acquire);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::erase(const EntryId id) {
+  // checked before the change is journaled
+  if (id >= size())
+    throw std::string("Invalid entry id: ") + std::to_string(id);
+
+  if (m_journal)
+    m_journal->appendEraseEntry(m_sequence + 1, id);
+  ++m_sequence;
+
+  if (!m_states[id].erased.exchange(true, std::memory_order_release))
+    ++m_nerased;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+inline bool TemplatedDatabase<TDescriptor, F>::isErased(const EntryId id) const {
+  return m_states[id].erased.load(std::memory_order_acquire);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+inline unsigned int TemplatedDatabase<TDescriptor, F>::numErased() const {
+  return m_nerased.load(std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+std::vector<EntryId> TemplatedDatabase<TDescriptor, F>::compact(const bool renumber) {
+  const EntryId n_entries = size();
+
+  if (m_journal)
+    m_journal->appendCompact(m_sequence + 1, renumber);
+  ++m_sequence;
+
+  // new ids, which keep the order of the entries
+  std::vector<EntryId> new_ids(n_entries);
+  EntryId n_kept = 0;
+  typename EntryStates::const_iterator sit = m_states.begin();
+  for (EntryId id = 0; id < n_entries; ++id, ++sit) {
+    if (sit->erased.load(std::memory_order_relaxed))
+      new_ids[id] = ERASED_ENTRY;
+    else
+      new_ids[id] = renumber ? n_kept++ : id;
+  }
+
+  // rewrite the inverted file
+  typename InvertedFile::iterator iit;
+  for (iit = m_ifile.begin(); iit != m_ifile.end(); ++iit) {
+    typename IFRow::const_iterator rit;
+
+    // the rows with no erased posting and no renumbered entry are kept
+    size_t n = 0;
+    bool changed = false;
+    for (rit = iit->begin(); rit != iit->end(); ++rit) {
+      if (new_ids[rit->entry_id] != ERASED_ENTRY)
+        ++n;
+      if (new_ids[rit->entry_id] != rit->entry_id)
+        changed = true;
+    }
+    if (!changed)
+      continue;
+
+    IFRow row;
+    row.reserve(n);
+    for (rit = iit->begin(); rit != iit->end(); ++rit) {
+      if (new_ids[rit->entry_id] != ERASED_ENTRY)
+        row.push_back(IFPair(new_ids[rit->entry_id], rit->word_weight));
+    }
+    *iit = std::move(row);
+  }
+
+  // and the direct file and the states
+  if (renumber) {
+    DirectFile dfile;
+    if (m_use_di) {
+      dfile.reserve(n_kept);
+
+      typename DirectFile::const_iterator dit = m_dfile.begin();
+      for (EntryId id = 0; id < n_entries; ++id, ++dit) {
+        if (new_ids[id] != ERASED_ENTRY)
+          dfile.push_back(*dit);
+      }
+    }
+
+    m_dfile = std::move(dfile);
+    m_states.clear();
+    m_states.reserve(n_kept);
+    for (EntryId id = 0; id < n_kept; ++id) {
+      m_states.push_back(EntryState());
+    }
+
+    m_nentries.store(n_kept, std::memory_order_release);
+    m_nerased.store(0, std::memory_order_relaxed);
+  }
+  else if (m_use_di) {
+    for (EntryId id = 0; id < n_entries; ++id) {
+      if (new_ids[id] == ERASED_ENTRY)
+        m_dfile[id] = FlatFeatureVector();
+    }
+  }
+
+  return new_ids;
 }
 
 // --------------------------------------------------------------------------
@@ -533,29 +1120,31 @@ void TemplatedDatabase<TDescriptor, F>::query(const BowVector& vec, QueryResults
                                               const int max_results, const int max_id) const {
   ret.resize(0);
 
+  const int n_entries = getQueryEntries(max_id);
+
   switch (m_voc->getScoringType()) {
     case L1_NORM:
-      queryL1(vec, ret, max_results, max_id);
+      queryWith<L1QueryScoring>(vec, ret, max_results, n_entries);
       break;
 
     case L2_NORM:
-      queryL2(vec, ret, max_results, max_id);
+      queryWith<L2QueryScoring>(vec, ret, max_results, n_entries);
       break;
 
     case CHI_SQUARE:
-      queryChiSquare(vec, ret, max_results, max_id);
+      queryWith<ChiSquareQueryScoring>(vec, ret, max_results, n_entries);
       break;
 
     case KL:
-      queryKL(vec, ret, max_results, max_id);
+      queryWith<KLQueryScoring>(vec, ret, max_results, n_entries);
       break;
 
     case BHATTACHARYYA:
-      queryBhattacharyya(vec, ret, max_results, max_id);
+      queryWith<BhattacharyyaQueryScoring>(vec, ret, max_results, n_entries);
       break;
 
     case DOT_PRODUCT:
-      queryDotProduct(vec, ret, max_results, max_id);
+      queryWith<DotProductQueryScoring>(vec, ret, max_results, n_entries);
       break;
   }
 }
@@ -563,460 +1152,483 @@ void TemplatedDatabase<TDescriptor, F>::query(const BowVector& vec, QueryResults
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector& vec, QueryResults& ret,
-                                                const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
-
-  std::map<EntryId, double> pairs;
-  std::map<EntryId, double>::iterator pit;
-
-  for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
+void TemplatedDatabase<TDescriptor, F>::query(const BowVector& vec, QueryResults& ret,
+                                              const int max_results, const int max_id, ThreadPool& pool) const {
+  const int n_entries = getQueryEntries(max_id);
+
+  // each thread scores a shard, unless they are too small
+  const int n_shards = std::min<int>(pool.size(), n_entries / MIN_SHARD_ENTRIES);
+  if (n_shards <= 1) {
+    query(vec, ret, max_results, max_id);
+    return;
+  }
 
-    const IFRow& row = m_ifile[word_id];
+  ret.resize(0);
 
-    // IFRows are sorted in ascending entry_id order
+  switch (m_voc->getScoringType()) {
+    case L1_NORM:
+      queryShardedWith<L1QueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
 
-    for (rit = row.begin(); rit != row.end(); ++rit) {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
+    case L2_NORM:
+      queryShardedWith<L2QueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
 
-      if ((int)entry_id < max_id || max_id == -1) {
-        double value = fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
+    case CHI_SQUARE:
+      queryShardedWith<ChiSquareQueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
 
-        pit = pairs.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second += value;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, double>::value_type(entry_id, value));
-        }
-      }
+    case KL:
+      queryShardedWith<KLQueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
 
-    } // for each inverted row
-  }   // for each query word
+    case BHATTACHARYYA:
+      queryShardedWith<BhattacharyyaQueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
 
-  // move to vector
-  ret.reserve(pairs.size());
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit) {
-    ret.push_back(Result(pit->first, pit->second));
+    case DOT_PRODUCT:
+      queryShardedWith<DotProductQueryScoring>(vec, ret, max_results, n_entries, n_shards, pool);
+      break;
   }
+}
 
-  // resulting "scores" are now in [-2 best .. 0 worst]
+// --------------------------------------------------------------------------
 
-  // sort vector in ascending order of score
-  std::sort(ret.begin(), ret.end());
-  // (ret is inverted now --the lower the better--)
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                                                   const int max_results, const int max_id) const {
+  queryBatch(vecs, rets, max_results, max_id, nullptr);
+}
 
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
+// --------------------------------------------------------------------------
 
-  // complete and scale score to [0 worst .. 1 best]
-  // ||v - w||_{L1} = 2 + Sum(|v_i - w_i| - |v_i| - |w_i|)
-  //    for all i | v_i != 0 and w_i != 0
-  // (Nister, 2006)
-  // scaled_||v - w||_{L1} = 1 - 0.5 * ||v - w||_{L1}
-  QueryResults::iterator qit;
-  for (qit = ret.begin(); qit != ret.end(); qit++)
-    qit->Score = -qit->Score / 2.0;
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                                                   const int max_results, const int max_id, ThreadPool& pool) const {
+  queryBatch(vecs, rets, max_results, max_id, &pool);
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryL2(const BowVector& vec, QueryResults& ret,
-                                                const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
+void TemplatedDatabase<TDescriptor, F>::queryBatch(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                                                   const int max_results, const int max_id, ThreadPool* pool) const {
+  rets.resize(vecs.size());
 
-  std::map<EntryId, double> pairs;
-  std::map<EntryId, double>::iterator pit;
+  // all the vectors see the same entries
+  const int n_entries = getQueryEntries(max_id);
 
-  //map<EntryId, int> counters;
-  //map<EntryId, int>::iterator cit;
+  switch (m_voc->getScoringType()) {
+    case L1_NORM:
+      queryBatchWith<L1QueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
 
-  for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
+    case L2_NORM:
+      queryBatchWith<L2QueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
 
-    const IFRow& row = m_ifile[word_id];
+    case CHI_SQUARE:
+      queryBatchWith<ChiSquareQueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
 
-    // IFRows are sorted in ascending entry_id order
+    case KL:
+      queryBatchWith<KLQueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
 
-    for (rit = row.begin(); rit != row.end(); ++rit) {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
+    case BHATTACHARYYA:
+      queryBatchWith<BhattacharyyaQueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
 
-      if ((int)entry_id < max_id || max_id == -1) {
-        double value = -qvalue * dvalue; // minus sign for sorting trick
+    case DOT_PRODUCT:
+      queryBatchWith<DotProductQueryScoring>(vecs, rets, max_results, n_entries, pool);
+      break;
+  }
+}
 
-        pit = pairs.lower_bound(entry_id);
-        //cit = counters.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second += value;
-          //cit->second += 1;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, double>::value_type(entry_id, value));
+// --------------------------------------------------------------------------
 
-          //counters.insert(cit,
-          //  map<EntryId, int>::value_type(entry_id, 1));
-        }
-      }
+template<class TDescriptor, class F>
+inline int TemplatedDatabase<TDescriptor, F>::getQueryEntries(const int max_id) const {
+  // the entries added from now on are not seen by the query
+  const int n_entries = m_nentries.load(std::memory_order_acquire);
+  return (max_id >= 0 && max_id < n_entries) ? max_id : n_entries;
+}
 
-    } // for each inverted row
-  }   // for each query word
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class T>
+ScoreAccumulator<T>& TemplatedDatabase<TDescriptor, F>::getScoreAccumulator(const int n_entries) const {
+  static thread_local ScoreAccumulator<T> accumulator;
+  accumulator.reset(n_entries);
+  return accumulator;
+}
 
-  // move to vector
-  ret.reserve(pairs.size());
-  //cit = counters.begin();
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit) //, ++cit)
-  {
-    ret.push_back(Result(pit->first, pit->second)); // / cit->second));
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class T>
+std::vector<ScoreAccumulator<T>>& TemplatedDatabase<TDescriptor, F>::getScoreAccumulators(const size_t n_queries,
+                                                                                         const int n_entries,
+                                                                                         const EntryId first) const {
+  static thread_local std::vector<ScoreAccumulator<T>> accumulators;
+  if (accumulators.size() < n_queries)
+    accumulators.resize(n_queries);
+
+  for (size_t i = 0; i < n_queries; ++i) {
+    accumulators[i].reset(n_entries, first);
   }
+  return accumulators;
+}
 
-  // resulting "scores" are now in [-1 best .. 0 worst]
+// --------------------------------------------------------------------------
 
-  // sort vector in ascending order of score
-  std::sort(ret.begin(), ret.end());
-  // (ret is inverted now --the lower the better--)
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::selectBest(std::vector<std::pair<double, EntryId>>& candidates,
+                                                   const int max_results, const bool ascending) {
+  using Candidate = std::pair<double, EntryId>;
 
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
+  const auto better = [ascending](const Candidate& a, const Candidate& b) {
+    return isBetter(a, b, ascending);
+  };
 
-  // complete and scale score to [0 worst .. 1 best]
-  // ||v - w||_{L2} = sqrt( 2 - 2 * Sum(v_i * w_i)
-  //    for all i | v_i != 0 and w_i != 0 )
-  // (Nister, 2006)
-  QueryResults::iterator qit;
-  for (qit = ret.begin(); qit != ret.end(); qit++) {
-    if (qit->Score <= -1.0) // rounding error
-      qit->Score = 1.0;
-    else
-      qit->Score = 1.0 - sqrt(1.0 + qit->Score); // [0..1]
-                                                 // the + sign is ok, it is due to - sign in
-                                                 // value = - qvalue * dvalue
+  if (max_results > 0 && (size_t)max_results < candidates.size()) {
+    const typename std::vector<Candidate>::iterator last = candidates.begin() + max_results;
+    std::nth_element(candidates.begin(), last, candidates.end(), better);
+    candidates.erase(last, candidates.end());
   }
+
+  std::sort(candidates.begin(), candidates.end(), better);
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryChiSquare(const BowVector& vec, QueryResults& ret,
-                                                       const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
+inline bool TemplatedDatabase<TDescriptor, F>::isBetter(const std::pair<double, EntryId>& a,
+                                                        const std::pair<double, EntryId>& b,
+                                                        const bool ascending) {
+  if (a.first != b.first)
+    return ascending ? a.first < b.first : a.first > b.first;
+  return a.second < b.second;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class T>
+void TemplatedDatabase<TDescriptor, F>::removeErased(ScoreAccumulator<T>& scores) const {
+  if (m_nerased.load(std::memory_order_relaxed) == 0)
+    return;
 
-  std::map<EntryId, std::pair<double, int>> pairs;
-  std::map<EntryId, std::pair<double, int>>::iterator pit;
+  scores.removeTouched([this](const EntryId entry_id) { return isErased(entry_id); });
+}
 
-  std::map<EntryId, std::pair<double, double>> sums; // < sum vi, sum wi >
-  std::map<EntryId, std::pair<double, double>>::iterator sit;
+// --------------------------------------------------------------------------
 
-  // In the current implementation, we suppose vec is not normalized
+template<class TDescriptor, class F>
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::queryWith(const BowVector& vec, QueryResults& ret,
+                                                  const int max_results, const int n_entries) const {
+  const Scoring scoring(vec, m_voc->getWeightingType());
+  ScoreAccumulator<typename Scoring::Score>& scores = getScoreAccumulator<typename Scoring::Score>(n_entries);
 
-  //map<EntryId, double> expected;
-  //map<EntryId, double>::iterator eit;
+  BowVector::const_iterator vit;
+  typename IFRow::const_iterator rit;
 
   for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
-
-    const IFRow& row = m_ifile[word_id];
+    const typename Scoring::Word word = scoring.word(vit->second);
+    const IFRow& row = m_ifile[vit->first];
 
     // IFRows are sorted in ascending entry_id order
 
     for (rit = row.begin(); rit != row.end(); ++rit) {
       const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
-
-      if ((int)entry_id < max_id || max_id == -1) {
-        // (v-w)^2/(v+w) - v - w = -4 vw/(v+w)
-        // we move the 4 out
-        double value = 0;
-        if (qvalue + dvalue != 0.0) // words may have weight zero
-          value = -qvalue * dvalue / (qvalue + dvalue);
-
-        pit = pairs.lower_bound(entry_id);
-        sit = sums.lower_bound(entry_id);
-        //eit = expected.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second.first += value;
-          pit->second.second += 1;
-          //eit->second += dvalue;
-          sit->second.first += qvalue;
-          sit->second.second += dvalue;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, std::pair<double, int>>::value_type(entry_id,
-                                                                             std::make_pair(value, 1)));
-          //expected.insert(eit,
-          //  map<EntryId, double>::value_type(entry_id, dvalue));
-
-          sums.insert(sit,
-                      std::map<EntryId, std::pair<double, double>>::value_type(entry_id,
-                                                                               std::make_pair(qvalue, dvalue)));
-        }
-      }
+      if ((int)entry_id >= n_entries)
+        break;
 
+      scoring.add(scores[entry_id], word, rit->word_weight);
     } // for each inverted row
   }   // for each query word
 
-  // move to vector
-  ret.reserve(pairs.size());
-  sit = sums.begin();
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit, ++sit) {
-    if (pit->second.second >= MIN_COMMON_WORDS) {
-      ret.push_back(Result(pit->first, pit->second.first));
-      ret.back().nWords = pit->second.second;
-      ret.back().sumCommonVi = sit->second.first;
-      ret.back().sumCommonWi = sit->second.second;
-      ret.back().expectedChiScore = 2 * sit->second.second / (1 + sit->second.second);
-    }
-
-    //ret.push_back(Result(pit->first, pit->second));
-  }
-
-  // resulting "scores" are now in [-2 best .. 0 worst]
-  // we have to add +2 to the scores to obtain the chi square score
-
-  // sort vector in ascending order of score
-  std::sort(ret.begin(), ret.end());
-  // (ret is inverted now --the lower the better--)
-
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
-
-  // complete and scale score to [0 worst .. 1 best]
-  QueryResults::iterator qit;
-  for (qit = ret.begin(); qit != ret.end(); qit++) {
-    // this takes the 4 into account
-    qit->Score = -2. * qit->Score; // [0..1]
-
-    qit->chiScore = qit->Score;
-  }
+  getResults(scoring, scores, ret, max_results);
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryKL(const BowVector& vec, QueryResults& ret,
-                                                const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::queryShardedWith(const BowVector& vec, QueryResults& ret, const int max_results,
+                                                         const int n_entries, const int n_shards, ThreadPool& pool) const {
+  using Candidate = std::pair<double, EntryId>;
 
-  std::map<EntryId, double> pairs;
-  std::map<EntryId, double>::iterator pit;
+  const Scoring scoring(vec, m_voc->getWeightingType());
+  const int shard_size = (n_entries + n_shards - 1) / n_shards;
 
-  for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& vi = vit->second;
+  // best results of each shard, with their ranks
+  std::vector<QueryResults> shard_results(n_shards);
+  std::vector<std::vector<Candidate>> shard_candidates(n_shards);
 
-    const IFRow& row = m_ifile[word_id];
+  pool.parallelFor(0, n_shards, 1, [&](const size_t first, const size_t last) {
+    for (size_t s = first; s < last; ++s) {
+      const EntryId shard_begin = s * shard_size;
+      const EntryId shard_end = std::min<EntryId>(n_entries, shard_begin + shard_size);
 
-    // IFRows are sorted in ascending entry_id order
+      ScoreAccumulator<typename Scoring::Score>& scores =
+        getScoreAccumulator<typename Scoring::Score>(shard_end);
 
-    for (rit = row.begin(); rit != row.end(); ++rit) {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& wi = rit->word_weight;
+      BowVector::const_iterator vit;
+      typename IFRow::const_iterator rit;
 
-      if ((int)entry_id < max_id || max_id == -1) {
-        double value = 0;
-        if (vi != 0 && wi != 0)
-          value = vi * log(vi / wi);
+      for (vit = vec.begin(); vit != vec.end(); ++vit) {
+        const typename Scoring::Word word = scoring.word(vit->second);
+        const IFRow& row = m_ifile[vit->first];
 
-        pit = pairs.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second += value;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, double>::value_type(entry_id, value));
-        }
-      }
+        // IFRows are sorted in ascending entry_id order, so the postings of
+        // the shard are a segment of the row
 
-    } // for each inverted row
-  }   // for each query word
+        rit = row.partition_point([shard_begin](const IFPair& pair) { return pair.entry_id < shard_begin; });
+        for (; rit != row.end(); ++rit) {
+          const EntryId entry_id = rit->entry_id;
+          if (entry_id >= shard_end)
+            break;
 
-  // resulting "scores" are now in [-X worst .. 0 best .. X worst]
-  // but we cannot make sure which ones are better without calculating
-  // the complete score
+          scoring.add(scores[entry_id], word, rit->word_weight);
+        } // for each inverted row
+      }   // for each query word
 
-  // complete scores and move to vector
-  ret.reserve(pairs.size());
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit) {
-    EntryId eid = pit->first;
-    double value = 0.0;
-
-    for (vit = vec.begin(); vit != vec.end(); ++vit) {
-      const WordValue& vi = vit->second;
-      const IFRow& row = m_ifile[vit->first];
-
-      if (vi != 0) {
-        if (row.end() == find(row.begin(), row.end(), eid)) {
-          value += vi * (log(vi) - GeneralScoring::LOG_EPS);
-        }
-      }
+      getResults(scoring, scores, shard_results[s], max_results, shard_candidates[s]);
     }
+  });
+
+  // merge the results of the shards, which are sorted from best to worst
+  std::vector<size_t> next(n_shards, 0);
+  while (max_results <= 0 || ret.size() < (size_t)max_results) {
+    int best = -1;
+    for (int s = 0; s < n_shards; ++s) {
+      if (next[s] < shard_candidates[s].size() &&
+          (best < 0 || isBetter(shard_candidates[s][next[s]], shard_candidates[best][next[best]], Scoring::ASCENDING)))
+        best = s;
+    }
+    if (best < 0)
+      break;
 
-    pit->second += value;
-
-    // to vector
-    ret.push_back(Result(pit->first, pit->second));
+    ret.push_back(shard_results[best][next[best]]);
+    ++next[best];
   }
+}
 
-  // real scores are now in [0 best .. X worst]
-
-  // sort vector in ascending order
-  // (scores are inverted now --the lower the better--)
-  std::sort(ret.begin(), ret.end());
+// --------------------------------------------------------------------------
 
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
+template<class TDescriptor, class F>
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::queryBatchWith(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                                                       const int max_results, const int n_entries, ThreadPool* pool) const {
+  // a block has at most 64 vectors, and their accumulators take about
+  // 32 MB: they cover as many entries as fit at a time
+  const size_t entry_size = sizeof(typename Scoring::Score) + sizeof(unsigned int);
+  const size_t block_size = std::max<size_t>(1, std::min<size_t>(64, vecs.size()));
+  const int range_size = (int)std::max<size_t>(
+    1, std::min<size_t>(std::max(n_entries, 1), (32 << 20) / (entry_size * block_size)));
+
+  const auto run_blocks = [&](const size_t begin, const size_t end) {
+    queryBlock<Scoring>(vecs, rets, begin, end, max_results, n_entries, range_size);
+  };
 
-  // cannot scale scores
+  if (pool != nullptr) {
+    pool->parallelFor(0, vecs.size(), block_size, run_blocks);
+  }
+  else {
+    for (size_t begin = 0; begin < vecs.size(); begin += block_size) {
+      run_blocks(begin, std::min(vecs.size(), begin + block_size));
+    }
+  }
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryBhattacharyya(const BowVector& vec, QueryResults& ret,
-                                                           const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::queryBlock(const std::vector<BowVector>& vecs, std::vector<QueryResults>& rets,
+                                                   const size_t begin, const size_t end,
+                                                   const int max_results, const int n_entries, const int range_size) const {
+  using Score = typename Scoring::Score;
+  using Word = typename Scoring::Word;
+  using Candidate = std::pair<double, EntryId>;
+
+  const size_t n_queries = end - begin;
+
+  std::vector<Scoring> scorings;
+  scorings.reserve(n_queries);
+  for (size_t q = begin; q < end; ++q) {
+    scorings.push_back(Scoring(vecs[q], m_voc->getWeightingType()));
+  }
 
-  //map<EntryId, double> pairs;
-  //map<EntryId, double>::iterator pit;
+  // words of all the vectors, grouped by word id. Each vector gets its
+  // words in ascending order, as in query, so its scores are the same
+  std::vector<std::pair<WordId, unsigned int>> words;
+  for (size_t q = 0; q < n_queries; ++q) {
+    BowVector::const_iterator vit;
+    for (vit = vecs[begin + q].begin(); vit != vecs[begin + q].end(); ++vit) {
+      words.push_back(std::make_pair(vit->first, (unsigned int)q));
+    }
+  }
+  std::sort(words.begin(), words.end());
 
-  std::map<EntryId, std::pair<double, int>> pairs; // <eid, <score, counter> >
-  std::map<EntryId, std::pair<double, int>>::iterator pit;
+  // vectors that have each word, with their query words
+  std::vector<Word> query_words(words.size());
+  for (size_t w = 0; w < words.size(); ++w) {
+    const unsigned int q = words[w].second;
+    query_words[w] = scorings[q].word(vecs[begin + q].find(words[w].first)->second);
+  }
 
-  for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
+  // best results of each vector in the ranges scored so far, with their
+  // ranks
+  const bool single_range = range_size >= n_entries;
+  std::vector<std::vector<Candidate>> candidates(n_queries);
+  std::vector<Candidate> range_candidates;
+  QueryResults range_ret;
 
-    const IFRow& row = m_ifile[word_id];
+  for (size_t q = 0; q < n_queries; ++q) {
+    rets[begin + q].resize(0);
+  }
 
-    // IFRows are sorted in ascending entry_id order
+  typename IFRow::const_iterator rit;
 
-    for (rit = row.begin(); rit != row.end(); ++rit) {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
+  for (EntryId first = 0; first < (EntryId)n_entries; first += range_size) {
+    const EntryId last = std::min<EntryId>(n_entries, first + range_size);
 
-      if ((int)entry_id < max_id || max_id == -1) {
-        double value = sqrt(qvalue * dvalue);
+    std::vector<ScoreAccumulator<Score>>& scores = getScoreAccumulators<Score>(n_queries, last - first, first);
 
-        pit = pairs.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second.first += value;
-          pit->second.second += 1;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, std::pair<double, int>>::value_type(entry_id,
-                                                                             std::make_pair(value, 1)));
+    for (size_t w = 0; w < words.size();) {
+      const WordId word_id = words[w].first;
+      const size_t group_end = std::upper_bound(words.begin() + w, words.end(),
+                                                std::make_pair(word_id, (unsigned int)n_queries)) - words.begin();
+
+      const IFRow& row = m_ifile[word_id];
+
+      // IFRows are sorted in ascending entry_id order, so the postings of
+      // the range are a segment of the row
+
+      rit = row.partition_point([first](const IFPair& pair) { return pair.entry_id < first; });
+      for (; rit != row.end(); ++rit) {
+        const EntryId entry_id = rit->entry_id;
+        if (entry_id >= last)
+          break;
+
+        for (size_t g = w; g < group_end; ++g) {
+          const unsigned int q = words[g].second;
+          scorings[q].add(scores[q][entry_id], query_words[g], rit->word_weight);
         }
-      }
+      } // for each inverted row
 
-    } // for each inverted row
-  }   // for each query word
+      w = group_end;
+    } // for each query word
+
+    for (size_t q = 0; q < n_queries; ++q) {
+      if (single_range) {
+        getResults(scorings[q], scores[q], rets[begin + q], max_results);
+        continue;
+      }
 
-  // move to vector
-  ret.reserve(pairs.size());
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit) {
-    if (pit->second.second >= MIN_COMMON_WORDS) {
-      ret.push_back(Result(pit->first, pit->second.first));
-      ret.back().nWords = pit->second.second;
-      ret.back().bhatScore = pit->second.first;
+      range_ret.clear();
+      getResults(scorings[q], scores[q], range_ret, max_results, range_candidates);
+      candidates[q].insert(candidates[q].end(), range_candidates.begin(), range_candidates.end());
+      rets[begin + q].insert(rets[begin + q].end(), range_ret.begin(), range_ret.end());
     }
   }
 
-  // scores are already in [0..1]
+  if (single_range)
+    return;
 
-  // sort vector in descending order
-  std::sort(ret.begin(), ret.end(), Result::gt);
+  // select the best results of all the ranges
+  std::vector<size_t> order;
+  for (size_t q = 0; q < n_queries; ++q) {
+    const std::vector<Candidate>& c = candidates[q];
 
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
+    order.resize(c.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&c](const size_t a, const size_t b) {
+      return isBetter(c[a], c[b], Scoring::ASCENDING);
+    });
+    if (max_results > 0 && (size_t)max_results < order.size())
+      order.resize(max_results);
+
+    QueryResults& ret = rets[begin + q];
+    QueryResults merged;
+    merged.reserve(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      merged.push_back(ret[order[i]]);
+    }
+    ret.swap(merged);
+  }
 }
 
-// ---------------------------------------------------------------------------
+// --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedDatabase<TDescriptor, F>::queryDotProduct(const BowVector& vec, QueryResults& ret,
-                                                        const int max_results, const int max_id) const {
-  BowVector::const_iterator vit;
-  typename IFRow::const_iterator rit;
-
-  std::map<EntryId, double> pairs;
-  std::map<EntryId, double>::iterator pit;
-
-  for (vit = vec.begin(); vit != vec.end(); ++vit) {
-    const WordId word_id = vit->first;
-    const WordValue& qvalue = vit->second;
-
-    const IFRow& row = m_ifile[word_id];
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::getResults(const Scoring& scoring, ScoreAccumulator<typename Scoring::Score>& scores,
+                                                   QueryResults& ret, const int max_results) const {
+  std::vector<std::pair<double, EntryId>> candidates;
+  getResults(scoring, scores, ret, max_results, candidates);
+}
 
-    // IFRows are sorted in ascending entry_id order
+// --------------------------------------------------------------------------
 
-    for (rit = row.begin(); rit != row.end(); ++rit) {
-      const EntryId entry_id = rit->entry_id;
-      const WordValue& dvalue = rit->word_weight;
-
-      if ((int)entry_id < max_id || max_id == -1) {
-        double value;
-        if (this->m_voc->getWeightingType() == BINARY)
-          value = 1;
-        else
-          value = qvalue * dvalue;
-
-        pit = pairs.lower_bound(entry_id);
-        if (pit != pairs.end() && !(pairs.key_comp()(entry_id, pit->first))) {
-          pit->second += value;
-        }
-        else {
-          pairs.insert(pit,
-                       std::map<EntryId, double>::value_type(entry_id, value));
-        }
-      }
+template<class TDescriptor, class F>
+template<class Scoring>
+void TemplatedDatabase<TDescriptor, F>::getResults(const Scoring& scoring, ScoreAccumulator<typename Scoring::Score>& scores,
+                                                   QueryResults& ret, const int max_results,
+                                                   std::vector<std::pair<double, EntryId>>& candidates) const {
+  removeErased(scores);
+
+  // rank the scored entries
+  const std::vector<EntryId>& entries = scores.touched();
+
+  candidates.clear();
+  candidates.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    double value;
+    if (scoring.rank(scores[entries[i]], value))
+      candidates.push_back(std::make_pair(value, entries[i]));
+  }
 
-    } // for each inverted row
-  }   // for each query word
+  // select the best ones
+  selectBest(candidates, max_results, Scoring::ASCENDING);
 
-  // move to vector
-  ret.reserve(pairs.size());
-  for (pit = pairs.begin(); pit != pairs.end(); ++pit) {
-    ret.push_back(Result(pit->first, pit->second));
+  // and complete only them
+  ret.reserve(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    ret.push_back(Result(candidates[i].second, candidates[i].first));
+    scoring.complete(scores[candidates[i].second], ret.back());
   }
+}
 
-  // scores are the greater the better
+// --------------------------------------------------------------------------
 
-  // sort vector in descending order
-  std::sort(ret.begin(), ret.end(), Result::gt);
+template<class TDescriptor, class F>
+FeatureVector TemplatedDatabase<TDescriptor, F>::retrieveFeatures(EntryId id) const {
+  FeatureVector fv;
+  retrieveFeatures(id, fv);
+  return fv;
+}
 
-  // cut vector
-  if (max_results > 0 && (int)ret.size() > max_results)
-    ret.resize(max_results);
+// --------------------------------------------------------------------------
 
-  // these scores cannot be scaled
+template<class TDescriptor, class F>
+const FlatFeatureVector& TemplatedDatabase<TDescriptor, F>::retrieveFlatFeatures(EntryId id) const {
+  assert(id < size());
+  return m_dfile[id];
 }
 
-// ---------------------------------------------------------------------------
+// --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-const FeatureVector& TemplatedDatabase<TDescriptor, F>::retrieveFeatures(EntryId id) const {
+void TemplatedDatabase<TDescriptor, F>::retrieveFeatures(EntryId id, FeatureVector& fv) const {
   assert(id < size());
-  return m_dfile[id];
+  m_dfile[id].toFeatureVector(fv);
 }
 
 // --------------------------------------------------------------------------
@@ -1041,6 +1653,8 @@ void TemplatedDatabase<TDescriptor, F>::save(cv::FileStorage& fs, const std::str
   //   nEntries:
   //   usingDI:
   //   diLevels:
+  //   sequence:
+  //   erased: [ ]
   //   invertedIndex
   //   [
   //     [
@@ -1071,9 +1685,19 @@ void TemplatedDatabase<TDescriptor, F>::save(cv::FileStorage& fs, const std::str
 
   fs << name << "{";
 
-  fs << "nEntries" << m_nentries;
+  fs << "nEntries" << (int)size();
   fs << "usingDI" << (m_use_di ? 1 : 0);
   fs << "diLevels" << m_dilevels;
+  fs << "sequence" << (double)m_sequence;
+
+  // ids of the erased entries
+  std::vector<int> erased;
+  for (EntryId id = 0; id < size(); ++id) {
+    if (isErased(id))
+      erased.push_back(id);
+  }
+  fs << "erased"
+     << "[" << erased << "]";
 
   fs << "invertedIndex"
      << "[";
@@ -1097,22 +1721,23 @@ void TemplatedDatabase<TDescriptor, F>::save(cv::FileStorage& fs, const std::str
      << "[";
 
   typename DirectFile::const_iterator dit;
-  typename FeatureVector::const_iterator drit;
+  FlatFeatureVector::const_iterator drit;
+  std::vector<int> features;
   for (dit = m_dfile.begin(); dit != m_dfile.end(); ++dit) {
     fs << "["; // entry of DF
 
     for (drit = dit->begin(); drit != dit->end(); ++drit) {
       NodeId nid = drit->first;
-      const std::vector<unsigned int>& features = drit->second;
+      // msvc++ 2010 with opencv 2.3.1 does not allow FileStorage::operator<<
+      // with vectors of unsigned int
+      features.assign(drit->second.begin(), drit->second.end());
 
       // save info of last_nid
       fs << "{";
       fs << "nodeId" << (int)nid;
-      // msvc++ 2010 with opencv 2.3.1 does not allow FileStorage::operator<<
-      // with vectors of unsigned int
       fs << "features"
          << "["
-         << *(const std::vector<int>*)(&features) << "]";
+         << features << "]";
       fs << "}";
     }
 
@@ -1128,6 +1753,11 @@ void TemplatedDatabase<TDescriptor, F>::save(cv::FileStorage& fs, const std::str
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::load(const std::string& filename) {
+  if (isMappedFile(filename)) {
+    loadFromMappedFile(filename);
+    return;
+  }
+
   cv::FileStorage fs(filename.c_str(), cv::FileStorage::READ);
   if (!fs.isOpened())
     throw std::string("Could not open file ") + filename;
@@ -1154,10 +1784,27 @@ void TemplatedDatabase<TDescriptor, F>::load(const cv::FileStorage& fs, const st
   m_nentries = (int)fdb["nEntries"];
   m_use_di = (int)fdb["usingDI"] != 0;
   m_dilevels = (int)fdb["diLevels"];
+  // files saved by previous versions have no sequence
+  m_sequence = (uint64_t)(double)fdb["sequence"];
+
+  m_states.reserve(m_nentries);
+  for (int i = 0; i < m_nentries; ++i) {
+    m_states.push_back(EntryState());
+  }
+
+  // files saved by previous versions have no erased entries
+  cv::FileNode ferased = fdb["erased"][0];
+  cv::FileNodeIterator feit;
+  for (feit = ferased.begin(); feit != ferased.end(); ++feit) {
+    const EntryId id = (int)*feit;
+    if (!m_states[id].erased.exchange(true, std::memory_order_relaxed))
+      ++m_nerased;
+  }
 
   cv::FileNode fn = fdb["invertedIndex"];
   for (WordId wid = 0; wid < fn.size(); ++wid) {
     cv::FileNode fw = fn[wid];
+    m_ifile[wid].reserve(fw.size());
 
     for (unsigned int i = 0; i < fw.size(); ++i) {
       EntryId eid = (int)fw[i]["imageId"];
@@ -1170,19 +1817,19 @@ void TemplatedDatabase<TDescriptor, F>::load(const cv::FileStorage& fs, const st
   if (m_use_di) {
     fn = fdb["directIndex"];
 
-    m_dfile.resize(fn.size());
+    m_dfile.reserve(fn.size());
     assert(m_nentries == (int)fn.size());
 
     FeatureVector::iterator dit;
     for (EntryId eid = 0; eid < fn.size(); ++eid) {
       cv::FileNode fe = fn[eid];
 
-      m_dfile[eid].clear();
+      FeatureVector fvec;
       for (unsigned int i = 0; i < fe.size(); ++i) {
         NodeId nid = (int)fe[i]["nodeId"];
 
-        dit = m_dfile[eid].insert(m_dfile[eid].end(),
-                                  make_pair(nid, std::vector<unsigned int>()));
+        dit = fvec.insert(fvec.end(),
+                          make_pair(nid, std::vector<unsigned int>()));
 
         // this failed to compile with some opencv versions (2.3.1)
         //fe[i]["features"] >> dit->second;
@@ -1201,12 +1848,381 @@ void TemplatedDatabase<TDescriptor, F>::load(const cv::FileStorage& fs, const st
           dit->second.push_back((int)*ffit);
         }
       }
+
+      m_dfile.push_back(FlatFeatureVector(fvec));
     } // for each entry
   }   // if use_id
 }
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::saveToMappedFile(const std::string& filename, const bool embed_vocabulary) const {
+  if (m_voc == nullptr)
+    throw std::string("Cannot save a database without vocabulary: ") + filename;
+
+  const EntryId n_entries = size();
+
+  MappedHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DBoW2MDB", 8);
+  header.version = 2;
+  header.byte_order = 0x01020304;
+  header.posting_size = sizeof(IFPair);
+  header.scoring = m_voc->getScoringType();
+  header.weighting = m_voc->getWeightingType();
+  header.n_words = m_ifile.size();
+  header.n_entries = n_entries;
+  header.use_di = m_use_di ? 1 : 0;
+  header.di_levels = m_dilevels;
+  header.sequence = m_sequence;
+
+  typename InvertedFile::const_iterator iit;
+  for (iit = m_ifile.begin(); iit != m_ifile.end(); ++iit) {
+    header.n_postings += iit->size();
+  }
+
+  typename DirectFile::const_iterator dit;
+  for (dit = m_dfile.begin(); dit != m_dfile.end(); ++dit) {
+    header.n_nodes += dit->size();
+    header.n_values += dit->valueCount();
+  }
+
+  const uint64_t n_entry_offsets = m_use_di ? (uint64_t)n_entries + 1 : 0;
+
+  uint64_t offset = sizeof(MappedHeader);
+  auto allocate = [&offset](uint64_t& array, const uint64_t bytes) {
+    offset = (offset + 63) & ~(uint64_t)63;
+    array = offset;
+    offset += bytes;
+  };
+
+  allocate(header.rows, ((uint64_t)header.n_words + 1) * sizeof(uint64_t));
+  allocate(header.postings, header.n_postings * sizeof(IFPair));
+  allocate(header.erased, n_entries);
+  allocate(header.entry_nodes, n_entry_offsets * sizeof(uint64_t));
+  allocate(header.entry_values, n_entry_offsets * sizeof(uint64_t));
+  allocate(header.values, header.n_values * sizeof(unsigned int));
+  if (embed_vocabulary)
+    allocate(header.vocabulary, 0);
+  header.size = offset;
+
+  std::ofstream ofs;
+  ofs.open(filename.c_str(), std::ios_base::out | std::ios::binary);
+
+  if (!ofs) {
+    throw std::string("Could not open file: ") + filename;
+  }
+
+  // the header is written again when the size of the vocabulary is known
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // pads the file up to an array
+  const auto seek = [&ofs](const uint64_t array) {
+    static const char zeros[64] = {};
+    ofs.write(zeros, array - (uint64_t)ofs.tellp());
+  };
+
+  seek(header.rows);
+  uint64_t first = 0;
+  for (iit = m_ifile.begin(); iit != m_ifile.end(); ++iit) {
+    ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+    first += iit->size();
+  }
+  ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+
+  // postings are written with their padding zeroed
+  seek(header.postings);
+  std::vector<unsigned char> buffer;
+  for (iit = m_ifile.begin(); iit != m_ifile.end(); ++iit) {
+    buffer.assign(iit->size() * sizeof(IFPair), 0);
+    IFPair* pairs = reinterpret_cast<IFPair*>(buffer.data());
+
+    typename IFRow::const_iterator rit;
+    for (rit = iit->begin(); rit != iit->end(); ++rit, ++pairs) {
+      pairs->entry_id = rit->entry_id;
+      pairs->word_weight = rit->word_weight;
+    }
+    ofs.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  }
+
+  seek(header.erased);
+  buffer.resize(n_entries);
+  for (EntryId id = 0; id < n_entries; ++id) {
+    buffer[id] = isErased(id) ? 1 : 0;
+  }
+  ofs.write(reinterpret_cast<const char*>(buffer.data()), n_entries);
+
+  if (m_use_di) {
+    seek(header.entry_nodes);
+    first = 0;
+    for (dit = m_dfile.begin(); dit != m_dfile.end(); ++dit) {
+      ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+      first += dit->size();
+    }
+    ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+
+    seek(header.entry_values);
+    first = 0;
+    for (dit = m_dfile.begin(); dit != m_dfile.end(); ++dit) {
+      ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+      first += dit->valueCount();
+    }
+    ofs.write(reinterpret_cast<const char*>(&first), sizeof(first));
+
+    // the buffer of each entry is written at once
+    seek(header.values);
+    for (dit = m_dfile.begin(); dit != m_dfile.end(); ++dit) {
+      ofs.write(reinterpret_cast<const char*>(dit->nodeIds()), dit->valueCount() * sizeof(unsigned int));
+    }
+  }
+
+  if (embed_vocabulary) {
+    seek(header.vocabulary);
+    m_voc->saveToMappedFile(ofs);
+    header.size = ofs.tellp();
+    header.vocabulary_size = header.size - header.vocabulary;
+
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  else {
+    seek(header.size);
+  }
+
+  if (!ofs) {
+    throw std::string("Could not write file: ") + filename;
+  }
+
+  ofs.close();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::loadFromMappedFile(const std::string& filename) {
+  std::shared_ptr<MappedFile> file(new MappedFile(filename));
+  unsigned char* image = file->data();
+  const size_t size = file->size();
+  const MappedHeader* header = reinterpret_cast<const MappedHeader*>(image);
+
+  if (size < sizeof(MappedHeader) || memcmp(header->magic, "DBoW2MDB", 8) != 0)
+    throw std::string("Invalid database file: ") + filename;
+  if (header->version != 2)
+    throw std::string("Unsupported database file version: ") + filename;
+  if (header->byte_order != 0x01020304 || header->posting_size != sizeof(IFPair))
+    throw std::string("Database file saved on another platform: ") + filename;
+
+  // every array must be inside the file
+  const uint64_t n_words = header->n_words;
+  const uint64_t n_entries = header->n_entries;
+  const uint64_t n_entry_offsets = header->use_di ? n_entries + 1 : 0;
+  auto fits = [&](const uint64_t array, const uint64_t bytes) {
+    return array % 8 == 0 && array <= size && bytes <= size - array;
+  };
+
+  if (header->size != size
+      || !fits(header->rows, (n_words + 1) * sizeof(uint64_t))
+      || !fits(header->postings, header->n_postings * sizeof(IFPair))
+      || !fits(header->erased, n_entries)
+      || !fits(header->entry_nodes, n_entry_offsets * sizeof(uint64_t))
+      || !fits(header->entry_values, n_entry_offsets * sizeof(uint64_t))
+      || !fits(header->values, header->n_values * sizeof(unsigned int))) {
+    throw std::string("Corrupted database file: ") + filename;
+  }
+
+  const uint64_t* rows = reinterpret_cast<const uint64_t*>(image + header->rows);
+  const uint64_t* entry_nodes = reinterpret_cast<const uint64_t*>(image + header->entry_nodes);
+  const uint64_t* entry_values = reinterpret_cast<const uint64_t*>(image + header->entry_values);
+  unsigned int* values = reinterpret_cast<unsigned int*>(image + header->values);
+
+  // and the offsets must split them
+  auto splits = [](const uint64_t* offsets, const uint64_t n, const uint64_t total) {
+    if (n == 0)
+      return total == 0;
+    for (uint64_t i = 1; i < n; ++i) {
+      if (offsets[i] < offsets[i - 1])
+        return false;
+    }
+    return offsets[0] == 0 && offsets[n - 1] == total;
+  };
+
+  if (!splits(rows, n_words + 1, header->n_postings)
+      || !splits(entry_nodes, n_entry_offsets, header->n_nodes)
+      || !splits(entry_values, n_entry_offsets, header->n_values)) {
+    throw std::string("Corrupted database file: ") + filename;
+  }
+
+  // and the values of each entry must be a feature vector
+  for (uint64_t id = 0; id + 1 < n_entry_offsets; ++id) {
+    const uint64_t n_nodes = entry_nodes[id + 1] - entry_nodes[id];
+    const uint64_t n_values = entry_values[id + 1] - entry_values[id];
+    if (n_nodes == 0) {
+      if (n_values != 0)
+        throw std::string("Corrupted database file: ") + filename;
+      continue;
+    }
+
+    if (n_values < 2 * n_nodes + 1)
+      throw std::string("Corrupted database file: ") + filename;
+
+    // the offsets must split the features
+    const unsigned int* offsets = values + entry_values[id] + n_nodes;
+    bool ok = offsets[0] == 0 && offsets[n_nodes] == n_values - (2 * n_nodes + 1);
+    for (uint64_t n = 1; ok && n <= n_nodes; ++n) {
+      ok = offsets[n] >= offsets[n - 1];
+    }
+    if (!ok)
+      throw std::string("Corrupted database file: ") + filename;
+  }
+
+  if (header->vocabulary != 0) {
+    if (!m_voc)
+      m_voc = new TemplatedVocabulary<TDescriptor, F>;
+
+    m_voc->loadFromMappedFile(file, header->vocabulary, header->vocabulary_size);
+  }
+
+  if (m_voc == nullptr || m_voc->size() != n_words
+      || m_voc->getScoringType() != header->scoring || m_voc->getWeightingType() != header->weighting) {
+    throw std::string("The vocabulary does not match the database file: ") + filename;
+  }
+
+  // load database now
+  m_use_di = header->use_di != 0;
+  m_dilevels = header->di_levels;
+  clear(); // resizes inverted file
+
+  // the rows refer to the file
+  m_file = file;
+  IFPair* postings = reinterpret_cast<IFPair*>(image + header->postings);
+  for (WordId wid = 0; wid < n_words; ++wid) {
+    m_ifile[wid].attach(postings + rows[wid], rows[wid + 1] - rows[wid]);
+  }
+
+  const unsigned char* erased = image + header->erased;
+  m_states.reserve(n_entries);
+  for (EntryId id = 0; id < n_entries; ++id) {
+    EntryState state;
+    if (erased[id] != 0) {
+      state.erased.store(true, std::memory_order_relaxed);
+      ++m_nerased;
+    }
+    m_states.push_back(state);
+  }
+
+  // and so does the direct index
+  if (m_use_di) {
+    m_dfile.reserve(n_entries);
+    for (EntryId id = 0; id < n_entries; ++id) {
+      FlatFeatureVector fvec;
+      fvec.attach(values + entry_values[id], entry_nodes[id + 1] - entry_nodes[id]);
+      m_dfile.push_back(std::move(fvec));
+    }
+  }
+
+  m_sequence = header->sequence;
+  m_nentries.store(n_entries, std::memory_order_release);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::openJournal(const std::string& filename, const unsigned int records_per_sync) {
+  std::unique_ptr<DatabaseJournal> journal(new DatabaseJournal(filename, records_per_sync));
+
+  // the changes replayed are not journaled again
+  m_journal.reset();
+
+  journal->replay([this, &filename](const DatabaseJournal::Record& record) {
+    // the database already has the changes up to m_sequence
+    if (record.sequence <= m_sequence)
+      return;
+    if (record.sequence != m_sequence + 1)
+      throw std::string("The journal does not follow the database: ") + filename;
+
+    switch (record.type) {
+      case DatabaseJournal::ADD_ENTRY:
+        add(record.bow_vector, record.feature_vector);
+        break;
+
+      case DatabaseJournal::ERASE_ENTRY:
+        if (record.entry_id >= size())
+          throw std::string("Corrupted journal file: ") + filename;
+        erase(record.entry_id);
+        break;
+
+      case DatabaseJournal::COMPACT:
+        compact(record.renumber);
+        break;
+    }
+  });
+
+  m_journal = std::move(journal);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::syncJournal() {
+  if (m_journal)
+    m_journal->sync();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::closeJournal() {
+  if (m_journal) {
+    m_journal->sync();
+    m_journal.reset();
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::checkpoint(const std::string& filename) {
+  // the journal is written first, so it has all the changes if the process
+  // crashes before the file is replaced
+  syncJournal();
+
+  const std::string tmp_filename = filename + ".tmp";
+  saveToMappedFile(tmp_filename);
+  FileSync::sync(tmp_filename);
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    // some platforms do not replace existing files
+    std::remove(filename.c_str());
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+      throw std::string("Could not write file: ") + filename;
+  }
+
+  // the changes of the journal are older than the file now, so they would
+  // be skipped anyway if the process crashed before this
+  if (m_journal)
+    m_journal->clear();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+inline uint64_t TemplatedDatabase<TDescriptor, F>::getSequence() const {
+  return m_sequence;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedDatabase<TDescriptor, F>::isMappedFile(const std::string& filename) {
+  std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios::binary);
+
+  char magic[8];
+  return ifs.read(magic, 8) && memcmp(magic, "DBoW2MDB", 8) == 0;
+}
+
+// --------------------------------------------------------------------------
+
 /**
  * Writes printable information of the database
  * @param os stream to write to
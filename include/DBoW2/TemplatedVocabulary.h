@@ -16,12 +16,25 @@
 #include <fstream>
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <chrono>
 
 #include <opencv2/core.hpp>
 
 #include "DBoW2/FeatureVector.h"
 #include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
+#include "DBoW2/FlatFeatureVector.h"
 #include "DBoW2/ScoringObject.h"
+#include "DBoW2/MappedFile.h"
+#include "DBoW2/DescriptorFile.h"
+#include "DBoW2/FileSync.h"
+#include "DBoW2/RandomGenerator.h"
+#include "DBoW2/ThreadPool.h"
 
 #ifdef _MSC_VER
 #define DLL_EXPORT __declspec(dllexport)
@@ -39,6 +52,69 @@ namespace DBoW2 {
 template<class TDescriptor, class F>
 class DLL_EXPORT TemplatedVocabulary {
 public:
+  /**
+   * Parameters of the k-means steps that create the vocabulary. By default,
+   * each step runs Lloyd iterations on all its descriptors until they do
+   * not change of cluster
+   */
+  struct KMeansParams {
+    /**
+     * Steps with more descriptors than this run their first iterations on a
+     * random batch of this size, and assign all their descriptors at the end
+     * only. 0 to always use all the descriptors. util/BenchmarkKMeans
+     * measures the speed-up and the recall of each setting
+     */
+    unsigned int batch_size;
+
+    //! Maximum iterations on the batch (0: until it converges)
+    unsigned int max_batch_iterations;
+
+    //! Maximum iterations on all the descriptors of a step after its batch
+    //! (0: until they converge). With 1, the descriptors are just assigned
+    //! to the clusters found with the batch
+    unsigned int max_full_iterations;
+
+    //! Maximum iterations of the steps with no batch (0: until they converge)
+    unsigned int max_iterations;
+
+    KMeansParams()
+        : batch_size(0), max_batch_iterations(0), max_full_iterations(1), max_iterations(0) {}
+  };
+
+  /**
+   * Parameters of the creation of a vocabulary from a descriptor source
+   */
+  struct StreamingParams {
+    /**
+     * Maximum number of training descriptors held in memory at once. The
+     * nodes with more descriptors are clustered on a random sample of this
+     * size, and their descriptors are partitioned to spill files
+     */
+    size_t max_descriptors;
+
+    //! Directory of the spill files, which are removed once used. Each
+    //! creation needs its own directory
+    std::string spill_directory;
+
+    StreamingParams()
+        : max_descriptors(16 << 20), spill_directory(".") {}
+  };
+
+  /**
+   * Parameters of the checkpoints saved while a vocabulary is created
+   */
+  struct CheckpointParams {
+    //! File of the checkpoints, which is removed once the vocabulary is
+    //! created. If it is empty, no checkpoint is saved
+    std::string filename;
+
+    //! Minimum time between two checkpoints, in seconds
+    unsigned int interval;
+
+    CheckpointParams()
+        : interval(600) {}
+  };
+
   /**
    * Initiates an empty vocabulary
    * @param k branching factor
@@ -87,6 +163,15 @@ public:
    */
   virtual void create(const std::vector<std::vector<TDescriptor>>& training_features);
 
+  /**
+   * Creates a vocabulary from the training features with the already
+   * defined parameters. The same seed and features give the same vocabulary
+   * on any platform and with any number of threads
+   * @param training_features
+   * @param seed seed of the random numbers of the k-means steps
+   */
+  virtual void create(const std::vector<std::vector<TDescriptor>>& training_features, const uint64_t seed);
+
   /**
    * Creates a vocabulary from the training features, setting the branching
    * factor and the depth levels of the tree
@@ -106,6 +191,43 @@ public:
                       const int k, const int L,
                       const WeightingType weighting, const ScoringType scoring);
 
+  /**
+   * Creates a vocabulary from the images of a descriptor source, with the
+   * already defined parameters, holding at most
+   * StreamingParams::max_descriptors descriptors in memory. If all the
+   * descriptors fit, the vocabulary is the same as the one created from
+   * them in memory with the same seed
+   * @param source training images, read several times
+   * @param seed seed of the random numbers of the k-means steps
+   */
+  virtual void create(DescriptorSource& source, const uint64_t seed);
+
+  /**
+   * Creates a vocabulary from the images of a descriptor source, with the
+   * already defined parameters
+   * @param source training images, read several times
+   */
+  virtual void create(DescriptorSource& source);
+
+  /**
+   * Goes on with the creation of a vocabulary from the checkpoint file
+   * (CheckpointParams::filename) saved by create with the same training
+   * features. The vocabulary is the same as the one create would have
+   * given without interruption. The parameters of the vocabulary are
+   * restored from the checkpoint, but the threads and the checkpoint
+   * parameters, which are the ones set now
+   * @param training_features
+   */
+  virtual void resumeCreate(const std::vector<std::vector<TDescriptor>>& training_features);
+
+  /**
+   * Goes on with the creation of a vocabulary from the checkpoint file
+   * saved by create with the same descriptor source, as the other version.
+   * The streaming parameters are restored too, but the spill directory
+   * @param source training images, read several times
+   */
+  virtual void resumeCreate(DescriptorSource& source);
+
   /**
    * Returns the number of words in the vocabulary
    * @return number of words
@@ -135,6 +257,114 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features, BowVector& v, FeatureVector& fv,
                          const int levelsup) const;
 
+  /**
+   * Transforms a set of descriptors into a bow vector, quantizing them in
+   * parallel. The result is the same as the one of the sequential transform
+   * @param features
+   * @param v (out) bow vector of weighted words
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, BowVector& v, ThreadPool& pool) const;
+
+  /**
+   * Transforms a set of descriptors into a bow vector and a feature vector,
+   * quantizing them in parallel. The result is the same as the one of the
+   * sequential transform
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, BowVector& v, FeatureVector& fv,
+                         const int levelsup, ThreadPool& pool) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector. The words are
+   * the same as the ones of the bow vector
+   * @param features
+   * @param v (out) flat bow vector of weighted words
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector and a feature
+   * vector
+   * @param features
+   * @param v (out) flat bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FeatureVector& fv,
+                         const int levelsup) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector, quantizing them
+   * in parallel
+   * @param features
+   * @param v (out) flat bow vector of weighted words
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v, ThreadPool& pool) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector and a feature
+   * vector, quantizing them in parallel
+   * @param features
+   * @param v (out) flat bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FeatureVector& fv,
+                         const int levelsup, ThreadPool& pool) const;
+
+  /**
+   * Transforms a set of descriptors into a bow vector and a flat feature
+   * vector, which is built at once without a node per allocation
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) flat feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, BowVector& v, FlatFeatureVector& fv,
+                         const int levelsup) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector and a flat
+   * feature vector
+   * @param features
+   * @param v (out) flat bow vector
+   * @param fv (out) flat feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FlatFeatureVector& fv,
+                         const int levelsup) const;
+
+  /**
+   * Transforms a set of descriptors into a bow vector and a flat feature
+   * vector, quantizing them in parallel
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) flat feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, BowVector& v, FlatFeatureVector& fv,
+                         const int levelsup, ThreadPool& pool) const;
+
+  /**
+   * Transforms a set of descriptors into a flat bow vector and a flat
+   * feature vector, quantizing them in parallel
+   * @param features
+   * @param v (out) flat bow vector
+   * @param fv (out) flat feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param pool threads to use
+   */
+  virtual void transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FlatFeatureVector& fv,
+                         const int levelsup, ThreadPool& pool) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -151,6 +381,15 @@ public:
    */
   inline double score(const BowVector& a, const BowVector& b) const;
 
+  /**
+   * Returns the score of two flat vectors
+   * @param a vector
+   * @param b vector
+   * @return score between vectors
+   * @note the vectors must be already sorted and normalized if necessary
+   */
+  inline double score(const FlatBowVector& a, const FlatBowVector& b) const;
+
   /**
    * Returns the id of the node that is "levelsup" levels from the word given
    * @param wid word id
@@ -211,6 +450,12 @@ public:
    */
   inline ScoringType getScoringType() const { return m_scoring; }
 
+  /**
+   * Returns the order in which sets of features are transformed
+   * @return descent type
+   */
+  inline DescentType getDescentType() const { return m_descent; }
+
   /**
    * Changes the weighting method
    * @param type new weighting type
@@ -223,6 +468,76 @@ public:
    */
   void setScoringType(ScoringType type);
 
+  /**
+   * Changes the order in which the sets of features given to transform are
+   * propagated down the tree. BREADTH_FIRST moves all the features of a set
+   * one level at a time, comparing the features that reach the same node
+   * with its children in a row. This reuses the children in cache when the
+   * vocabulary is much larger than the cache. The words are the same with
+   * both types
+   * @param type new descent type
+   */
+  inline void setDescentType(DescentType type) { m_descent = type; }
+
+  /**
+   * Sets the threads used to create the vocabulary. The subtrees of the
+   * vocabulary are built as parallel tasks, and the k-means steps of the
+   * nodes with many descriptors run as parallel loops. The vocabulary is
+   * the same with any number of threads
+   * @param pool threads to use (not owned), or nullptr to create the
+   *   vocabulary serially
+   */
+  inline void setTrainingThreadPool(ThreadPool* pool) { m_training_pool = pool; }
+
+  /**
+   * Returns the threads used to create the vocabulary
+   * @return pool, or nullptr if the vocabulary is created serially
+   */
+  inline ThreadPool* getTrainingThreadPool() const { return m_training_pool; }
+
+  /**
+   * Sets the parameters of the k-means steps used to create the
+   * vocabulary. A batch makes the steps at the top levels, which have most
+   * of the descriptors, much faster, at the cost of some precision
+   * @param params
+   */
+  inline void setKMeansParams(const KMeansParams& params) { m_kmeans = params; }
+
+  /**
+   * Returns the parameters of the k-means steps used to create the
+   * vocabulary
+   * @return parameters
+   */
+  inline const KMeansParams& getKMeansParams() const { return m_kmeans; }
+
+  /**
+   * Sets the parameters of the creation of the vocabulary from a
+   * descriptor source
+   * @param params
+   */
+  inline void setStreamingParams(const StreamingParams& params) { m_streaming = params; }
+
+  /**
+   * Returns the parameters of the creation of the vocabulary from a
+   * descriptor source
+   * @return params
+   */
+  inline const StreamingParams& getStreamingParams() const { return m_streaming; }
+
+  /**
+   * Sets the parameters of the checkpoints saved while the vocabulary is
+   * created
+   * @param params
+   */
+  inline void setCheckpointParams(const CheckpointParams& params) { m_checkpoint = params; }
+
+  /**
+   * Returns the parameters of the checkpoints saved while the vocabulary
+   * is created
+   * @return params
+   */
+  inline const CheckpointParams& getCheckpointParams() const { return m_checkpoint; }
+
   /**
    * Loads the vocabulary from a text file
    * @param filename
@@ -236,13 +551,47 @@ public:
   void saveToTextFile(const std::string& filename) const;
 
   /**
-   * Loads the vocabulary from a binary file
+   * Loads the vocabulary by mapping a file saved with saveToMappedFile.
+   * Nothing is copied or allocated per node: the pages of the file are read
+   * on demand and shared by all the processes that load it
+   * @param filename
+   */
+  void loadFromMappedFile(const std::string& filename);
+
+  /**
+   * Loads the vocabulary from an image in the mapped format stored in a
+   * part of a mapped file, such as the one embedded in a database file
+   * @param file mapped file, which is kept by the vocabulary
+   * @param offset offset of the image in the file (multiple of 64)
+   * @param size size of the image in bytes
+   */
+  void loadFromMappedFile(const std::shared_ptr<MappedFile>& file, const size_t offset, const size_t size);
+
+  /**
+   * Saves the vocabulary into a file in the mapped format. The file can be
+   * loaded only by the same kind of vocabulary on a machine with the same
+   * byte order
+   * @param filename
+   */
+  void saveToMappedFile(const std::string& filename) const;
+
+  /**
+   * Writes the vocabulary in the mapped format into a binary stream
+   * @param out stream
+   */
+  void saveToMappedFile(std::ostream& out) const;
+
+  /**
+   * Loads the vocabulary from a binary file saved with saveToBinaryFile.
+   * Throws a std::string if the file does not match the descriptor type
    * @param filename
    */
   void loadFromBinaryFile(const std::string& filename);
 
   /**
-   * Saves the vocabulary into a binary file
+   * Saves the vocabulary into a binary file. The descriptors are stored in
+   * their raw representation (F::toBytes), so any descriptor type can be
+   * saved. Files of ORB vocabularies are the same as in previous versions
    * @param filename
    */
   void saveToBinaryFile(const std::string& filename) const;
@@ -254,7 +603,7 @@ public:
   void save(const std::string& filename) const;
 
   /**
-   * Loads the vocabulary from a file
+   * Loads the vocabulary from a file saved with save or saveToMappedFile
    * @param filename
    */
   void load(const std::string& filename);
@@ -329,6 +678,111 @@ protected:
     inline bool isLeaf() const { return children.empty(); }
   };
 
+  //! Node whose subtree is still to be created from a descriptor source
+  struct PendingNode {
+    //! Node id
+    NodeId id;
+    //! Level of the children of the node
+    int level;
+    //! Random generator of the subtree
+    RandomGenerator rng;
+    //! Spill file with the descriptors of the node (empty for the source)
+    std::string filename;
+    //! Number of descriptors of the node
+    uint64_t size;
+
+    PendingNode()
+        : id(0), level(0), size(0) {}
+  };
+
+  //! Creation of a vocabulary with checkpoints
+  struct CheckpointState {
+    //! Number of training descriptors
+    uint64_t n_descriptors;
+    //! The descriptors are read from a descriptor source
+    bool streamed;
+    //! Time of the last checkpoint
+    std::chrono::steady_clock::time_point last_time;
+
+    CheckpointState()
+        : n_descriptors(0), streamed(false) {}
+  };
+
+  /**
+   * Compiled tree, which is read by all the operations of a created or
+   * loaded vocabulary.
+   * Every node has a slot. The slots are sorted in breadth-first order, so
+   * that the children of a node take a contiguous block of slots, and the
+   * slots of the top levels are close to each other.
+   * All the data are stored in one image, which is also the format of the
+   * mapped files: a header followed by arrays aligned to 64 bytes. The image
+   * is either owned by the layout or mapped from a file
+   */
+  struct SearchLayout {
+    //! Slot of a node
+    struct Slot {
+      //! Node id
+      NodeId node;
+      //! First slot of the children of the node
+      unsigned int first;
+      //! Number of children of the node (0 if it is a leaf)
+      unsigned int size;
+    };
+
+    //! Header of the image
+    struct Header {
+      //! "DBoW2MAP"
+      char magic[8];
+      //! Version of the format
+      uint32_t version;
+      //! 0x01020304 in the byte order of the writer
+      uint32_t byte_order;
+      //! Branching factor, depth levels, scoring type and weighting type
+      int32_t k, L, scoring, weighting;
+      //! Bytes per raw descriptor (F::byte_size)
+      uint32_t descriptor_size;
+      //! Number of nodes, slots and words
+      uint32_t n_nodes, n_slots, n_words;
+      //! Size of the image in bytes
+      uint64_t size;
+      //! Offsets of the arrays from the beginning of the image
+      uint64_t slots, descriptors, node_slots, parents, word_ids, weights, words;
+    };
+
+    //! Header, or nullptr if there is no image
+    const Header* header;
+    //! Slots (the root is the slot 0)
+    const Slot* slots;
+    //! Raw descriptors of the slots, F::byte_size bytes per slot
+    const unsigned char* descriptors;
+    //! Slot of each node
+    const unsigned int* node_slots;
+    //! Parent of each node (0 for the root)
+    const NodeId* parents;
+    //! Word id of each node (0 if it is not a leaf)
+    const WordId* word_ids;
+    //! Weight of each node
+    WordValue* weights;
+    //! Node of each word
+    const NodeId* words;
+
+    //! Number of nodes (= number of slots) and of words
+    unsigned int n_nodes, n_words;
+
+    //! Image, if it is owned
+    std::vector<unsigned char> storage;
+    //! Image, if it is mapped
+    std::shared_ptr<MappedFile> file;
+
+    SearchLayout()
+        : header(nullptr), slots(nullptr), descriptors(nullptr), node_slots(nullptr), parents(nullptr),
+          word_ids(nullptr), weights(nullptr), words(nullptr), n_nodes(0), n_words(0) {}
+
+    // the pointers refer to the image, so copies are made by the vocabulary
+    SearchLayout(const SearchLayout&) = delete;
+    SearchLayout& operator=(const SearchLayout&) = delete;
+  };
+
 protected:
   /**
    * Creates an instance of the scoring object accoring to m_scoring
@@ -361,32 +815,276 @@ protected:
    */
   virtual void transform(const TDescriptor& feature, WordId& id) const;
 
+  /**
+   * Transforms a set of descriptors into a bow vector of any type, and into
+   * a feature vector if given
+   * @param TBowVector BowVector or FlatBowVector
+   * @param TFeatureVector FeatureVector or FlatFeatureVector
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) if given, feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param pool if given, threads to use
+   */
+  template<class TBowVector, class TFeatureVector>
+  void transformVectors(const std::vector<TDescriptor>& features, TBowVector& v, TFeatureVector* fv,
+                        const int levelsup, ThreadPool* pool) const;
+
+  /**
+   * Returns the word ids associated to a set of features
+   * @param features
+   * @param word_ids (out) word id of each feature
+   * @param weights (out) weight of the word of each feature
+   * @param node_ids (out) if given, id of the node "levelsup" levels up of each feature
+   * @param levelsup
+   * @param pool if given, threads to use
+   */
+  void quantize(const std::vector<TDescriptor>& features, std::vector<WordId>& word_ids,
+                std::vector<WordValue>& weights, std::vector<NodeId>* node_ids, const int levelsup,
+                ThreadPool* pool) const;
+
+  /**
+   * Returns the word ids associated to a range of features, propagating all
+   * of them down the tree one level at a time
+   * @param features
+   * @param begin first feature of the range
+   * @param end last feature of the range + 1
+   * @param word_ids (out) word id of each feature (indexed as features)
+   * @param weights (out) weight of the word of each feature (indexed as features)
+   * @param node_ids (out) if given, id of the node "levelsup" levels up of
+   *   each feature (indexed as features)
+   * @param levelsup
+   */
+  void quantizeBreadthFirst(const std::vector<TDescriptor>& features, const size_t begin, const size_t end,
+                            WordId* word_ids, WordValue* weights, NodeId* node_ids, const int levelsup) const;
+
+  /**
+   * Builds the bow vector and the feature vector of a set of quantized
+   * features. The result is the same as adding the features one by one
+   * @param word_ids word id of each feature
+   * @param weights weight of the word of each feature
+   * @param node_ids node id of each feature, required if fv is given
+   * @param v (out) bow vector, BowVector or FlatBowVector, must be empty
+   * @param fv (out) if given, feature vector, FeatureVector or
+   *   FlatFeatureVector, must be empty
+   */
+  template<class TBowVector, class TFeatureVector>
+  void buildVectors(const std::vector<WordId>& word_ids, const std::vector<WordValue>& weights,
+                    const std::vector<NodeId>* node_ids, TBowVector& v, TFeatureVector* fv) const;
+
+  /**
+   * Builds a feature vector from (node id, feature index) pairs sorted by
+   * node id
+   * @param entries
+   * @param fv (out) feature vector, must be empty
+   */
+  static void buildFeatureVector(const std::vector<std::pair<NodeId, unsigned int>>& entries, FeatureVector& fv);
+  static void buildFeatureVector(const std::vector<std::pair<NodeId, unsigned int>>& entries, FlatFeatureVector& fv);
+
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
    * a descriptor set, and recursively creates the subsequent levels too
-   * @param parent_id id of parent node
+   * @param parent_id id of parent node in nodes
    * @param descriptors descriptors to run the kmeans on
    * @param current_level current level in the tree
+   * @param nodes (in/out) nodes of the tree, where the new ones are appended
+   * @param rng random generator of the subtree. Each child subtree gets its
+   *   own generator, split from this one
+   * @param last_level last level to create (m_L for the whole subtree)
    */
   void HKmeansStep(const NodeId parent_id, const std::vector<pDescriptor>& descriptors,
-                   const int current_level);
+                   const int current_level, std::vector<Node>& nodes, RandomGenerator& rng,
+                   const int last_level);
+
+  /**
+   * Creates the subtrees of pending nodes whose descriptors are in memory,
+   * saving checkpoints between them. The subtrees are the same as with
+   * HKmeansStep
+   * @param pending (in/out) pending nodes, the next one on top. It is empty
+   *   at the end
+   * @param descriptors (in/out) descriptors of each pending node
+   * @param outer pending nodes below these ones, which are saved in the
+   *   checkpoints too
+   */
+  void createPendingNodes(std::vector<PendingNode>& pending, std::vector<std::vector<pDescriptor>>& descriptors,
+                          const std::vector<PendingNode>& outer);
+
+  /**
+   * Creates the subtrees of pending nodes from a descriptor source, with
+   * at most StreamingParams::max_descriptors descriptors in memory
+   * @param source training images; it has the descriptors of the pending
+   *   nodes without a spill file
+   * @param pending (in/out) pending nodes, the next one on top. It is empty
+   *   at the end
+   */
+  void createFromSource(DescriptorSource& source, std::vector<PendingNode>& pending);
+
+  /**
+   * Creates the words, the search layout and the weights once the tree is
+   * created, and removes the checkpoint file
+   * @param set_weights function that sets the weights of the nodes
+   */
+  void finishCreation(const std::function<void()>& set_weights);
+
+  /**
+   * Saves a checkpoint if checkpoints are enabled and the interval has
+   * elapsed since the last one
+   * @param outer pending nodes
+   * @param inner pending nodes above the outer ones
+   */
+  void saveCheckpointIfDue(const std::vector<PendingNode>& outer, const std::vector<PendingNode>& inner);
+
+  /**
+   * Saves the tree created so far and the pending nodes to the checkpoint
+   * file. The file is replaced once the new one is complete
+   * @param outer pending nodes
+   * @param inner pending nodes above the outer ones
+   */
+  void saveCheckpoint(const std::vector<PendingNode>& outer, const std::vector<PendingNode>& inner);
+
+  /**
+   * Loads the tree and the parameters of the vocabulary from the
+   * checkpoint file
+   * @param pending (out) pending nodes, the next one on top, with no size
+   */
+  void loadCheckpoint(std::vector<PendingNode>& pending);
+
+  /**
+   * Returns the pending node that a descriptor belongs to. Descriptors are
+   * propagated from the root as k-means assigned them, to the closest child
+   * @param feature
+   * @param pending_index index of each node in the pending nodes, or -1
+   * @return index of the pending node, or -1 if the descriptor reaches a
+   *   node that is not pending
+   */
+  int findPendingNode(const TDescriptor& feature, const std::vector<int>& pending_index) const;
+
+  /**
+   * Returns the index of each node of the tree in some pending nodes
+   * @param pending
+   * @param pending_index (out) index of each node, or -1
+   */
+  void getPendingIndex(const std::vector<PendingNode>& pending, std::vector<int>& pending_index) const;
+
+  /**
+   * Writes the descriptors of some pending nodes from a source to their
+   * spill files
+   * @param source training images
+   * @param pending (in/out) pending nodes, which get their spill file and
+   *   size. The root is left without spill file
+   */
+  void spillPendingNodes(DescriptorSource& source, std::vector<PendingNode>& pending) const;
+
+  /**
+   * Counts the descriptors of a source
+   * @param source
+   * @return number of descriptors
+   */
+  static uint64_t countDescriptors(DescriptorSource& source);
+
+  /**
+   * Clusters the descriptors of a pending node on a random sample of them,
+   * creating as many levels as needed for its descendants to fit in
+   * memory, and partitions the descriptors among the leaves created, which
+   * become pending nodes with a spill file
+   * @param node pending node, whose generator is advanced
+   * @param source descriptors of the node
+   * @param pending (in/out) pending nodes, where the new ones are pushed so
+   *   that the first one is on top
+   */
+  void streamingStep(PendingNode& node, DescriptorSource& source, std::vector<PendingNode>& pending);
+
+  /**
+   * Reads all the descriptors of a source
+   * @param source
+   * @param descriptors (out) descriptors, in their order in the source
+   */
+  void loadDescriptors(DescriptorSource& source, std::vector<TDescriptor>& descriptors) const;
+
+  /**
+   * Returns the name of the spill file of a node
+   * @param id node id
+   * @return path in StreamingParams::spill_directory
+   */
+  std::string getSpillFilename(const NodeId id) const;
+
+  /**
+   * Clusters a descriptor set with the k-means parameters of the
+   * vocabulary. This is the step of HKmeansStep that creates a level
+   * @param descriptors
+   * @param clusters (out) at most k clusters
+   * @param groups (out) indices of the descriptors of each cluster, in order.
+   *   A descriptor is in the group of its closest cluster
+   * @param rng random generator
+   */
+  void clusterDescriptors(const std::vector<pDescriptor>& descriptors, std::vector<TDescriptor>& clusters,
+                          std::vector<std::vector<unsigned int>>& groups, RandomGenerator& rng) const;
+
+  /**
+   * Appends to a tree the nodes of the subtree of one of its nodes, built
+   * apart. The nodes get the ids they would have got if the subtree had been
+   * built in the tree
+   * @param nodes (in/out) nodes of the tree
+   * @param id id of the root of the subtree in nodes
+   * @param subtree (in/out) nodes of the subtree; subtree[0] stands for
+   *   nodes[id]. The nodes are moved
+   */
+  void appendSubtree(std::vector<Node>& nodes, const NodeId id, std::vector<Node>& subtree) const;
+
+  /**
+   * Runs Lloyd iterations of k-means from the given clusters: the
+   * descriptors are associated with their closest cluster, and the
+   * clusters are moved to the mean of their descriptors, until no
+   * descriptor changes of cluster
+   * @param descriptors
+   * @param clusters (in/out) clusters, which are not moved after the last
+   *   association
+   * @param groups (out) indices of the descriptors of each cluster, in order
+   * @param max_iterations maximum number of associations (0: no limit)
+   */
+  void runKMeans(const std::vector<pDescriptor>& descriptors, std::vector<TDescriptor>& clusters,
+                 std::vector<std::vector<unsigned int>>& groups, const unsigned int max_iterations) const;
+
+  /**
+   * Draws a random sample of descriptors, with no repetitions
+   * @param descriptors
+   * @param n size of the sample (<= descriptors.size())
+   * @param sample (out) descriptors of the sample, in their original order
+   * @param rng random generator
+   */
+  void sampleDescriptors(const std::vector<pDescriptor>& descriptors, const size_t n,
+                         std::vector<pDescriptor>& sample, RandomGenerator& rng) const;
 
   /**
    * Creates k clusters from the given descriptors with some seeding algorithm.
    * @note In this class, kmeans++ is used, but this function should be
    *   overriden by inherited classes.
+   * @param descriptors
+   * @param clusters resulting clusters
+   * @param rng random generator
    */
   virtual void initiateClusters(const std::vector<pDescriptor>& descriptors,
-                                std::vector<TDescriptor>& clusters) const;
+                                std::vector<TDescriptor>& clusters, RandomGenerator& rng) const;
 
   /**
    * Creates k clusters from the given descriptor sets by running the
    * initial step of kmeans++
    * @param descriptors 
    * @param clusters resulting clusters
+   * @param rng random generator
    */
   void initiateClustersKMpp(const std::vector<pDescriptor>& descriptors,
-                            std::vector<TDescriptor>& clusters) const;
+                            std::vector<TDescriptor>& clusters, RandomGenerator& rng) const;
+
+  /**
+   * Returns the threads to use for a training step on some descriptors
+   * @param n_descriptors number of descriptors of the step
+   * @return pool, or nullptr if the step is too small to be split
+   */
+  inline ThreadPool* getThreadPoolForStep(const size_t n_descriptors) const {
+    // below this, scheduling the threads costs about as much as the step
+    return n_descriptors >= 4096 ? m_training_pool : nullptr;
+  }
 
   /**
    * Create the words of the vocabulary once the tree has been built
@@ -394,36 +1092,96 @@ protected:
   void createWords();
 
   /**
-   * Sets the weights of the nodes of tree according to the given features.
-   * Before calling this function, the nodes and the words must be already
-   * created (by calling HKmeansStep and createWords)
-   * @param features
+   * Creates the search layout from the nodes and the words of the tree,
+   * which are released afterwards. This must be called each time the tree
+   * is built or loaded. Throws if some node cannot be reached from the root
    */
-  void setNodeWeights(const std::vector<std::vector<TDescriptor>>& features);
+  void createSearchLayout();
 
   /**
-   * Returns a random number in the range [min..max]
-   * @param min
-   * @param max
-   * @return random T number in [min..max]
+   * Sets the image of the search layout, after checking its header and
+   * sizes (the arrays are trusted, as in the other formats)
+   * @param image image owned by m_layout.storage or m_layout.file
+   * @param size bytes of the image
    */
-  template<class T>
-  static T RandomValue(const T min, const T max) {
-    return ((T)rand() / (T)RAND_MAX) * (max - min) + min;
-  }
+  void setSearchLayout(unsigned char* image, const size_t size);
 
   /**
-   * Returns a random int in the range [min..max]
-   * @param min
-   * @param max
-   * @return random int in [min..max]
+   * Returns the raw descriptor of a node
+   * @param nid node id
+   * @return F::byte_size bytes
    */
-  static int RandomInt(const int min, const int max) {
-    const int d = max - min + 1;
-    return int(((double)rand() / ((double)RAND_MAX + 1.0)) * d) + min;
+  inline const unsigned char* getRawDescriptor(const NodeId nid) const {
+    return m_layout.descriptors + (size_t)m_layout.node_slots[nid] * F::byte_size;
   }
 
-protected:
+  /**
+   * Returns whether a file is a mapped vocabulary
+   * @param filename
+   * @return true iff the file starts with the mapped format magic
+   */
+  static bool isMappedFile(const std::string& filename);
+
+  /**
+   * Returns the slot of the search layout closest to a feature, among a
+   * block of contiguous slots
+   * @param feature raw feature (F::byte_size bytes)
+   * @param first first slot of the block
+   * @param size number of slots in the block (> 0)
+   * @return closest slot. Ties are resolved in favour of the first slot
+   */
+  unsigned int nearestSlot(const unsigned char* feature, const unsigned int first, const unsigned int size) const;
+
+  /**
+   * Sets the weights of the nodes of tree according to the given features.
+   * Before calling this function, the nodes and the words must be already
+   * created and compiled (by calling HKmeansStep, createWords and
+   * createSearchLayout)
+   * @param features
+   */
+  void setNodeWeights(const std::vector<std::vector<TDescriptor>>& features);
+
+  /**
+   * Sets the weights of the nodes of tree according to the images of a
+   * descriptor source, as the other version does
+   * @param source
+   */
+  void setNodeWeights(DescriptorSource& source);
+
+  /**
+   * Sets the weights of the nodes of tree according to a sequence of
+   * images, given by blocks
+   * @param next_images function that returns (in its second argument) the
+   *   next images, up to the given number, or none at the end
+   */
+  void setNodeWeights(
+      const std::function<void(const unsigned int, std::vector<const std::vector<TDescriptor>*>&)>& next_images);
+
+  /**
+   * Returns a random number in the range [min..max]
+   * @param rng random generator
+   * @param min
+   * @param max
+   * @return random T number in [min..max]
+   */
+  template<class T>
+  static T RandomValue(RandomGenerator& rng, const T min, const T max) {
+    return (T)rng.uniform() * (max - min) + min;
+  }
+
+  /**
+   * Returns a random int in the range [min..max]
+   * @param rng random generator
+   * @param min
+   * @param max
+   * @return random int in [min..max]
+   */
+  static int RandomInt(RandomGenerator& rng, const int min, const int max) {
+    const int d = max - min + 1;
+    return int(rng.uniform() * d) + min;
+  }
+
+protected:
   //! Branching factor
   int m_k;
 
@@ -436,15 +1194,36 @@ protected:
   //! Scoring method
   ScoringType m_scoring;
 
+  //! Descent of the sets of features
+  DescentType m_descent;
+
+  //! Threads used to create the vocabulary (not owned)
+  ThreadPool* m_training_pool;
+
+  //! Parameters of the k-means steps
+  KMeansParams m_kmeans;
+
+  //! Parameters of the creation from a descriptor source
+  StreamingParams m_streaming;
+
+  //! Parameters of the checkpoints
+  CheckpointParams m_checkpoint;
+
+  //! Creation in progress, for its checkpoints
+  CheckpointState m_checkpoint_state;
+
   //! Object for computing scores
   GeneralScoring* m_scoring_object;
 
-  //! Tree nodes
+  //! Tree nodes, only while the tree is being built or loaded
   std::vector<Node> m_nodes;
 
-  //! Words of the vocabulary (tree leaves)
-  //! this condition holds: m_words[wid]->word_id == wid
+  //! Words of the vocabulary (tree leaves), only while the tree is being
+  //! built or loaded. This condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  //! Search layout of the tree (built from m_nodes, or mapped)
+  SearchLayout m_layout;
 };
 
 // --------------------------------------------------------------------------
@@ -452,8 +1231,8 @@ protected:
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(const int k, const int L,
                                                          const WeightingType weighting, const ScoringType scoring)
-    : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-      m_scoring_object(nullptr) {
+    : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring), m_descent(DEPTH_FIRST),
+      m_training_pool(nullptr), m_scoring_object(nullptr) {
   createScoringObject();
 }
 
@@ -461,7 +1240,7 @@ TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(const int k, const int
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(const std::string& filename)
-    : m_scoring_object(nullptr) {
+    : m_descent(DEPTH_FIRST), m_training_pool(nullptr), m_scoring_object(nullptr) {
   load(filename);
 }
 
@@ -469,7 +1248,7 @@ TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(const std::string& file
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(const char* filename)
-    : m_scoring_object(nullptr) {
+    : m_descent(DEPTH_FIRST), m_training_pool(nullptr), m_scoring_object(nullptr) {
   load(filename);
 }
 
@@ -527,7 +1306,7 @@ void TemplatedVocabulary<TDescriptor, F>::setWeightingType(WeightingType type) {
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor, F>::TemplatedVocabulary(
     const TemplatedVocabulary<TDescriptor, F>& voc)
-    : m_scoring_object(nullptr) {
+    : m_descent(DEPTH_FIRST), m_training_pool(nullptr), m_scoring_object(nullptr) {
   *this = voc;
 }
 
@@ -543,18 +1322,34 @@ TemplatedVocabulary<TDescriptor, F>::~TemplatedVocabulary() {
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor, F>&
 TemplatedVocabulary<TDescriptor, F>::operator=(const TemplatedVocabulary<TDescriptor, F>& voc) {
+  if (this == &voc)
+    return *this;
+
   this->m_k = voc.m_k;
   this->m_L = voc.m_L;
   this->m_scoring = voc.m_scoring;
   this->m_weighting = voc.m_weighting;
+  this->m_descent = voc.m_descent;
+  this->m_kmeans = voc.m_kmeans;
+  this->m_streaming = voc.m_streaming;
+  this->m_checkpoint = voc.m_checkpoint;
 
   this->createScoringObject();
 
   this->m_nodes.clear();
   this->m_words.clear();
 
-  this->m_nodes = voc.m_nodes;
-  this->createWords();
+  // the image is copied, even if voc maps it from a file
+  this->m_layout.file.reset();
+  if (voc.m_layout.header != nullptr) {
+    const unsigned char* image = reinterpret_cast<const unsigned char*>(voc.m_layout.header);
+    this->m_layout.storage.assign(image, image + voc.m_layout.header->size);
+    this->setSearchLayout(this->m_layout.storage.data(), this->m_layout.storage.size());
+  }
+  else {
+    this->m_layout.storage.clear();
+    this->setSearchLayout(nullptr, 0);
+  }
 
   return *this;
 }
@@ -564,6 +1359,15 @@ TemplatedVocabulary<TDescriptor, F>::operator=(const TemplatedVocabulary<TDescri
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::create(
     const std::vector<std::vector<TDescriptor>>& training_features) {
+  // the seed is taken from rand, so that srand still chooses the vocabulary
+  create(training_features, (uint64_t)rand());
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::create(
+    const std::vector<std::vector<TDescriptor>>& training_features, const uint64_t seed) {
   m_nodes.clear();
   m_words.clear();
 
@@ -579,13 +1383,76 @@ void TemplatedVocabulary<TDescriptor, F>::create(
   m_nodes.push_back(Node(0)); // root
 
   // create the tree
-  HKmeansStep(0, features, 1);
+  RandomGenerator rng(seed);
+  if (m_checkpoint.filename.empty()) {
+    HKmeansStep(0, features, 1, m_nodes, rng, m_L);
+  }
+  else {
+    m_checkpoint_state.n_descriptors = features.size();
+    m_checkpoint_state.streamed = false;
+    m_checkpoint_state.last_time = std::chrono::steady_clock::now();
 
-  // create the words
-  createWords();
+    std::vector<PendingNode> pending(1);
+    pending[0].id = 0;
+    pending[0].level = 1;
+    pending[0].rng = rng;
+    pending[0].size = features.size();
 
-  // and set the weight of each node of the tree
-  setNodeWeights(training_features);
+    std::vector<std::vector<pDescriptor>> descriptors(1);
+    descriptors[0].swap(features);
+
+    createPendingNodes(pending, descriptors, std::vector<PendingNode>());
+  }
+
+  finishCreation([&] { setNodeWeights(training_features); });
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::resumeCreate(
+    const std::vector<std::vector<TDescriptor>>& training_features) {
+  std::vector<PendingNode> pending;
+  loadCheckpoint(pending);
+
+  std::vector<pDescriptor> features;
+  getFeatures(training_features, features);
+
+  if (m_checkpoint_state.streamed || m_checkpoint_state.n_descriptors != features.size()) {
+    m_nodes.clear();
+    throw std::string("The checkpoint was saved with other training features");
+  }
+
+  // the descriptors of the pending nodes are found again, in order
+  std::vector<int> pending_index;
+  getPendingIndex(pending, pending_index);
+
+  std::vector<int> owners(features.size());
+  auto findOwners = [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      owners[i] = findPendingNode(*features[i], pending_index);
+    }
+  };
+
+  if (m_training_pool != nullptr)
+    m_training_pool->parallelFor(0, features.size(), 1024, findOwners);
+  else
+    findOwners(0, features.size());
+
+  std::vector<std::vector<pDescriptor>> descriptors(pending.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    if (owners[i] >= 0)
+      descriptors[owners[i]].push_back(features[i]);
+  }
+
+  for (size_t i = 0; i < pending.size(); ++i) {
+    pending[i].size = descriptors[i].size();
+  }
+
+  m_checkpoint_state.last_time = std::chrono::steady_clock::now();
+  createPendingNodes(pending, descriptors, std::vector<PendingNode>());
+
+  finishCreation([&] { setNodeWeights(training_features); });
 }
 
 // --------------------------------------------------------------------------
@@ -617,299 +1484,1395 @@ void TemplatedVocabulary<TDescriptor, F>::create(const std::vector<std::vector<T
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::getFeatures(const std::vector<std::vector<TDescriptor>>& training_features,
-                                                      std::vector<pDescriptor>& features) const {
-  features.resize(0);
-
-  typename std::vector<std::vector<TDescriptor>>::const_iterator vvit;
-  typename std::vector<TDescriptor>::const_iterator vit;
-  for (vvit = training_features.begin(); vvit != training_features.end(); ++vvit) {
-    features.reserve(features.size() + vvit->size());
-    for (vit = vvit->begin(); vit != vvit->end(); ++vit) {
-      features.push_back(&(*vit));
-    }
-  }
+void TemplatedVocabulary<TDescriptor, F>::create(DescriptorSource& source) {
+  create(source, (uint64_t)rand());
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::HKmeansStep(const NodeId parent_id, const std::vector<pDescriptor>& descriptors,
-                                                      const int current_level) {
-  if (descriptors.empty())
-    return;
+void TemplatedVocabulary<TDescriptor, F>::create(DescriptorSource& source, const uint64_t seed) {
+  if (source.descriptorSize() != (unsigned int)F::byte_size) {
+    throw std::string("The training descriptors are not of the vocabulary type");
+  }
+  if (m_streaming.max_descriptors == 0) {
+    throw std::string("Invalid streaming parameters");
+  }
 
-  // features associated to each cluster
-  std::vector<TDescriptor> clusters;
-  std::vector<std::vector<unsigned int>> groups; // groups[i] = [j1, j2, ...]
-  // j1, j2, ... indices of descriptors associated to cluster i
+  m_nodes.clear();
+  m_words.clear();
 
-  clusters.reserve(m_k);
-  groups.reserve(m_k);
+  // expected_nodes = Sum_{i=0..L} ( k^i )
+  int expected_nodes = (int)((pow((double)m_k, (double)m_L + 1) - 1) / (m_k - 1));
 
-  //const int msizes[] = { m_k, descriptors.size() };
-  //cv::SparseMat assoc(2, msizes, CV_8U);
-  //cv::SparseMat last_assoc(2, msizes, CV_8U);
-  //! / assoc.row(cluster_idx).col(descriptor_idx) = 1 iif associated
+  m_nodes.reserve(expected_nodes); // avoid allocations when creating the tree
 
-  if ((int)descriptors.size() <= m_k) {
-    // trivial case: one cluster per feature
-    groups.resize(descriptors.size());
+  // the descriptors are counted to size the samples
+  const uint64_t n_descriptors = countDescriptors(source);
 
-    for (unsigned int i = 0; i < descriptors.size(); i++) {
-      groups[i].push_back(i);
-      clusters.push_back(*descriptors[i]);
-    }
-  }
-  else {
-    // select clusters and groups with kmeans
+  m_checkpoint_state.n_descriptors = n_descriptors;
+  m_checkpoint_state.streamed = true;
+  m_checkpoint_state.last_time = std::chrono::steady_clock::now();
 
-    bool first_time = true;
-    bool goon = true;
+  // create root
+  m_nodes.push_back(Node(0)); // root
 
-    // to check if clusters move after iterations
-    std::vector<int> last_association, current_association;
+  // create the tree. The root reads the source itself
+  std::vector<PendingNode> pending(1);
+  pending[0].id = 0;
+  pending[0].level = 1;
+  pending[0].rng.seed(seed);
+  pending[0].size = n_descriptors;
 
-    while (goon) {
-      // 1. Calculate clusters
+  createFromSource(source, pending);
 
-      if (first_time) {
-        // random sample
-        initiateClusters(descriptors, clusters);
-      }
-      else {
-        // calculate cluster centres
-
-        for (unsigned int c = 0; c < clusters.size(); ++c) {
-          std::vector<pDescriptor> cluster_descriptors;
-          cluster_descriptors.reserve(groups[c].size());
-
-          /*
-          for(unsigned int d = 0; d < descriptors.size(); ++d)
-          {
-            if( assoc.find<unsigned char>(c, d) )
-            {
-              cluster_descriptors.push_back(descriptors[d]);
-            }
-          }
-          */
+  finishCreation([&] { setNodeWeights(source); });
+}
 
-          std::vector<unsigned int>::const_iterator vit;
-          for (vit = groups[c].begin(); vit != groups[c].end(); ++vit) {
-            cluster_descriptors.push_back(descriptors[*vit]);
-          }
+// --------------------------------------------------------------------------
 
-          F::meanValue(cluster_descriptors, clusters[c]);
-        }
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::resumeCreate(DescriptorSource& source) {
+  if (source.descriptorSize() != (unsigned int)F::byte_size) {
+    throw std::string("The training descriptors are not of the vocabulary type");
+  }
 
-      } // if(!first_time)
+  std::vector<PendingNode> pending;
+  loadCheckpoint(pending);
 
-      // 2. Associate features with clusters
+  if (!m_checkpoint_state.streamed || m_checkpoint_state.n_descriptors != countDescriptors(source)) {
+    m_nodes.clear();
+    throw std::string("The checkpoint was saved with other training features");
+  }
 
-      // calculate distances to cluster centers
-      groups.clear();
-      groups.resize(clusters.size(), std::vector<unsigned int>());
-      current_association.resize(descriptors.size());
+  // the descriptors of the pending nodes are written to their spill files
+  // again
+  spillPendingNodes(source, pending);
 
-      //assoc.clear();
+  m_checkpoint_state.last_time = std::chrono::steady_clock::now();
+  createFromSource(source, pending);
 
-      typename std::vector<pDescriptor>::const_iterator fit;
-      //unsigned int d = 0;
-      for (fit = descriptors.begin(); fit != descriptors.end(); ++fit) //, ++d)
-      {
-        double best_dist = F::distance(*(*fit), clusters[0]);
-        unsigned int icluster = 0;
+  finishCreation([&] { setNodeWeights(source); });
+}
 
-        for (unsigned int c = 1; c < clusters.size(); ++c) {
-          double dist = F::distance(*(*fit), clusters[c]);
-          if (dist < best_dist) {
-            best_dist = dist;
-            icluster = c;
-          }
-        }
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::createFromSource(DescriptorSource& source,
+                                                           std::vector<PendingNode>& pending) {
+  // the tree is created depth-first, one subtree in memory at a time
+  while (!pending.empty()) {
+    PendingNode node = std::move(pending.back());
+    pending.pop_back();
+
+    std::unique_ptr<DescriptorFileReader> spill;
+    DescriptorSource* descriptors = &source;
+    if (!node.filename.empty()) {
+      spill.reset(new DescriptorFileReader(node.filename));
+      descriptors = spill.get();
+    }
 
-        //assoc.ref<unsigned char>(icluster, d) = 1;
+    if (node.size <= m_streaming.max_descriptors) {
+      // the whole subtree is created as in memory
+      std::vector<TDescriptor> features;
+      features.reserve(node.size);
+      loadDescriptors(*descriptors, features);
 
-        groups[icluster].push_back(fit - descriptors.begin());
-        current_association[fit - descriptors.begin()] = icluster;
+      std::vector<pDescriptor> pfeatures(features.size());
+      for (size_t i = 0; i < features.size(); ++i) {
+        pfeatures[i] = &features[i];
       }
 
-      // kmeans++ ensures all the clusters has any feature associated with them
-
-      // 3. check convergence
-      if (first_time) {
-        first_time = false;
+      if (m_checkpoint.filename.empty()) {
+        HKmeansStep(node.id, pfeatures, node.level, m_nodes, node.rng, m_L);
       }
       else {
-        //goon = !eqUChar(last_assoc, assoc);
-
-        goon = false;
-        for (unsigned int i = 0; i < current_association.size(); i++) {
-          if (current_association[i] != last_association[i]) {
-            goon = true;
-            break;
-          }
-        }
+        std::vector<PendingNode> inner(1, node);
+        std::vector<std::vector<pDescriptor>> inner_descriptors(1);
+        inner_descriptors[0].swap(pfeatures);
+        createPendingNodes(inner, inner_descriptors, pending);
       }
+    }
+    else {
+      streamingStep(node, *descriptors, pending);
+      saveCheckpointIfDue(pending, std::vector<PendingNode>());
+    }
 
-      if (goon) {
-        // copy last feature-cluster association
-        last_association = current_association;
-        //last_assoc = assoc.clone();
-      }
+    if (spill) {
+      spill.reset();
+      std::remove(node.filename.c_str());
+    }
+  }
+}
 
-    } // while(goon)
+// --------------------------------------------------------------------------
 
-  } // if must run kmeans
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::createPendingNodes(std::vector<PendingNode>& pending,
+                                                             std::vector<std::vector<pDescriptor>>& descriptors,
+                                                             const std::vector<PendingNode>& outer) {
+  // the subtrees of this size are created at once, between two checkpoints,
+  // and the larger nodes one level at a time
+  const size_t max_subtree_size = 65536;
 
-  // create nodes
-  for (unsigned int i = 0; i < clusters.size(); ++i) {
-    NodeId id = m_nodes.size();
-    m_nodes.push_back(Node(id));
-    m_nodes.back().descriptor = clusters[i];
-    m_nodes.back().parent = parent_id;
-    m_nodes[parent_id].children.push_back(id);
-  }
+  std::vector<TDescriptor> clusters;
+  std::vector<std::vector<unsigned int>> groups;
 
-  // go on with the next level
-  if (current_level < m_L) {
-    // iterate again with the resulting clusters
-    const std::vector<NodeId>& children_ids = m_nodes[parent_id].children;
-    for (unsigned int i = 0; i < clusters.size(); ++i) {
-      NodeId id = children_ids[i];
+  while (!pending.empty()) {
+    PendingNode node = std::move(pending.back());
+    pending.pop_back();
 
-      std::vector<pDescriptor> child_features;
-      child_features.reserve(groups[i].size());
+    std::vector<pDescriptor> node_descriptors;
+    node_descriptors.swap(descriptors.back());
+    descriptors.pop_back();
 
-      std::vector<unsigned int>::const_iterator vit;
-      for (vit = groups[i].begin(); vit != groups[i].end(); ++vit) {
-        child_features.push_back(descriptors[*vit]);
+    if (node_descriptors.size() <= max_subtree_size) {
+      HKmeansStep(node.id, node_descriptors, node.level, m_nodes, node.rng, m_L);
+    }
+    else {
+      // the same as HKmeansStep without pool, with the recursion unrolled
+      clusterDescriptors(node_descriptors, clusters, groups, node.rng);
+
+      const NodeId first_child = m_nodes.size();
+      for (unsigned int i = 0; i < clusters.size(); ++i) {
+        NodeId id = m_nodes.size();
+        m_nodes.push_back(Node(id));
+        m_nodes.back().descriptor = clusters[i];
+        m_nodes.back().parent = node.id;
+        m_nodes[node.id].children.push_back(id);
       }
 
-      if (child_features.size() > 1) {
-        HKmeansStep(id, child_features, current_level + 1);
+      if (node.level < m_L) {
+        std::vector<PendingNode> children(clusters.size());
+        for (unsigned int i = 0; i < clusters.size(); ++i) {
+          children[i].id = first_child + i;
+          children[i].level = node.level + 1;
+          children[i].rng = node.rng.split();
+          children[i].size = groups[i].size();
+        }
+
+        // the first child is created first
+        for (unsigned int i = clusters.size(); i > 0; --i) {
+          if (groups[i - 1].size() > 1) {
+            std::vector<pDescriptor> child_descriptors(groups[i - 1].size());
+            for (size_t j = 0; j < groups[i - 1].size(); ++j) {
+              child_descriptors[j] = node_descriptors[groups[i - 1][j]];
+            }
+
+            pending.push_back(std::move(children[i - 1]));
+            descriptors.push_back(std::move(child_descriptors));
+          }
+        }
       }
     }
+
+    saveCheckpointIfDue(outer, pending);
   }
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::initiateClusters(const std::vector<pDescriptor>& descriptors,
-                                                           std::vector<TDescriptor>& clusters) const {
-  initiateClustersKMpp(descriptors, clusters);
+void TemplatedVocabulary<TDescriptor, F>::finishCreation(const std::function<void()>& set_weights) {
+  // create the words
+  createWords();
+
+  // compile the tree to propagate the features down (this releases the
+  // nodes)
+  createSearchLayout();
+
+  // and set the weight of each node of the tree
+  set_weights();
+
+  if (!m_checkpoint.filename.empty())
+    std::remove(m_checkpoint.filename.c_str());
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::initiateClustersKMpp(
-    const std::vector<pDescriptor>& pfeatures,
-    std::vector<TDescriptor>& clusters) const {
-  // Implements kmeans++ seeding algorithm
-  // Algorithm:
-  // 1. Choose one center uniformly at random from among the data points.
-  // 2. For each data point x, compute D(x), the distance between x and the nearest
-  //    center that has already been chosen.
-  // 3. Add one new data point as a center. Each point x is chosen with probability
-  //    proportional to D(x)^2.
-  // 4. Repeat Steps 2 and 3 until k centers have been chosen.
-  // 5. Now that the initial centers have been chosen, proceed using standard k-means
-  //    clustering.
+void TemplatedVocabulary<TDescriptor, F>::saveCheckpointIfDue(const std::vector<PendingNode>& outer,
+                                                              const std::vector<PendingNode>& inner) {
+  if (m_checkpoint.filename.empty())
+    return;
 
-  clusters.resize(0);
-  clusters.reserve(m_k);
-  std::vector<double> min_dists(pfeatures.size(), std::numeric_limits<double>::max());
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - m_checkpoint_state.last_time < std::chrono::seconds(m_checkpoint.interval))
+    return;
 
-  // 1.
+  saveCheckpoint(outer, inner);
+  m_checkpoint_state.last_time = std::chrono::steady_clock::now();
+}
 
-  int ifeature = RandomInt(0, pfeatures.size() - 1);
+// --------------------------------------------------------------------------
 
-  // create first cluster
-  clusters.push_back(*pfeatures[ifeature]);
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::saveCheckpoint(const std::vector<PendingNode>& outer,
+                                                         const std::vector<PendingNode>& inner) {
+  const std::string& filename = m_checkpoint.filename;
+  const std::string tmp_filename = filename + ".tmp";
 
-  // compute the initial distances
-  typename std::vector<pDescriptor>::const_iterator fit;
-  std::vector<double>::iterator dit;
-  dit = min_dists.begin();
-  for (fit = pfeatures.begin(); fit != pfeatures.end(); ++fit, ++dit) {
-    *dit = F::distance(*(*fit), clusters.back());
+  std::ofstream ofs;
+  ofs.open(tmp_filename.c_str(), std::ios_base::out | std::ios::binary);
+
+  if (!ofs) {
+    throw std::string("Could not open file: ") + tmp_filename;
   }
 
-  while ((int)clusters.size() < m_k) {
-    // 2.
-    dit = min_dists.begin();
-    for (fit = pfeatures.begin(); fit != pfeatures.end(); ++fit, ++dit) {
-      if (*dit > 0) {
-        double dist = F::distance(*(*fit), clusters.back());
-        if (dist < *dit)
-          *dit = dist;
-      }
-    }
+  // header: the parameters that the tree depends on
+  const uint32_t version = 1;
+  const uint32_t byte_order = 0x01020304;
+  const uint32_t descriptor_size = F::byte_size;
+  const uint32_t streamed = m_checkpoint_state.streamed ? 1 : 0;
+  const uint64_t max_descriptors = m_streaming.max_descriptors;
+  const uint32_t n_nodes = m_nodes.size();
+  const uint32_t n_pending = outer.size() + inner.size();
+
+  ofs.write("DBoW2CKP", 8);
+  ofs.write((char*)&version, sizeof(version));
+  ofs.write((char*)&byte_order, sizeof(byte_order));
+  ofs.write((char*)&descriptor_size, sizeof(descriptor_size));
+  ofs.write((char*)&m_k, sizeof(m_k));
+  ofs.write((char*)&m_L, sizeof(m_L));
+  ofs.write((char*)&m_scoring, sizeof(m_scoring));
+  ofs.write((char*)&m_weighting, sizeof(m_weighting));
+  ofs.write((char*)&m_kmeans.batch_size, sizeof(m_kmeans.batch_size));
+  ofs.write((char*)&m_kmeans.max_batch_iterations, sizeof(m_kmeans.max_batch_iterations));
+  ofs.write((char*)&m_kmeans.max_full_iterations, sizeof(m_kmeans.max_full_iterations));
+  ofs.write((char*)&m_kmeans.max_iterations, sizeof(m_kmeans.max_iterations));
+  ofs.write((char*)&streamed, sizeof(streamed));
+  ofs.write((char*)&max_descriptors, sizeof(max_descriptors));
+  ofs.write((char*)&m_checkpoint_state.n_descriptors, sizeof(m_checkpoint_state.n_descriptors));
+  ofs.write((char*)&n_nodes, sizeof(n_nodes));
+  ofs.write((char*)&n_pending, sizeof(n_pending));
+
+  // nodes, but the root: the children of a node are listed in order
+  std::vector<unsigned char> buf(F::byte_size);
+  for (NodeId i = 1; i < n_nodes; ++i) {
+    ofs.write((char*)&m_nodes[i].parent, sizeof(NodeId));
+    F::toBytes(m_nodes[i].descriptor, buf.data());
+    ofs.write((char*)buf.data(), F::byte_size);
+  }
 
-    // 3.
-    double dist_sum = std::accumulate(min_dists.begin(), min_dists.end(), 0.0);
+  // pending nodes, from the bottom of the stack
+  for (unsigned int i = 0; i < n_pending; ++i) {
+    const PendingNode& node = i < outer.size() ? outer[i] : inner[i - outer.size()];
 
-    if (dist_sum > 0) {
-      double cut_d;
-      do {
-        cut_d = RandomValue<double>(0, dist_sum);
-      } while (cut_d == 0.0);
+    uint64_t state[4];
+    node.rng.getState(state);
 
-      double d_up_now = 0;
-      for (dit = min_dists.begin(); dit != min_dists.end(); ++dit) {
-        d_up_now += *dit;
-        if (d_up_now >= cut_d)
-          break;
-      }
+    ofs.write((char*)&node.id, sizeof(node.id));
+    ofs.write((char*)&node.level, sizeof(node.level));
+    ofs.write((char*)state, sizeof(state));
+  }
 
-      if (dit == min_dists.end())
-        ifeature = pfeatures.size() - 1;
-      else
-        ifeature = dit - min_dists.begin();
+  ofs.close();
+
+  if (!ofs) {
+    throw std::string("Could not write file: ") + tmp_filename;
+  }
+
+  FileSync::sync(tmp_filename);
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    // some platforms do not replace existing files
+    std::remove(filename.c_str());
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+      throw std::string("Could not write file: ") + filename;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::loadCheckpoint(std::vector<PendingNode>& pending) {
+  const std::string& filename = m_checkpoint.filename;
+
+  std::ifstream ifs;
+  ifs.open(filename.c_str(), std::ios_base::in | std::ios::binary);
+
+  if (!ifs) {
+    throw std::string("Could not open file: ") + filename;
+  }
+
+  char magic[8];
+  uint32_t version, byte_order, descriptor_size, streamed, n_nodes, n_pending;
+  uint64_t max_descriptors;
+
+  ifs.read(magic, 8);
+  ifs.read((char*)&version, sizeof(version));
+  ifs.read((char*)&byte_order, sizeof(byte_order));
+  ifs.read((char*)&descriptor_size, sizeof(descriptor_size));
+
+  if (!ifs || memcmp(magic, "DBoW2CKP", 8) != 0 || version != 1 || byte_order != 0x01020304
+      || descriptor_size != (uint32_t)F::byte_size) {
+    throw std::string("Invalid checkpoint file: ") + filename;
+  }
+
+  ifs.read((char*)&m_k, sizeof(m_k));
+  ifs.read((char*)&m_L, sizeof(m_L));
+  ifs.read((char*)&m_scoring, sizeof(m_scoring));
+  ifs.read((char*)&m_weighting, sizeof(m_weighting));
+  ifs.read((char*)&m_kmeans.batch_size, sizeof(m_kmeans.batch_size));
+  ifs.read((char*)&m_kmeans.max_batch_iterations, sizeof(m_kmeans.max_batch_iterations));
+  ifs.read((char*)&m_kmeans.max_full_iterations, sizeof(m_kmeans.max_full_iterations));
+  ifs.read((char*)&m_kmeans.max_iterations, sizeof(m_kmeans.max_iterations));
+  ifs.read((char*)&streamed, sizeof(streamed));
+  ifs.read((char*)&max_descriptors, sizeof(max_descriptors));
+  ifs.read((char*)&m_checkpoint_state.n_descriptors, sizeof(m_checkpoint_state.n_descriptors));
+  ifs.read((char*)&n_nodes, sizeof(n_nodes));
+  ifs.read((char*)&n_pending, sizeof(n_pending));
+  createScoringObject();
+
+  if (!ifs || n_nodes == 0) {
+    throw std::string("Invalid checkpoint file: ") + filename;
+  }
+
+  m_checkpoint_state.streamed = streamed != 0;
+  m_streaming.max_descriptors = max_descriptors;
+
+  m_words.clear();
+  m_nodes.clear();
+
+  // expected_nodes = Sum_{i=0..L} ( k^i )
+  int expected_nodes = (int)((pow((double)m_k, (double)m_L + 1) - 1) / (m_k - 1));
+
+  m_nodes.reserve(std::max(expected_nodes, (int)n_nodes));
+  m_nodes.resize(n_nodes);
+
+  std::vector<unsigned char> buf(F::byte_size);
+  for (NodeId i = 1; i < n_nodes; ++i) {
+    Node& node = m_nodes[i];
+    node.id = i;
+
+    ifs.read((char*)&node.parent, sizeof(NodeId));
+    ifs.read((char*)buf.data(), F::byte_size);
+    if (!ifs || node.parent >= i) {
+      m_nodes.clear();
+      throw std::string("Invalid checkpoint file: ") + filename;
+    }
+
+    F::fromBytes(node.descriptor, buf.data());
+    m_nodes[node.parent].children.push_back(i);
+  }
+
+  pending.resize(n_pending);
+  for (unsigned int i = 0; i < n_pending; ++i) {
+    uint64_t state[4];
+
+    ifs.read((char*)&pending[i].id, sizeof(pending[i].id));
+    ifs.read((char*)&pending[i].level, sizeof(pending[i].level));
+    ifs.read((char*)state, sizeof(state));
+    if (!ifs || pending[i].id >= n_nodes) {
+      m_nodes.clear();
+      throw std::string("Invalid checkpoint file: ") + filename;
+    }
+
+    pending[i].rng.setState(state);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+int TemplatedVocabulary<TDescriptor, F>::findPendingNode(const TDescriptor& feature,
+                                                         const std::vector<int>& pending_index) const {
+  NodeId nid = 0;
+  while (pending_index[nid] < 0 && !m_nodes[nid].children.empty()) {
+    const std::vector<NodeId>& children = m_nodes[nid].children;
+
+    // ties are resolved in favour of the first child, as in runKMeans
+    NodeId best = children[0];
+    double best_dist = F::distance(feature, m_nodes[best].descriptor);
+    for (unsigned int c = 1; c < children.size(); ++c) {
+      const double dist = F::distance(feature, m_nodes[children[c]].descriptor);
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = children[c];
+      }
+    }
+    nid = best;
+  }
+
+  return pending_index[nid];
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::getPendingIndex(const std::vector<PendingNode>& pending,
+                                                          std::vector<int>& pending_index) const {
+  pending_index.assign(m_nodes.size(), -1);
+  for (size_t i = 0; i < pending.size(); ++i) {
+    pending_index[pending[i].id] = i;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::spillPendingNodes(DescriptorSource& source,
+                                                            std::vector<PendingNode>& pending) const {
+  // at most this number of spill files are open at once, as in
+  // streamingStep
+  const size_t max_spill_files = 256;
+
+  std::vector<int> pending_index;
+  getPendingIndex(pending, pending_index);
+
+  std::vector<unsigned char> buf;
+  TDescriptor feature;
+
+  for (size_t first = 0; first < pending.size(); first += max_spill_files) {
+    const size_t n = std::min(max_spill_files, pending.size() - first);
+
+    std::vector<std::unique_ptr<DescriptorFileWriter>> writers(n);
+    for (size_t j = 0; j < n; ++j) {
+      // the root reads the source itself
+      if (pending[first + j].id != 0)
+        writers[j].reset(new DescriptorFileWriter(getSpillFilename(pending[first + j].id), F::byte_size));
+    }
+
+    std::vector<std::vector<unsigned char>> images(n);
+
+    source.rewind();
+    while (source.nextImage(buf)) {
+      const size_t n_features = buf.size() / F::byte_size;
+      for (size_t j = 0; j < n_features; ++j) {
+        const unsigned char* raw = buf.data() + j * F::byte_size;
+        F::fromBytes(feature, raw);
+
+        const int p = findPendingNode(feature, pending_index);
+        if (p >= (int)first && p < (int)(first + n) && writers[p - first])
+          images[p - first].insert(images[p - first].end(), raw, raw + F::byte_size);
+      }
+
+      for (size_t j = 0; j < n; ++j) {
+        if (!images[j].empty()) {
+          writers[j]->addImage(images[j].data(), images[j].size() / F::byte_size);
+          images[j].clear();
+        }
+      }
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+      PendingNode& node = pending[first + j];
+      if (writers[j]) {
+        writers[j]->close();
+        node.filename = getSpillFilename(node.id);
+        node.size = writers[j]->nDescriptors();
+      }
+      else {
+        node.size = m_checkpoint_state.n_descriptors;
+      }
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+uint64_t TemplatedVocabulary<TDescriptor, F>::countDescriptors(DescriptorSource& source) {
+  uint64_t n_descriptors = 0;
+  std::vector<unsigned char> buf;
+  source.rewind();
+  while (source.nextImage(buf)) {
+    n_descriptors += buf.size() / F::byte_size;
+  }
+  return n_descriptors;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::getFeatures(const std::vector<std::vector<TDescriptor>>& training_features,
+                                                      std::vector<pDescriptor>& features) const {
+  features.resize(0);
+
+  // reserving room image by image would copy the pointers once per image
+  typename std::vector<std::vector<TDescriptor>>::const_iterator vvit;
+  size_t n_features = 0;
+  for (vvit = training_features.begin(); vvit != training_features.end(); ++vvit) {
+    n_features += vvit->size();
+  }
+  features.reserve(n_features);
+
+  typename std::vector<TDescriptor>::const_iterator vit;
+  for (vvit = training_features.begin(); vvit != training_features.end(); ++vvit) {
+    for (vit = vvit->begin(); vit != vvit->end(); ++vit) {
+      features.push_back(&(*vit));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::streamingStep(PendingNode& node, DescriptorSource& source,
+                                                        std::vector<PendingNode>& pending) {
+  // every leaf created has a spill file open while the descriptors are
+  // partitioned, and it should get enough descriptors of the sample
+  const size_t max_spill_files = 256;
+  const size_t min_sample_size = 64;
+
+  const size_t max_descriptors = m_streaming.max_descriptors;
+  std::vector<unsigned char> buf;
+
+  // create the levels needed for the nodes of the last one to fit in
+  // memory, if their clusters are balanced
+  const int levels = m_L - node.level + 1;
+  int n_levels = 1;
+  double expected_size = (double)node.size / m_k;
+  size_t fanout = m_k;
+  while (n_levels < levels && expected_size > max_descriptors && fanout * m_k <= max_spill_files
+         && fanout * m_k * min_sample_size <= max_descriptors) {
+    ++n_levels;
+    expected_size /= m_k;
+    fanout *= m_k;
+  }
+  const int last_level = node.level + n_levels - 1;
+
+  // draw the sample with selection sampling, as sampleDescriptors
+  std::vector<TDescriptor> sample;
+  sample.reserve(max_descriptors);
+
+  source.rewind();
+  uint64_t i = 0;
+  while (sample.size() < max_descriptors && source.nextImage(buf)) {
+    const size_t n = buf.size() / F::byte_size;
+    for (size_t j = 0; j < n && sample.size() < max_descriptors; ++j, ++i) {
+      if (node.rng.uniform() * (double)(node.size - i) < (double)(max_descriptors - sample.size())) {
+        sample.push_back(TDescriptor());
+        F::fromBytes(sample.back(), buf.data() + j * F::byte_size);
+      }
+    }
+  }
+
+  std::vector<pDescriptor> psample(sample.size());
+  for (size_t j = 0; j < sample.size(); ++j) {
+    psample[j] = &sample[j];
+  }
+
+  // create the top levels of the subtree
+  const NodeId first = m_nodes.size();
+  HKmeansStep(node.id, psample, node.level, m_nodes, node.rng, last_level);
+
+  sample.clear();
+  sample.shrink_to_fit();
+
+  // levels and raw descriptors of the new nodes; the children of a node
+  // are contiguous. The leaves above the last level of the tree go on with
+  // all their descriptors, even if the sample had few of them
+  const size_t n_new = m_nodes.size() - first;
+  std::vector<unsigned char> raw(n_new * F::byte_size);
+  std::vector<int> node_levels(n_new);
+  std::vector<int> spill_index(n_new, -1);
+  std::vector<NodeId> spill_nodes;
+
+  for (size_t j = 0; j < n_new; ++j) {
+    const Node& new_node = m_nodes[first + j];
+    F::toBytes(new_node.descriptor, raw.data() + j * F::byte_size);
+
+    node_levels[j] = new_node.parent == node.id ? node.level : node_levels[new_node.parent - first] + 1;
+    if (new_node.isLeaf() && node_levels[j] < m_L) {
+      spill_index[j] = spill_nodes.size();
+      spill_nodes.push_back(new_node.id);
+    }
+  }
+
+  if (spill_nodes.empty())
+    return;
+
+  std::vector<std::unique_ptr<DescriptorFileWriter>> writers(spill_nodes.size());
+  for (size_t j = 0; j < spill_nodes.size(); ++j) {
+    writers[j].reset(new DescriptorFileWriter(getSpillFilename(spill_nodes[j]), F::byte_size));
+  }
+
+  // partition the descriptors by propagating them down the new levels. The
+  // spill files keep the order of the source, and one image of the source
+  // gives at most one image in each file
+  std::vector<std::vector<unsigned char>> images(spill_nodes.size());
+  std::vector<double> distances(m_k);
+
+  source.rewind();
+  while (source.nextImage(buf)) {
+    const size_t n = buf.size() / F::byte_size;
+    for (size_t j = 0; j < n; ++j) {
+      const unsigned char* feature = buf.data() + j * F::byte_size;
+
+      NodeId nid = node.id;
+      while (!m_nodes[nid].children.empty()) {
+        const std::vector<NodeId>& children = m_nodes[nid].children;
+        F::distances(feature, raw.data() + (size_t)(children[0] - first) * F::byte_size, children.size(),
+                     distances.data());
+
+        // ties are resolved in favour of the first child, as in runKMeans
+        unsigned int best = 0;
+        for (unsigned int c = 1; c < children.size(); ++c) {
+          if (distances[c] < distances[best])
+            best = c;
+        }
+        nid = children[best];
+      }
+
+      const int s = spill_index[nid - first];
+      if (s >= 0)
+        images[s].insert(images[s].end(), feature, feature + F::byte_size);
+    }
+
+    for (size_t s = 0; s < images.size(); ++s) {
+      if (!images[s].empty()) {
+        writers[s]->addImage(images[s].data(), images[s].size() / F::byte_size);
+        images[s].clear();
+      }
+    }
+  }
+
+  // the generators are split in order, as in HKmeansStep, and the nodes
+  // are pushed so that they are created in order too
+  std::vector<PendingNode> children(spill_nodes.size());
+  for (size_t j = 0; j < spill_nodes.size(); ++j) {
+    writers[j]->close();
+
+    children[j].id = spill_nodes[j];
+    children[j].level = node_levels[spill_nodes[j] - first] + 1;
+    children[j].rng = node.rng.split();
+    children[j].filename = getSpillFilename(spill_nodes[j]);
+    children[j].size = writers[j]->nDescriptors();
+  }
+
+  for (size_t j = children.size(); j > 0; --j) {
+    if (children[j - 1].size > 1)
+      pending.push_back(std::move(children[j - 1]));
+    else
+      std::remove(children[j - 1].filename.c_str());
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::loadDescriptors(DescriptorSource& source,
+                                                          std::vector<TDescriptor>& descriptors) const {
+  descriptors.clear();
+
+  std::vector<unsigned char> buf;
+  source.rewind();
+  while (source.nextImage(buf)) {
+    const size_t n = buf.size() / F::byte_size;
+    for (size_t j = 0; j < n; ++j) {
+      descriptors.push_back(TDescriptor());
+      F::fromBytes(descriptors.back(), buf.data() + j * F::byte_size);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+std::string TemplatedVocabulary<TDescriptor, F>::getSpillFilename(const NodeId id) const {
+  return m_streaming.spill_directory + "/dbow2_spill_" + std::to_string(id) + ".dsc";
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::HKmeansStep(const NodeId parent_id, const std::vector<pDescriptor>& descriptors,
+                                                      const int current_level, std::vector<Node>& nodes,
+                                                      RandomGenerator& rng, const int last_level) {
+  if (descriptors.empty())
+    return;
+
+  ThreadPool* pool = getThreadPoolForStep(descriptors.size());
+
+  // features associated to each cluster
+  std::vector<TDescriptor> clusters;
+  std::vector<std::vector<unsigned int>> groups; // groups[i] = [j1, j2, ...]
+  // j1, j2, ... indices of descriptors associated to cluster i
+
+  clusterDescriptors(descriptors, clusters, groups, rng);
+
+  // create nodes
+  const NodeId first_child = nodes.size();
+  for (unsigned int i = 0; i < clusters.size(); ++i) {
+    NodeId id = nodes.size();
+    nodes.push_back(Node(id));
+    nodes.back().descriptor = clusters[i];
+    nodes.back().parent = parent_id;
+    nodes[parent_id].children.push_back(id);
+  }
+
+  // go on with the next level
+  if (current_level < last_level) {
+    // the generators of the children are split in order, so that the
+    // subtrees do not depend on the order they are built in
+    std::vector<RandomGenerator> child_rngs;
+    child_rngs.reserve(clusters.size());
+    for (unsigned int i = 0; i < clusters.size(); ++i) {
+      child_rngs.push_back(rng.split());
+    }
+
+    // iterate again with the resulting clusters
+    auto createSubtree = [&](const unsigned int i, const NodeId id, std::vector<Node>& subtree) {
+      std::vector<pDescriptor> child_features;
+      child_features.reserve(groups[i].size());
+
+      std::vector<unsigned int>::const_iterator vit;
+      for (vit = groups[i].begin(); vit != groups[i].end(); ++vit) {
+        child_features.push_back(descriptors[*vit]);
+      }
+
+      HKmeansStep(id, child_features, current_level + 1, subtree, child_rngs[i], last_level);
+    };
+
+    if (pool == nullptr) {
+      for (unsigned int i = 0; i < clusters.size(); ++i) {
+        if (groups[i].size() > 1)
+          createSubtree(i, first_child + i, nodes);
+      }
+    }
+    else {
+      // each subtree is built apart, and then appended in order
+      std::vector<std::vector<Node>> subtrees(clusters.size());
+
+      TaskGroup tasks(*pool);
+      for (unsigned int i = 0; i < clusters.size(); ++i) {
+        if (groups[i].size() > 1) {
+          tasks.run([&, i] {
+            subtrees[i].push_back(Node(0)); // stands for the child
+            createSubtree(i, 0, subtrees[i]);
+          });
+        }
+      }
+      tasks.wait();
+
+      for (unsigned int i = 0; i < clusters.size(); ++i) {
+        if (!subtrees[i].empty())
+          appendSubtree(nodes, first_child + i, subtrees[i]);
+      }
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::clusterDescriptors(const std::vector<pDescriptor>& descriptors,
+                                                             std::vector<TDescriptor>& clusters,
+                                                             std::vector<std::vector<unsigned int>>& groups,
+                                                             RandomGenerator& rng) const {
+  clusters.clear();
+  groups.clear();
+  clusters.reserve(m_k);
+  groups.reserve(m_k);
+
+  if ((int)descriptors.size() <= m_k) {
+    // trivial case: one cluster per feature
+    groups.resize(descriptors.size());
+
+    for (unsigned int i = 0; i < descriptors.size(); i++) {
+      groups[i].push_back(i);
+      clusters.push_back(*descriptors[i]);
+    }
+  }
+  else if (m_kmeans.batch_size > 0 && descriptors.size() > m_kmeans.batch_size) {
+    // select the clusters with kmeans on a batch, and then refine them with
+    // all the descriptors
+    std::vector<pDescriptor> batch;
+    sampleDescriptors(descriptors, m_kmeans.batch_size, batch, rng);
+
+    initiateClusters(batch, clusters, rng);
+    runKMeans(batch, clusters, groups, m_kmeans.max_batch_iterations);
+    runKMeans(descriptors, clusters, groups, m_kmeans.max_full_iterations);
+  }
+  else {
+    // select clusters and groups with kmeans
+    initiateClusters(descriptors, clusters, rng);
+    runKMeans(descriptors, clusters, groups, m_kmeans.max_iterations);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::appendSubtree(std::vector<Node>& nodes, const NodeId id,
+                                                        std::vector<Node>& subtree) const {
+  // the nodes of the subtree, but its root, keep their relative order
+  const NodeId offset = nodes.size() - 1;
+
+  nodes[id].children.reserve(subtree[0].children.size());
+  for (unsigned int i = 0; i < subtree[0].children.size(); ++i) {
+    nodes[id].children.push_back(subtree[0].children[i] + offset);
+  }
+
+  for (unsigned int j = 1; j < subtree.size(); ++j) {
+    Node& node = subtree[j];
+    node.id += offset;
+    node.parent = node.parent == 0 ? id : node.parent + offset;
+    for (unsigned int i = 0; i < node.children.size(); ++i) {
+      node.children[i] += offset;
+    }
+
+    nodes.push_back(std::move(node));
+  }
+
+  subtree.clear();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::runKMeans(const std::vector<pDescriptor>& descriptors,
+                                                    std::vector<TDescriptor>& clusters,
+                                                    std::vector<std::vector<unsigned int>>& groups,
+                                                    const unsigned int max_iterations) const {
+  ThreadPool* pool = getThreadPoolForStep(descriptors.size());
+
+  // to check if clusters move after iterations
+  std::vector<int> last_association, current_association;
+
+  // descriptors of each cluster. They and the groups keep their memory
+  // between iterations
+  std::vector<std::vector<pDescriptor>> cluster_descriptors(clusters.size());
+
+  bool first_time = true;
+  bool goon = true;
+  unsigned int iterations = 0;
+
+  while (goon) {
+    // 1. Calculate clusters
+
+    if (!first_time) {
+      // calculate cluster centres
+
+      auto computeCentres = [&](const size_t begin, const size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+          cluster_descriptors[c].clear();
+
+          std::vector<unsigned int>::const_iterator vit;
+          for (vit = groups[c].begin(); vit != groups[c].end(); ++vit) {
+            cluster_descriptors[c].push_back(descriptors[*vit]);
+          }
+
+          F::meanValue(cluster_descriptors[c], clusters[c]);
+        }
+      };
+
+      if (pool != nullptr)
+        pool->parallelFor(0, clusters.size(), 1, computeCentres);
+      else
+        computeCentres(0, clusters.size());
+
+    } // if(!first_time)
+
+    // 2. Associate features with clusters
+
+    // calculate distances to cluster centers
+    current_association.resize(descriptors.size());
+
+    auto associate = [&](const size_t begin, const size_t end) {
+      for (size_t d = begin; d < end; ++d) {
+        double best_dist = F::distance(*descriptors[d], clusters[0]);
+        unsigned int icluster = 0;
+
+        for (unsigned int c = 1; c < clusters.size(); ++c) {
+          double dist = F::distance(*descriptors[d], clusters[c]);
+          if (dist < best_dist) {
+            best_dist = dist;
+            icluster = c;
+          }
+        }
+
+        current_association[d] = icluster;
+      }
+    };
+
+    if (pool != nullptr)
+      pool->parallelFor(0, descriptors.size(), 1024, associate);
+    else
+      associate(0, descriptors.size());
+
+    // the groups keep the order of the descriptors
+    groups.resize(clusters.size());
+    for (unsigned int c = 0; c < clusters.size(); ++c) {
+      groups[c].clear();
+    }
+
+    for (unsigned int d = 0; d < descriptors.size(); ++d) {
+      groups[current_association[d]].push_back(d);
+    }
+
+    // kmeans++ ensures all the clusters has any feature associated with them
+
+    // 3. check convergence
+    ++iterations;
+
+    if (first_time) {
+      first_time = false;
+    }
+    else {
+      goon = false;
+      for (unsigned int i = 0; i < current_association.size(); i++) {
+        if (current_association[i] != last_association[i]) {
+          goon = true;
+          break;
+        }
+      }
+    }
+
+    if (max_iterations > 0 && iterations >= max_iterations)
+      goon = false;
+
+    if (goon) {
+      // keep last feature-cluster association
+      last_association.swap(current_association);
+    }
+
+  } // while(goon)
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::sampleDescriptors(const std::vector<pDescriptor>& descriptors,
+                                                            const size_t n, std::vector<pDescriptor>& sample,
+                                                            RandomGenerator& rng) const {
+  // selection sampling: each descriptor is taken with probability
+  // (still needed) / (still left), so the sample has exactly n of them
+  sample.clear();
+  sample.reserve(n);
+
+  const size_t N = descriptors.size();
+  for (size_t i = 0; i < N && sample.size() < n; ++i) {
+    if (rng.uniform() * (double)(N - i) < (double)(n - sample.size()))
+      sample.push_back(descriptors[i]);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::initiateClusters(const std::vector<pDescriptor>& descriptors,
+                                                           std::vector<TDescriptor>& clusters,
+                                                           RandomGenerator& rng) const {
+  initiateClustersKMpp(descriptors, clusters, rng);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::initiateClustersKMpp(
+    const std::vector<pDescriptor>& pfeatures,
+    std::vector<TDescriptor>& clusters, RandomGenerator& rng) const {
+  // Implements kmeans++ seeding algorithm
+  // Algorithm:
+  // 1. Choose one center uniformly at random from among the data points.
+  // 2. For each data point x, compute D(x), the distance between x and the nearest
+  //    center that has already been chosen.
+  // 3. Add one new data point as a center. Each point x is chosen with probability
+  //    proportional to D(x)^2.
+  // 4. Repeat Steps 2 and 3 until k centers have been chosen.
+  // 5. Now that the initial centers have been chosen, proceed using standard k-means
+  //    clustering.
+
+  clusters.resize(0);
+  clusters.reserve(m_k);
+  std::vector<double> min_dists(pfeatures.size(), std::numeric_limits<double>::max());
+
+  // 1.
+
+  int ifeature = RandomInt(rng, 0, pfeatures.size() - 1);
+
+  // create first cluster
+  clusters.push_back(*pfeatures[ifeature]);
+
+  // updates the distances to the nearest cluster with the last one
+  ThreadPool* pool = getThreadPoolForStep(pfeatures.size());
+
+  auto updateDistances = [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (min_dists[i] > 0) {
+        double dist = F::distance(*pfeatures[i], clusters.back());
+        if (dist < min_dists[i])
+          min_dists[i] = dist;
+      }
+    }
+  };
+
+  // compute the initial distances
+  if (pool != nullptr)
+    pool->parallelFor(0, pfeatures.size(), 1024, updateDistances);
+  else
+    updateDistances(0, pfeatures.size());
+
+  std::vector<double>::iterator dit;
+
+  while ((int)clusters.size() < m_k) {
+    // 3.
+    double dist_sum = std::accumulate(min_dists.begin(), min_dists.end(), 0.0);
+
+    if (dist_sum > 0) {
+      double cut_d;
+      do {
+        cut_d = RandomValue<double>(rng, 0, dist_sum);
+      } while (cut_d == 0.0);
+
+      double d_up_now = 0;
+      for (dit = min_dists.begin(); dit != min_dists.end(); ++dit) {
+        d_up_now += *dit;
+        if (d_up_now >= cut_d)
+          break;
+      }
+
+      if (dit == min_dists.end())
+        ifeature = pfeatures.size() - 1;
+      else
+        ifeature = dit - min_dists.begin();
+
+      clusters.push_back(*pfeatures[ifeature]);
+
+      // 2.
+      if ((int)clusters.size() < m_k) {
+        if (pool != nullptr)
+          pool->parallelFor(0, pfeatures.size(), 1024, updateDistances);
+        else
+          updateDistances(0, pfeatures.size());
+      }
+
+    } // if dist_sum > 0
+    else
+      break;
+
+  } // while(used_clusters < m_k)
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::createWords() {
+  m_words.resize(0);
+
+  if (!m_nodes.empty()) {
+    m_words.reserve((int)pow((double)m_k, (double)m_L));
+
+    typename std::vector<Node>::iterator nit;
+
+    nit = m_nodes.begin(); // ignore root
+    for (++nit; nit != m_nodes.end(); ++nit) {
+      if (nit->isLeaf()) {
+        nit->word_id = m_words.size();
+        m_words.push_back(&(*nit));
+      }
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::createSearchLayout() {
+  typedef typename SearchLayout::Slot Slot;
+  typedef typename SearchLayout::Header Header;
+
+  static_assert(sizeof(Slot) == 12 && sizeof(Header) == 112, "unexpected padding in the mapped format");
+
+  const unsigned int n_nodes = m_nodes.size();
+  const unsigned int n_words = m_words.size();
+
+  if (n_nodes == 0) {
+    m_layout.storage.clear();
+    m_layout.file.reset();
+    setSearchLayout(nullptr, 0);
+    return;
+  }
+
+  // the slots are visited in breadth-first order, and the children of
+  // each one are appended as a block at the end
+  std::vector<Slot> slots(n_nodes);
+
+  // the root takes the slot 0
+  slots[0].node = 0;
+  unsigned int n_slots = 1;
+
+  for (unsigned int s = 0; s < n_slots; ++s) {
+    const std::vector<NodeId>& children = m_nodes[slots[s].node].children;
+
+    if (n_slots + children.size() > n_nodes)
+      throw std::string("Invalid vocabulary tree");
+
+    slots[s].first = n_slots;
+    slots[s].size = children.size();
+
+    std::vector<NodeId>::const_iterator cit;
+    for (cit = children.begin(); cit != children.end(); ++cit, ++n_slots) {
+      slots[n_slots].node = *cit;
+    }
+  }
+
+  if (n_slots != n_nodes)
+    throw std::string("Invalid vocabulary tree: some nodes cannot be reached from the root");
+
+  // arrays of the image
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DBoW2MAP", 8);
+  header.version = 1;
+  header.byte_order = 0x01020304;
+  header.k = m_k;
+  header.L = m_L;
+  header.scoring = m_scoring;
+  header.weighting = m_weighting;
+  header.descriptor_size = F::byte_size;
+  header.n_nodes = n_nodes;
+  header.n_slots = n_slots;
+  header.n_words = n_words;
+
+  uint64_t offset = sizeof(Header);
+  auto allocate = [&offset](uint64_t& array, const uint64_t bytes) {
+    offset = (offset + 63) & ~(uint64_t)63;
+    array = offset;
+    offset += bytes;
+  };
+
+  allocate(header.slots, (uint64_t)n_slots * sizeof(Slot));
+  allocate(header.descriptors, (uint64_t)n_slots * F::byte_size);
+  allocate(header.node_slots, (uint64_t)n_nodes * sizeof(unsigned int));
+  allocate(header.parents, (uint64_t)n_nodes * sizeof(NodeId));
+  allocate(header.word_ids, (uint64_t)n_nodes * sizeof(WordId));
+  allocate(header.weights, (uint64_t)n_nodes * sizeof(WordValue));
+  allocate(header.words, (uint64_t)n_words * sizeof(NodeId));
+  header.size = offset;
+
+  std::vector<unsigned char>& image = m_layout.storage;
+  image.assign(header.size, 0);
+  memcpy(image.data(), &header, sizeof(header));
+
+  Slot* image_slots = reinterpret_cast<Slot*>(&image[header.slots]);
+  unsigned char* descriptors = &image[header.descriptors];
+  unsigned int* node_slots = reinterpret_cast<unsigned int*>(&image[header.node_slots]);
+  NodeId* parents = reinterpret_cast<NodeId*>(&image[header.parents]);
+  WordId* word_ids = reinterpret_cast<WordId*>(&image[header.word_ids]);
+  WordValue* weights = reinterpret_cast<WordValue*>(&image[header.weights]);
+  NodeId* words = reinterpret_cast<NodeId*>(&image[header.words]);
+
+  for (unsigned int s = 0; s < n_slots; ++s) {
+    const NodeId nid = slots[s].node;
+    const Node& node = m_nodes[nid];
+
+    image_slots[s] = slots[s];
+    node_slots[nid] = s;
+    parents[nid] = node.parent;
+    word_ids[nid] = node.word_id;
+    weights[nid] = node.weight;
+
+    // the root has no descriptor
+    if (s > 0)
+      F::toBytes(node.descriptor, descriptors + (size_t)s * F::byte_size);
+  }
+
+  for (unsigned int w = 0; w < n_words; ++w) {
+    words[w] = m_words[w]->id;
+  }
+
+  m_layout.file.reset();
+  setSearchLayout(image.data(), image.size());
+
+  // from now on, the tree is read from the layout
+  m_nodes.clear();
+  m_nodes.shrink_to_fit();
+  m_words.clear();
+  m_words.shrink_to_fit();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::setSearchLayout(unsigned char* image, const size_t size) {
+  typedef typename SearchLayout::Slot Slot;
+  typedef typename SearchLayout::Header Header;
+
+  if (image == nullptr) {
+    m_layout.header = nullptr;
+    m_layout.slots = nullptr;
+    m_layout.descriptors = nullptr;
+    m_layout.node_slots = nullptr;
+    m_layout.parents = nullptr;
+    m_layout.word_ids = nullptr;
+    m_layout.weights = nullptr;
+    m_layout.words = nullptr;
+    m_layout.n_nodes = m_layout.n_words = 0;
+    return;
+  }
+
+  const Header* header = reinterpret_cast<const Header*>(image);
+
+  if (size < sizeof(Header) || memcmp(header->magic, "DBoW2MAP", 8) != 0)
+    throw std::string("Invalid vocabulary image");
+  if (header->version != 1)
+    throw std::string("Unsupported vocabulary image version");
+  if (header->byte_order != 0x01020304)
+    throw std::string("Vocabulary image saved with another byte order");
+  if (header->descriptor_size != (uint32_t)F::byte_size)
+    throw std::string("Vocabulary image saved with another descriptor type");
+  if (header->scoring < L1_NORM || header->scoring > DOT_PRODUCT || header->weighting < TF_IDF
+      || header->weighting > BINARY)
+    throw std::string("Corrupted vocabulary image");
+
+  // every array must be inside the image
+  const uint64_t n_nodes = header->n_nodes;
+  const uint64_t n_words = header->n_words;
+  auto fits = [&](const uint64_t array, const uint64_t bytes) {
+    return array % 8 == 0 && array <= size && bytes <= size - array;
+  };
+
+  if (header->size != size || header->n_slots != n_nodes || n_nodes == 0
+      || !fits(header->slots, n_nodes * sizeof(Slot))
+      || !fits(header->descriptors, n_nodes * F::byte_size)
+      || !fits(header->node_slots, n_nodes * sizeof(unsigned int))
+      || !fits(header->parents, n_nodes * sizeof(NodeId))
+      || !fits(header->word_ids, n_nodes * sizeof(WordId))
+      || !fits(header->weights, n_nodes * sizeof(WordValue))
+      || !fits(header->words, n_words * sizeof(NodeId))) {
+    throw std::string("Corrupted vocabulary image");
+  }
+
+  const Slot* slots = reinterpret_cast<const Slot*>(image + header->slots);
+  const unsigned int* node_slots = reinterpret_cast<const unsigned int*>(image + header->node_slots);
+  const NodeId* parents = reinterpret_cast<const NodeId*>(image + header->parents);
+  const WordId* word_ids = reinterpret_cast<const WordId*>(image + header->word_ids);
+  const NodeId* words = reinterpret_cast<const NodeId*>(image + header->words);
+
+  // the tree must be the one written by createSearchLayout, so that the
+  // descents and the walks up to the root stay inside the arrays and end:
+  // the slots are a permutation of the nodes, the children of each slot are
+  // the next block of slots after it, and words and leaves match
+  if (slots[0].node != 0 || parents[0] != 0)
+    throw std::string("Corrupted vocabulary image");
+
+  uint64_t next_block = 1;
+  for (uint64_t s = 0; s < n_nodes; ++s) {
+    const Slot& slot = slots[s];
+
+    if (slot.node >= n_nodes || node_slots[slot.node] != s)
+      throw std::string("Corrupted vocabulary image");
+
+    if (slot.size > 0) {
+      if (slot.first != next_block || slot.first <= s || slot.size > n_nodes - slot.first)
+        throw std::string("Corrupted vocabulary image");
+      next_block += slot.size;
+
+      for (uint64_t c = slot.first; c < next_block; ++c) {
+        if (slots[c].node >= n_nodes || parents[slots[c].node] != slot.node)
+          throw std::string("Corrupted vocabulary image");
+      }
+    }
+    else if (s > 0) {
+      if (word_ids[slot.node] >= n_words || words[word_ids[slot.node]] != slot.node)
+        throw std::string("Corrupted vocabulary image");
+    }
+  }
 
-      clusters.push_back(*pfeatures[ifeature]);
+  if (next_block != n_nodes)
+    throw std::string("Corrupted vocabulary image");
 
-    } // if dist_sum > 0
-    else
-      break;
+  for (uint64_t w = 0; w < n_words; ++w) {
+    if (words[w] == 0 || words[w] >= n_nodes || word_ids[words[w]] != w || slots[node_slots[words[w]]].size > 0)
+      throw std::string("Corrupted vocabulary image");
+  }
 
-  } // while(used_clusters < m_k)
+  m_layout.header = header;
+  m_layout.slots = slots;
+  m_layout.descriptors = image + header->descriptors;
+  m_layout.node_slots = node_slots;
+  m_layout.parents = parents;
+  m_layout.word_ids = word_ids;
+  m_layout.weights = reinterpret_cast<WordValue*>(image + header->weights);
+  m_layout.words = words;
+  m_layout.n_nodes = n_nodes;
+  m_layout.n_words = n_words;
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::createWords() {
-  m_words.resize(0);
+unsigned int TemplatedVocabulary<TDescriptor, F>::nearestSlot(const unsigned char* feature,
+                                                              const unsigned int first, const unsigned int size) const {
+  // the distances to the whole block are computed at once, by chunks
+  // that fit in the stack
+  const unsigned int chunk = 32;
+  double d[chunk];
 
-  if (!m_nodes.empty()) {
-    m_words.reserve((int)pow((double)m_k, (double)m_L));
+  const unsigned char* descriptors = m_layout.descriptors + (size_t)first * F::byte_size;
 
-    typename std::vector<Node>::iterator nit;
+  unsigned int best = first;
+  double best_d = 0;
 
-    nit = m_nodes.begin(); // ignore root
-    for (++nit; nit != m_nodes.end(); ++nit) {
-      if (nit->isLeaf()) {
-        nit->word_id = m_words.size();
-        m_words.push_back(&(*nit));
+  for (unsigned int i = 0; i < size; i += chunk) {
+    const unsigned int n = std::min(size - i, chunk);
+    F::distances(feature, descriptors + i * F::byte_size, n, d);
+
+    if (i == 0)
+      best_d = d[0];
+
+    for (unsigned int j = 0; j < n; ++j) {
+      if (d[j] < best_d) {
+        best_d = d[j];
+        best = first + i + j;
       }
     }
   }
+
+  return best;
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(const std::vector<std::vector<TDescriptor>>& training_features) {
-  const unsigned int NWords = m_words.size();
-  const unsigned int NDocs = training_features.size();
+  size_t next = 0;
+  setNodeWeights([&](const unsigned int max_images, std::vector<const std::vector<TDescriptor>*>& images) {
+    images.clear();
+    for (; next < training_features.size() && images.size() < max_images; ++next) {
+      images.push_back(&training_features[next]);
+    }
+  });
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(DescriptorSource& source) {
+  std::vector<std::vector<TDescriptor>> block;
+  std::vector<unsigned char> buf;
+
+  source.rewind();
+  setNodeWeights([&](const unsigned int max_images, std::vector<const std::vector<TDescriptor>*>& images) {
+    // the descriptors of the block are reused
+    block.resize(max_images);
+    images.clear();
+    while (images.size() < max_images && source.nextImage(buf)) {
+      std::vector<TDescriptor>& image = block[images.size()];
+      image.resize(buf.size() / F::byte_size);
+      for (size_t j = 0; j < image.size(); ++j) {
+        F::fromBytes(image[j], buf.data() + j * F::byte_size);
+      }
+      images.push_back(&image);
+    }
+  });
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(
+    const std::function<void(const unsigned int, std::vector<const std::vector<TDescriptor>*>&)>& next_images) {
+  const unsigned int NWords = m_layout.n_words;
+  unsigned int NDocs = 0;
 
   if (m_weighting == TF || m_weighting == BINARY) {
     // idf part must be 1 always
     for (unsigned int i = 0; i < NWords; i++)
-      m_words[i]->weight = 1;
+      m_layout.weights[m_layout.words[i]] = 1;
   }
   else if (m_weighting == IDF || m_weighting == TF_IDF) {
     // IDF and TF-IDF: we calculte the idf path now
@@ -918,21 +2881,45 @@ void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(const std::vector<std::
     // The complete tf-idf score is calculated in ::transform
 
     std::vector<unsigned int> Ni(NWords, 0);
-    std::vector<bool> counted(NWords, false);
 
-    typename std::vector<std::vector<TDescriptor>>::const_iterator mit;
-    typename std::vector<TDescriptor>::const_iterator fit;
+    // the words of the images are computed in parallel, by blocks of images
+    const unsigned int block_size = 256;
+    std::vector<const std::vector<TDescriptor>*> images;
+    std::vector<std::vector<WordId>> image_words(block_size);
+
+    while (true) {
+      next_images(block_size, images);
+      if (images.empty())
+        break;
+
+      const unsigned int n = images.size();
+      NDocs += n;
+
+      auto quantizeImages = [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const std::vector<TDescriptor>& image = *images[i];
+          std::vector<WordId>& words = image_words[i];
+
+          words.resize(image.size());
+          for (unsigned int j = 0; j < image.size(); ++j) {
+            transform(image[j], words[j]);
+          }
 
-    for (mit = training_features.begin(); mit != training_features.end(); ++mit) {
-      fill(counted.begin(), counted.end(), false);
+          std::sort(words.begin(), words.end());
+          words.erase(std::unique(words.begin(), words.end()), words.end());
+        }
+      };
 
-      for (fit = mit->begin(); fit < mit->end(); ++fit) {
-        WordId word_id;
-        transform(*fit, word_id);
+      if (m_training_pool != nullptr)
+        m_training_pool->parallelFor(0, n, 1, quantizeImages);
+      else
+        quantizeImages(0, n);
 
-        if (!counted[word_id]) {
-          Ni[word_id]++;
-          counted[word_id] = true;
+      // each word is counted once per image
+      for (unsigned int i = 0; i < n; ++i) {
+        std::vector<WordId>::const_iterator wit;
+        for (wit = image_words[i].begin(); wit != image_words[i].end(); ++wit) {
+          Ni[*wit]++;
         }
       }
     }
@@ -940,7 +2927,7 @@ void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(const std::vector<std::
     // set ln(N/Ni)
     for (unsigned int i = 0; i < NWords; i++) {
       if (Ni[i] > 0) {
-        m_words[i]->weight = log((double)NDocs / (double)Ni[i]);
+        m_layout.weights[m_layout.words[i]] = log((double)NDocs / (double)Ni[i]);
       } // else // This cannot occur if using kmeans++
     }
   }
@@ -950,14 +2937,14 @@ void TemplatedVocabulary<TDescriptor, F>::setNodeWeights(const std::vector<std::
 
 template<class TDescriptor, class F>
 inline unsigned int TemplatedVocabulary<TDescriptor, F>::size() const {
-  return m_words.size();
+  return m_layout.n_words;
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 inline bool TemplatedVocabulary<TDescriptor, F>::empty() const {
-  return m_words.empty();
+  return m_layout.n_words == 0;
 }
 
 // --------------------------------------------------------------------------
@@ -965,29 +2952,30 @@ inline bool TemplatedVocabulary<TDescriptor, F>::empty() const {
 template<class TDescriptor, class F>
 float TemplatedVocabulary<TDescriptor, F>::getEffectiveLevels() const {
   long sum = 0;
-  typename std::vector<Node*>::const_iterator wit;
-  for (wit = m_words.begin(); wit != m_words.end(); ++wit) {
-    const Node* p = *wit;
+  for (WordId wid = 0; wid < m_layout.n_words; ++wid) {
+    NodeId p = m_layout.words[wid];
 
-    for (; p->id != 0; sum++)
-      p = &m_nodes[p->parent];
+    for (; p != 0; sum++)
+      p = m_layout.parents[p];
   }
 
-  return (float)((double)sum / (double)m_words.size());
+  return (float)((double)sum / (double)m_layout.n_words);
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 TDescriptor TemplatedVocabulary<TDescriptor, F>::getWord(WordId wid) const {
-  return m_words[wid]->descriptor;
+  TDescriptor descriptor;
+  F::fromBytes(descriptor, getRawDescriptor(m_layout.words[wid]));
+  return descriptor;
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 WordValue TemplatedVocabulary<TDescriptor, F>::getWordWeight(WordId wid) const {
-  return m_words[wid]->weight;
+  return m_layout.weights[m_layout.words[wid]];
 }
 
 // --------------------------------------------------------------------------
@@ -1007,122 +2995,307 @@ WordId TemplatedVocabulary<TDescriptor, F>::transform(const TDescriptor& feature
 
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v) const {
-  v.clear();
+  transformVectors(features, v, static_cast<FeatureVector*>(nullptr), 0, nullptr);
+}
 
-  if (empty()) {
-    return;
-  }
+// --------------------------------------------------------------------------
 
-  // normalize
-  LNorm norm;
-  bool must = m_scoring_object->mustNormalize(norm);
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v, FeatureVector& fv, const int levelsup) const {
+  transformVectors(features, v, &fv, levelsup, nullptr);
+}
 
-  typename std::vector<TDescriptor>::const_iterator fit;
+// --------------------------------------------------------------------------
 
-  if (m_weighting == TF || m_weighting == TF_IDF) {
-    for (fit = features.begin(); fit < features.end(); ++fit) {
-      WordId id;
-      WordValue w;
-      // w is the idf value if TF_IDF, 1 if TF
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v, ThreadPool& pool) const {
+  transformVectors(features, v, static_cast<FeatureVector*>(nullptr), 0, &pool);
+}
 
-      transform(*fit, id, w);
+// --------------------------------------------------------------------------
 
-      // not stopped
-      if (w > 0)
-        v.addWeight(id, w);
-    }
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v, FeatureVector& fv, const int levelsup, ThreadPool& pool) const {
+  transformVectors(features, v, &fv, levelsup, &pool);
+}
 
-    if (!v.empty() && !must) {
-      // unnecessary when normalizing
-      const double nd = v.size();
-      for (BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
-        vit->second /= nd;
-    }
-  }
-  else // IDF || BINARY
-  {
-    for (fit = features.begin(); fit < features.end(); ++fit) {
-      WordId id;
-      WordValue w;
-      // w is idf if IDF, or 1 if BINARY
+// --------------------------------------------------------------------------
 
-      transform(*fit, id, w);
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v) const {
+  transformVectors(features, v, static_cast<FeatureVector*>(nullptr), 0, nullptr);
+}
 
-      // not stopped
-      if (w > 0)
-        v.addIfNotExist(id, w);
+// --------------------------------------------------------------------------
 
-    } // if add_features
-  }   // if m_weighting == ...
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FeatureVector& fv, const int levelsup) const {
+  transformVectors(features, v, &fv, levelsup, nullptr);
+}
 
-  if (must)
-    v.normalize(norm);
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v, ThreadPool& pool) const {
+  transformVectors(features, v, static_cast<FeatureVector*>(nullptr), 0, &pool);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v, FeatureVector& fv, const int levelsup, ThreadPool& pool) const {
+  transformVectors(features, v, &fv, levelsup, &pool);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v,
+                                                    FlatFeatureVector& fv, const int levelsup) const {
+  transformVectors(features, v, &fv, levelsup, nullptr);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v,
+                                                    FlatFeatureVector& fv, const int levelsup) const {
+  transformVectors(features, v, &fv, levelsup, nullptr);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, BowVector& v,
+                                                    FlatFeatureVector& fv, const int levelsup,
+                                                    ThreadPool& pool) const {
+  transformVectors(features, v, &fv, levelsup, &pool);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features, FlatBowVector& v,
+                                                    FlatFeatureVector& fv, const int levelsup,
+                                                    ThreadPool& pool) const {
+  transformVectors(features, v, &fv, levelsup, &pool);
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
-void TemplatedVocabulary<TDescriptor, F>::transform(const std::vector<TDescriptor>& features,
-                                                    BowVector& v, FeatureVector& fv, const int levelsup) const {
+template<class TBowVector, class TFeatureVector>
+void TemplatedVocabulary<TDescriptor, F>::transformVectors(const std::vector<TDescriptor>& features, TBowVector& v,
+                                                           TFeatureVector* fv, const int levelsup,
+                                                           ThreadPool* pool) const {
   v.clear();
-  fv.clear();
+  if (fv != nullptr)
+    fv->clear();
 
   if (empty()) // safe for subclasses
   {
     return;
   }
 
+  std::vector<WordId> word_ids;
+  std::vector<WordValue> weights;
+  std::vector<NodeId> node_ids;
+  quantize(features, word_ids, weights, fv != nullptr ? &node_ids : nullptr, levelsup, pool);
+
+  buildVectors(word_ids, weights, fv != nullptr ? &node_ids : nullptr, v, fv);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::quantize(const std::vector<TDescriptor>& features,
+                                                   std::vector<WordId>& word_ids, std::vector<WordValue>& weights,
+                                                   std::vector<NodeId>* node_ids, const int levelsup,
+                                                   ThreadPool* pool) const {
+  const size_t n = features.size();
+
+  word_ids.resize(n);
+  weights.resize(n);
+  if (node_ids != nullptr)
+    node_ids->assign(n, 0);
+
+  // each feature is written only by the thread that quantizes it
+  auto quantizeRange = [&](const size_t begin, const size_t end) {
+    if (m_descent == BREADTH_FIRST) {
+      quantizeBreadthFirst(features, begin, end, word_ids.data(), weights.data(),
+                           node_ids != nullptr ? node_ids->data() : nullptr, levelsup);
+      return;
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+      transform(features[i], word_ids[i], weights[i],
+                node_ids != nullptr ? &(*node_ids)[i] : nullptr, levelsup);
+    }
+  };
+
+  if (pool != nullptr) {
+    // chunks large enough to amortize the scheduling, and to share the
+    // nodes among several features in the breadth-first descent
+    pool->parallelFor(0, n, m_descent == BREADTH_FIRST ? 256 : 64, quantizeRange);
+  }
+  else {
+    quantizeRange(0, n);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::quantizeBreadthFirst(const std::vector<TDescriptor>& features,
+                                                               const size_t begin, const size_t end,
+                                                               WordId* word_ids, WordValue* weights,
+                                                               NodeId* node_ids, const int levelsup) const {
+  typedef typename SearchLayout::Slot Slot;
+
+  const Slot* slots = m_layout.slots;
+  const unsigned int n = end - begin;
+
+  // the features are compared with the raw descriptors of the layout
+  std::vector<unsigned char> queries(n * F::byte_size);
+  for (unsigned int i = 0; i < n; ++i) {
+    F::toBytes(features[begin + i], &queries[i * F::byte_size]);
+  }
+
+  // level at which the node must be stored in node_ids, if given
+  const int nid_level = m_L - levelsup;
+  if (nid_level <= 0 && node_ids != nullptr) {
+    for (size_t i = begin; i < end; ++i)
+      node_ids[i] = 0; // root
+  }
+
+  // (slot, feature) pairs of the features that have not reached a leaf yet,
+  // sorted by slot so that the features of the same node are in a row
+  std::vector<std::pair<unsigned int, unsigned int>> active(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    active[i] = std::make_pair(0, i); // root
+  }
+
+  for (int current_level = 1; !active.empty(); ++current_level) {
+    // active is compacted in place: n_active <= i always
+    size_t n_active = 0;
+
+    for (size_t i = 0; i < active.size();) {
+      const unsigned int parent = active[i].first;
+      const Slot& slot = slots[parent];
+
+      // the children of the node stay in cache for all its features
+      for (; i < active.size() && active[i].first == parent; ++i) {
+        const unsigned int f = active[i].second;
+        const unsigned int best = nearestSlot(&queries[f * F::byte_size], slot.first, slot.size);
+
+        if (node_ids != nullptr && current_level == nid_level)
+          node_ids[begin + f] = slots[best].node;
+
+        if (slots[best].size > 0) {
+          active[n_active++] = std::make_pair(best, f);
+        }
+        else {
+          // turn node id into word id
+          word_ids[begin + f] = m_layout.word_ids[slots[best].node];
+          weights[begin + f] = m_layout.weights[slots[best].node];
+        }
+      }
+    }
+
+    active.resize(n_active);
+    std::sort(active.begin(), active.end());
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class TBowVector, class TFeatureVector>
+void TemplatedVocabulary<TDescriptor, F>::buildVectors(const std::vector<WordId>& word_ids,
+                                                       const std::vector<WordValue>& weights,
+                                                       const std::vector<NodeId>* node_ids,
+                                                       TBowVector& v, TFeatureVector* fv) const {
   // normalize
   LNorm norm;
   bool must = m_scoring_object->mustNormalize(norm);
 
-  typename std::vector<TDescriptor>::const_iterator fit;
+  // w is the idf value if TF_IDF, 1 if TF, idf if IDF, or 1 if BINARY
+  const bool add_weights = m_weighting == TF || m_weighting == TF_IDF;
 
-  if (m_weighting == TF || m_weighting == TF_IDF) {
-    unsigned int i_feature = 0;
-    for (fit = features.begin(); fit < features.end(); ++fit, ++i_feature) {
-      WordId id;
-      NodeId nid;
-      WordValue w;
-      // w is the idf value if TF_IDF, 1 if TF
+  // sorting (id, feature index) pairs gives the words in the order of the
+  // vectors, and the features of each word in the order they were added
+  std::vector<std::pair<unsigned int, unsigned int>> entries;
+  entries.reserve(word_ids.size());
 
-      transform(*fit, id, w, &nid, levelsup);
+  for (unsigned int i = 0; i < word_ids.size(); ++i) {
+    // not stopped
+    if (weights[i] > 0)
+      entries.push_back(std::make_pair(word_ids[i], i));
+  }
 
-      if (w > 0) // not stopped
-      {
-        v.addWeight(id, w);
-        fv.addFeature(nid, i_feature);
-      }
-    }
+  std::sort(entries.begin(), entries.end());
+
+  for (size_t i = 0; i < entries.size();) {
+    const WordId id = entries[i].first;
+    WordValue value = weights[entries[i].second];
 
-    if (!v.empty() && !must) {
-      // unnecessary when normalizing
-      const double nd = v.size();
-      for (BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
-        vit->second /= nd;
+    // same summation order as adding the features one by one
+    for (++i; i < entries.size() && entries[i].first == id; ++i) {
+      if (add_weights)
+        value += weights[entries[i].second];
     }
+
+    v.insert(v.end(), typename TBowVector::value_type(id, value));
+  }
+
+  if (add_weights && !v.empty() && !must) {
+    // unnecessary when normalizing
+    const double nd = v.size();
+    for (typename TBowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+      vit->second /= nd;
   }
-  else // IDF || BINARY
-  {
-    unsigned int i_feature = 0;
-    for (fit = features.begin(); fit < features.end(); ++fit, ++i_feature) {
-      WordId id;
-      NodeId nid;
-      WordValue w;
-      // w is idf if IDF, or 1 if BINARY
-
-      transform(*fit, id, w, &nid, levelsup);
-
-      if (w > 0) // not stopped
-      {
-        v.addIfNotExist(id, w);
-        fv.addFeature(nid, i_feature);
-      }
-    }
-  } // if m_weighting == ...
 
   if (must)
     v.normalize(norm);
+
+  if (fv == nullptr)
+    return;
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    entries[i].first = (*node_ids)[entries[i].second];
+  }
+
+  std::sort(entries.begin(), entries.end());
+
+  buildFeatureVector(entries, *fv);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::buildFeatureVector(const std::vector<std::pair<NodeId, unsigned int>>& entries,
+                                                             FeatureVector& fv) {
+  for (size_t i = 0; i < entries.size();) {
+    const NodeId nid = entries[i].first;
+
+    size_t j = i + 1;
+    while (j < entries.size() && entries[j].first == nid)
+      ++j;
+
+    FeatureVector::iterator fit = fv.insert(fv.end(), FeatureVector::value_type(nid, std::vector<unsigned int>()));
+    fit->second.reserve(j - i);
+    for (; i < j; ++i) {
+      fit->second.push_back(entries[i].second);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::buildFeatureVector(const std::vector<std::pair<NodeId, unsigned int>>& entries,
+                                                             FlatFeatureVector& fv) {
+  fv.assign(entries);
 }
 
 // --------------------------------------------------------------------------
@@ -1134,6 +3307,13 @@ inline double TemplatedVocabulary<TDescriptor, F>::score(const BowVector& v1, co
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+inline double TemplatedVocabulary<TDescriptor, F>::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return m_scoring_object->score(v1, v2);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::transform(const TDescriptor& feature, WordId& id) const {
   WordValue weight;
@@ -1145,53 +3325,50 @@ void TemplatedVocabulary<TDescriptor, F>::transform(const TDescriptor& feature,
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::transform(const TDescriptor& feature, WordId& word_id, WordValue& weight,
                                                     NodeId* nid, const int levelsup) const {
-  // propagate the feature down the tree
-  std::vector<NodeId> nodes;
-  typename std::vector<NodeId>::const_iterator nit;
+  typedef typename SearchLayout::Slot Slot;
+
+  const Slot* slots = m_layout.slots;
+
+  // the feature is compared with the raw descriptors of the layout
+  unsigned char query[F::byte_size];
+  F::toBytes(feature, query);
 
   // level at which the node must be stored in nid, if given
   const int nid_level = m_L - levelsup;
   if (nid_level <= 0 && nid != nullptr)
     *nid = 0; // root
 
-  NodeId final_id = 0; // root
+  // propagate the feature down the tree
+  const Slot* slot = &slots[0]; // root
   int current_level = 0;
 
   do {
     ++current_level;
-    nodes = m_nodes[final_id].children;
-    final_id = nodes[0];
 
-    double best_d = F::distance(feature, m_nodes[final_id].descriptor);
+    // the children of the current node are contiguous
+    const unsigned int best = nearestSlot(query, slot->first, slot->size);
 
-    for (nit = nodes.begin() + 1; nit != nodes.end(); ++nit) {
-      NodeId id = *nit;
-      double d = F::distance(feature, m_nodes[id].descriptor);
-      if (d < best_d) {
-        best_d = d;
-        final_id = id;
-      }
-    }
+    slot = &slots[best];
 
     if (nid != nullptr && current_level == nid_level)
-      *nid = final_id;
+      *nid = slot->node;
 
-  } while (!m_nodes[final_id].isLeaf());
+  } while (slot->size > 0);
 
   // turn node id into word id
-  word_id = m_nodes[final_id].word_id;
-  weight = m_nodes[final_id].weight;
+  word_id = m_layout.word_ids[slot->node];
+  weight = m_layout.weights[slot->node];
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor, F>::getParentNode(const WordId wid, int levelsup) const {
-  NodeId ret = m_words[wid]->id;   // node id
-  while (levelsup > 0 && ret != 0) // ret == 0 --> root
+  NodeId ret = m_layout.words[wid]; // node id
+  while (levelsup > 0 && ret != 0)   // ret == 0 --> root
   {
     --levelsup;
-    ret = m_nodes[ret].parent;
+    ret = m_layout.parents[ret];
   }
   return ret;
 }
@@ -1200,31 +3377,32 @@ NodeId TemplatedVocabulary<TDescriptor, F>::getParentNode(const WordId wid, int
 
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::getWordsFromNode(const NodeId nid, std::vector<WordId>& words) const {
+  typedef typename SearchLayout::Slot Slot;
+
   words.clear();
 
-  if (m_nodes[nid].isLeaf()) {
-    words.push_back(m_nodes[nid].word_id);
+  const Slot* slots = m_layout.slots;
+  const unsigned int slot = m_layout.node_slots[nid];
+
+  if (slots[slot].size == 0) {
+    words.push_back(m_layout.word_ids[nid]);
   }
   else {
     words.reserve(m_k); // ^1, ^2, ...
 
-    std::vector<NodeId> parents;
-    parents.push_back(nid);
+    // the children of a node are a block of slots
+    std::vector<unsigned int> parents;
+    parents.push_back(slot);
 
     while (!parents.empty()) {
-      NodeId parentid = parents.back();
+      const Slot& parent = slots[parents.back()];
       parents.pop_back();
 
-      const std::vector<NodeId>& child_ids = m_nodes[parentid].children;
-      std::vector<NodeId>::const_iterator cit;
-
-      for (cit = child_ids.begin(); cit != child_ids.end(); ++cit) {
-        const Node& child_node = m_nodes[*cit];
-
-        if (child_node.isLeaf())
-          words.push_back(child_node.word_id);
+      for (unsigned int c = parent.first; c < parent.first + parent.size; ++c) {
+        if (slots[c].size == 0)
+          words.push_back(m_layout.word_ids[slots[c].node]);
         else
-          parents.push_back(*cit);
+          parents.push_back(c);
 
       } // for each child
     }   // while !parents.empty
@@ -1236,11 +3414,11 @@ void TemplatedVocabulary<TDescriptor, F>::getWordsFromNode(const NodeId nid, std
 template<class TDescriptor, class F>
 int TemplatedVocabulary<TDescriptor, F>::stopWords(const double minWeight) {
   int c = 0;
-  typename std::vector<Node*>::iterator wit;
-  for (wit = m_words.begin(); wit != m_words.end(); ++wit) {
-    if ((*wit)->weight < minWeight) {
+  for (WordId wid = 0; wid < m_layout.n_words; ++wid) {
+    WordValue& weight = m_layout.weights[m_layout.words[wid]];
+    if (weight < minWeight) {
       ++c;
-      (*wit)->weight = 0;
+      weight = 0;
     }
   }
   return c;
@@ -1328,6 +3506,8 @@ void TemplatedVocabulary<TDescriptor, F>::loadFromTextFile(const std::string& fi
       m_nodes.at(n_id).children.reserve(m_k);
     }
   }
+
+  createSearchLayout();
 }
 
 // --------------------------------------------------------------------------
@@ -1344,19 +3524,20 @@ void TemplatedVocabulary<TDescriptor, F>::saveToTextFile(const std::string& file
   ofs << m_k << " " << m_L << " "
       << " " << m_scoring << " " << m_weighting << std::endl;
 
-  for (size_t i = 1; i < m_nodes.size(); ++i) {
-    const Node& node = m_nodes.at(i);
+  TDescriptor descriptor;
 
-    ofs << node.parent << " ";
+  for (NodeId i = 1; i < m_layout.n_nodes; ++i) {
+    ofs << m_layout.parents[i] << " ";
 
-    if (node.isLeaf()) {
+    if (m_layout.slots[m_layout.node_slots[i]].size == 0) {
       ofs << 1 << " ";
     }
     else {
       ofs << 0 << " ";
     }
 
-    ofs << F::toString(node.descriptor) << " " << static_cast<double>(node.weight) << std::endl;
+    F::fromBytes(descriptor, getRawDescriptor(i));
+    ofs << F::toString(descriptor) << " " << static_cast<double>(m_layout.weights[i]) << std::endl;
   }
 
   ofs.close();
@@ -1376,6 +3557,13 @@ void TemplatedVocabulary<TDescriptor, F>::loadFromBinaryFile(const std::string&
   unsigned int n_nodes, node_size;
   ifs.read((char*)&n_nodes, sizeof(n_nodes));
   ifs.read((char*)&node_size, sizeof(node_size));
+
+  // parent, raw descriptor, weight and leaf flag
+  const unsigned int expected_node_size = sizeof(NodeId) + F::byte_size + sizeof(float) + sizeof(bool);
+  if (!ifs || n_nodes == 0 || node_size != expected_node_size) {
+    throw std::string("Invalid vocabulary file: ") + filename;
+  }
+
   ifs.read((char*)&m_k, sizeof(m_k));
   ifs.read((char*)&m_L, sizeof(m_L));
   ifs.read((char*)&m_scoring, sizeof(m_scoring));
@@ -1389,40 +3577,45 @@ void TemplatedVocabulary<TDescriptor, F>::loadFromBinaryFile(const std::string&
   m_nodes.resize(n_nodes);
   m_nodes.at(0).id = 0;
 
-  char* buf = new char[node_size];
-  unsigned int n_id = 1;
+  std::vector<unsigned char> buf(node_size);
 
-  while (!ifs.eof()) {
-    ifs.read(buf, node_size);
-    m_nodes.at(n_id).id = n_id;
-    const int* ptr = (int*)buf;
+  for (NodeId n_id = 1; n_id < n_nodes; ++n_id) {
+    ifs.read((char*)buf.data(), node_size);
+    if (!ifs) {
+      throw std::string("Invalid vocabulary file: ") + filename;
+    }
+
+    const unsigned char* ptr = buf.data();
 
-    m_nodes.at(n_id).parent = *ptr;
-    m_nodes.at(m_nodes.at(n_id).parent).children.push_back(n_id);
-    m_nodes.at(n_id).descriptor = cv::Mat(1, F::L, CV_8U);
+    Node& node = m_nodes.at(n_id);
+    node.id = n_id;
 
-    memcpy(m_nodes.at(n_id).descriptor.data, buf + 4, F::L);
-    m_nodes.at(n_id).weight = *reinterpret_cast<float*>(buf + 4 + F::L);
+    memcpy(&node.parent, ptr, sizeof(NodeId));
+    ptr += sizeof(NodeId);
+    m_nodes.at(node.parent).children.push_back(n_id);
 
-    if (buf[8 + F::L]) {
+    F::fromBytes(node.descriptor, ptr);
+    ptr += F::byte_size;
+
+    float weight;
+    memcpy(&weight, ptr, sizeof(float));
+    ptr += sizeof(float);
+    node.weight = weight;
+
+    if (*ptr) {
       const int w_id = m_words.size();
       m_words.resize(w_id + 1);
-      m_nodes.at(n_id).word_id = w_id;
-      m_words.at(w_id) = &m_nodes.at(n_id);
+      node.word_id = w_id;
+      m_words.at(w_id) = &node;
     }
     else {
-      m_nodes.at(n_id).children.reserve(m_k);
-    }
-
-    ++n_id;
-    if (n_id == n_nodes) {
-      break;
+      node.children.reserve(m_k);
     }
   }
 
   ifs.close();
 
-  delete[] buf;
+  createSearchLayout();
 }
 
 // --------------------------------------------------------------------------
@@ -1436,8 +3629,8 @@ void TemplatedVocabulary<TDescriptor, F>::saveToBinaryFile(const std::string& fi
     throw std::string("Could not open file: ") + filename;
   }
 
-  const unsigned int n_nodes = m_nodes.size();
-  const unsigned int node_size = sizeof(m_nodes.at(0).parent) + F::L * sizeof(char) + sizeof(float) + sizeof(bool);
+  const unsigned int n_nodes = m_layout.n_nodes;
+  const unsigned int node_size = sizeof(NodeId) + F::byte_size + sizeof(float) + sizeof(bool);
 
   ofs.write((char*)&n_nodes, sizeof(n_nodes));
   ofs.write((char*)&node_size, sizeof(node_size));
@@ -1446,16 +3639,16 @@ void TemplatedVocabulary<TDescriptor, F>::saveToBinaryFile(const std::string& fi
   ofs.write((char*)&m_scoring, sizeof(m_scoring));
   ofs.write((char*)&m_weighting, sizeof(m_weighting));
 
-  for (size_t i = 1; i < n_nodes; ++i) {
-    const Node& node = m_nodes.at(i);
+  for (NodeId i = 1; i < n_nodes; ++i) {
+    ofs.write((char*)&m_layout.parents[i], sizeof(NodeId));
 
-    ofs.write((char*)&node.parent, sizeof(node.parent));
-    ofs.write((char*)node.descriptor.data, F::L);
+    // the raw descriptors are the same bytes as in the search layout
+    ofs.write((const char*)getRawDescriptor(i), F::byte_size);
 
-    const float weight = node.weight;
+    const float weight = m_layout.weights[i];
     ofs.write((char*)&weight, sizeof(weight));
 
-    const bool is_leaf = node.isLeaf();
+    const bool is_leaf = m_layout.slots[m_layout.node_slots[i]].size == 0;
     ofs.write((char*)&is_leaf, sizeof(is_leaf));
   }
 
@@ -1464,6 +3657,94 @@ void TemplatedVocabulary<TDescriptor, F>::saveToBinaryFile(const std::string& fi
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::loadFromMappedFile(const std::string& filename) {
+  std::shared_ptr<MappedFile> file(new MappedFile(filename));
+  loadFromMappedFile(file, 0, file->size());
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::loadFromMappedFile(const std::shared_ptr<MappedFile>& file,
+                                                             const size_t offset, const size_t size) {
+  if (offset % 64 != 0 || offset > file->size() || size > file->size() - offset)
+    throw std::string("Invalid vocabulary image");
+
+  // the current tree is kept if the image is not valid
+  setSearchLayout(file->data() + offset, size);
+
+  m_layout.file = file;
+  m_layout.storage.clear();
+  m_layout.storage.shrink_to_fit();
+  m_nodes.clear();
+  m_words.clear();
+
+  const typename SearchLayout::Header* header = m_layout.header;
+  m_k = header->k;
+  m_L = header->L;
+  m_scoring = static_cast<ScoringType>(header->scoring);
+  m_weighting = static_cast<WeightingType>(header->weighting);
+  createScoringObject();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::saveToMappedFile(const std::string& filename) const {
+  if (m_layout.header == nullptr) {
+    throw std::string("Cannot save an empty vocabulary: ") + filename;
+  }
+
+  std::ofstream ofs;
+  ofs.open(filename.c_str(), std::ios_base::out | std::ios::binary);
+
+  if (!ofs) {
+    throw std::string("Could not open file: ") + filename;
+  }
+
+  // the image is the file
+  saveToMappedFile(ofs);
+
+  if (!ofs) {
+    throw std::string("Could not write file: ") + filename;
+  }
+
+  ofs.close();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::saveToMappedFile(std::ostream& out) const {
+  if (m_layout.header == nullptr) {
+    throw std::string("Cannot save an empty vocabulary");
+  }
+
+  // the header of the image keeps the parameters of the vocabulary when its
+  // layout was created, and the scoring and weighting may have changed since
+  typename SearchLayout::Header header = *m_layout.header;
+  header.k = m_k;
+  header.L = m_L;
+  header.scoring = m_scoring;
+  header.weighting = m_weighting;
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(m_layout.header) + sizeof(header), header.size - sizeof(header));
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor, F>::isMappedFile(const std::string& filename) {
+  std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios::binary);
+
+  char magic[8];
+  return ifs.read(magic, 8) && memcmp(magic, "DBoW2MAP", 8) == 0;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::save(const std::string& filename) const {
   cv::FileStorage fs(filename.c_str(), cv::FileStorage::WRITE);
@@ -1477,6 +3758,11 @@ void TemplatedVocabulary<TDescriptor, F>::save(const std::string& filename) cons
 
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::load(const std::string& filename) {
+  if (isMappedFile(filename)) {
+    loadFromMappedFile(filename);
+    return;
+  }
+
   cv::FileStorage fs(filename.c_str(), cv::FileStorage::READ);
   if (!fs.isOpened())
     throw std::string("Could not open file ") + filename;
@@ -1527,32 +3813,34 @@ void TemplatedVocabulary<TDescriptor, F>::save(cv::FileStorage& f,
   // tree
   f << "nodes"
     << "[";
-  std::vector<NodeId> parents, children;
-  std::vector<NodeId>::const_iterator pit;
+  typedef typename SearchLayout::Slot Slot;
+  const Slot* slots = m_layout.slots;
+  std::vector<unsigned int> parents; // slots
+  TDescriptor descriptor;
 
-  parents.push_back(0); // root
+  if (m_layout.n_nodes > 0)
+    parents.push_back(0); // root
 
   while (!parents.empty()) {
-    NodeId pid = parents.back();
+    const Slot& parent = slots[parents.back()];
     parents.pop_back();
 
-    const Node& parent = m_nodes[pid];
-    children = parent.children;
-
-    for (pit = children.begin(); pit != children.end(); pit++) {
-      const Node& child = m_nodes[*pit];
+    for (unsigned int c = parent.first; c < parent.first + parent.size; ++c) {
+      const NodeId child = slots[c].node;
 
       // save node data
+      F::fromBytes(descriptor, getRawDescriptor(child));
+
       f << "{:";
-      f << "nodeId" << (int)child.id;
-      f << "parentId" << (int)pid;
-      f << "weight" << (double)child.weight;
-      f << "descriptor" << F::toString(child.descriptor);
+      f << "nodeId" << (int)child;
+      f << "parentId" << (int)parent.node;
+      f << "weight" << (double)m_layout.weights[child];
+      f << "descriptor" << F::toString(descriptor);
       f << "}";
 
       // add to parent list
-      if (!child.isLeaf()) {
-        parents.push_back(*pit);
+      if (slots[c].size > 0) {
+        parents.push_back(c);
       }
     }
   }
@@ -1563,12 +3851,10 @@ void TemplatedVocabulary<TDescriptor, F>::save(cv::FileStorage& f,
   f << "words"
     << "[";
 
-  typename std::vector<Node*>::const_iterator wit;
-  for (wit = m_words.begin(); wit != m_words.end(); wit++) {
-    WordId id = wit - m_words.begin();
+  for (WordId id = 0; id < m_layout.n_words; ++id) {
     f << "{:";
     f << "wordId" << (int)id;
-    f << "nodeId" << (int)(*wit)->id;
+    f << "nodeId" << (int)m_layout.words[id];
     f << "}";
   }
 
@@ -1626,6 +3912,8 @@ void TemplatedVocabulary<TDescriptor, F>::load(const cv::FileStorage& fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  createSearchLayout();
 }
 
 // --------------------------------------------------------------------------
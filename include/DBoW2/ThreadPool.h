@@ -0,0 +1,186 @@
+/**
+ * File: ThreadPool.h
+ * Date: October 2026
+ * Description: pool of threads to run parallel loops and tasks
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef __D_T_THREAD_POOL__
+#define __D_T_THREAD_POOL__
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _MSC_VER
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+namespace DBoW2 {
+
+class TaskGroup;
+
+/**
+ * Fixed set of threads that run the iterations of parallel loops and groups
+ * of tasks. Each thread keeps its own queue of tasks, runs the last one it
+ * queued first, and steals the oldest ones of the other threads when its
+ * queue is empty. The threads that wait for a loop or a group work too, so
+ * loops and groups can be nested
+ */
+class DLL_EXPORT ThreadPool {
+public:
+  //! Body of a parallel loop, called with a range [begin, end) of iterations
+  using RangeFunction = std::function<void(size_t, size_t)>;
+
+  //! Task
+  using Task = std::function<void()>;
+
+  /**
+   * Creates the pool
+   * @param n_threads number of threads that work on each loop, including the
+   *   calling one. 0 means one per hardware thread; 1 runs the loops serially
+   */
+  explicit ThreadPool(const unsigned int n_threads = 0);
+
+  /**
+   * Waits for the running tasks and stops the threads
+   */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * Returns the number of threads that work on each loop
+   * @return number of threads, including the calling one
+   */
+  inline unsigned int size() const { return m_workers.size() + 1; }
+
+  /**
+   * Runs fn over the range [begin, end), split into chunks of grain
+   * iterations, and waits until all of them are done. If fn throws, the
+   * first exception is rethrown here once the other chunks are done
+   * @param begin first iteration
+   * @param end last iteration + 1
+   * @param grain iterations per chunk (> 0)
+   * @param fn body, called once per chunk
+   */
+  void parallelFor(const size_t begin, const size_t end, const size_t grain, const RangeFunction& fn);
+
+protected:
+  friend class TaskGroup;
+
+  //! Queue of tasks of a thread
+  struct Queue {
+    std::deque<Task> tasks;
+    std::mutex mutex;
+  };
+
+  /**
+   * Queues a task in the queue of the calling thread
+   * @param task
+   */
+  void push(Task task);
+
+  /**
+   * Runs one queued task, if any: the newest one of the calling thread, or
+   * the oldest one of another thread
+   * @return true iff a task was run
+   */
+  bool runQueuedTask();
+
+  /**
+   * Returns the queue of the calling thread. The threads that do not belong
+   * to the pool share the last queue
+   * @return index of the queue
+   */
+  unsigned int getQueueIndex() const;
+
+  /**
+   * Wakes up the threads waiting for tasks or for the end of a group
+   */
+  void notify();
+
+  /**
+   * Loop of the worker threads
+   * @param index index of the worker
+   */
+  void work(const unsigned int index);
+
+protected:
+  //! Worker threads
+  std::vector<std::thread> m_workers;
+
+  //! Queues of tasks, one per worker plus one for the other threads
+  std::vector<std::unique_ptr<Queue>> m_queues;
+
+  //! Number of queued tasks
+  std::atomic<size_t> m_n_queued;
+
+  //! Protects the waits on m_cond
+  std::mutex m_mutex;
+
+  //! Signals new tasks, finished groups or stop
+  std::condition_variable m_cond;
+
+  //! Flag to stop the workers
+  bool m_stop;
+};
+
+/**
+ * Set of tasks run by a thread pool, which can be waited for together
+ */
+class DLL_EXPORT TaskGroup {
+public:
+  /**
+   * Creates an empty group
+   * @param pool threads that run the tasks
+   */
+  explicit TaskGroup(ThreadPool& pool);
+
+  /**
+   * Waits for the tasks of the group. Their exceptions are ignored
+   */
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  /**
+   * Queues a task. It may run at any moment until wait returns
+   * @param task
+   */
+  void run(ThreadPool::Task task);
+
+  /**
+   * Runs queued tasks until all the tasks of the group are done. If any of
+   * them threw, the first exception is rethrown
+   */
+  void wait();
+
+protected:
+  //! Pool
+  ThreadPool& m_pool;
+
+  //! Number of tasks not finished yet
+  std::atomic<size_t> m_n_pending;
+
+  //! First exception thrown by a task
+  std::exception_ptr m_error;
+
+  //! Protects m_error
+  std::mutex m_mutex;
+};
+
+} // namespace DBoW2
+
+#endif
@@ -0,0 +1,448 @@
+/**
+ * File: DatabaseJournal.cpp
+ * Date: October 2026
+ * Description: append-only journal of the changes of a database
+ * License: see the LICENSE.txt file
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "DBoW2/DatabaseJournal.h"
+#include "DBoW2/FileSync.h"
+
+namespace DBoW2 {
+
+namespace {
+
+//! Header of the file
+struct FileHeader {
+  //! "DBoW2JNL"
+  char magic[8];
+  //! Version of the format
+  uint32_t version;
+  //! 0x01020304 in the byte order of the writer
+  uint32_t byte_order;
+};
+
+//! Header of a record, followed by its payload and by the checksum of both
+struct RecordHeader {
+  //! Type of change
+  uint32_t type;
+  //! Size of the payload in bytes
+  uint32_t size;
+  //! Number of the change
+  uint64_t sequence;
+};
+
+/**
+ * Computes the FNV-1a hash of some bytes
+ * @param data
+ * @param size number of bytes
+ * @param hash hash of the previous bytes, if any
+ * @return hash
+ */
+uint32_t checksum(const void* data, const size_t size, uint32_t hash = 2166136261u) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Appends a value to a buffer
+ * @param buffer
+ * @param value
+ */
+template<class T>
+void put(std::vector<unsigned char>& buffer, const T& value) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/**
+ * Reads a value from a payload
+ * @param p (in/out) position in the payload
+ * @param end end of the payload
+ * @param value (out)
+ * @return false if the payload is too short
+ */
+template<class T>
+bool get(const unsigned char*& p, const unsigned char* end, T& value) {
+  if ((size_t)(end - p) < sizeof(T))
+    return false;
+
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+/**
+ * Appends the words of a bow vector to a buffer
+ * @param buffer
+ * @param bow_vector BowVector or FlatBowVector
+ */
+template<class TBowVector>
+void putWords(std::vector<unsigned char>& buffer, const TBowVector& bow_vector) {
+  put<uint32_t>(buffer, bow_vector.size());
+  for (typename TBowVector::const_iterator vit = bow_vector.begin(); vit != bow_vector.end(); ++vit) {
+    put<uint32_t>(buffer, vit->first);
+    put<double>(buffer, vit->second);
+  }
+}
+
+/**
+ * Appends a feature vector to a buffer
+ * @param buffer
+ * @param feature_vector
+ */
+void putFeatures(std::vector<unsigned char>& buffer, const FlatFeatureVector& feature_vector) {
+  put<uint32_t>(buffer, feature_vector.size());
+  for (FlatFeatureVector::const_iterator fit = feature_vector.begin(); fit != feature_vector.end(); ++fit) {
+    put<uint32_t>(buffer, fit->first);
+    put<uint32_t>(buffer, fit->second.size());
+    for (size_t i = 0; i < fit->second.size(); ++i) {
+      put<uint32_t>(buffer, fit->second[i]);
+    }
+  }
+}
+
+/**
+ * Changes the size of a file
+ * @param file
+ * @param size bytes
+ * @return true iff it succeeded
+ */
+bool truncateFile(FILE* file, const uint64_t size) {
+  if (fflush(file) != 0)
+    return false;
+#ifdef _WIN32
+  return _chsize_s(_fileno(file), size) == 0;
+#else
+  return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+DatabaseJournal::DatabaseJournal(const std::string& filename, const unsigned int records_per_sync)
+    : m_filename(filename), m_file(nullptr), m_size(0), m_n_pending(0),
+      m_records_per_sync(std::max(1u, records_per_sync)) {
+  m_file = fopen(filename.c_str(), "r+b");
+  if (m_file == nullptr)
+    m_file = fopen(filename.c_str(), "w+b");
+  if (m_file == nullptr)
+    throw std::string("Could not open file: ") + filename;
+
+  FileHeader header;
+  if (fread(&header, sizeof(header), 1, m_file) != 1) {
+    // new file, or the process crashed while creating it
+    try {
+      clear();
+    }
+    catch (...) {
+      fclose(m_file);
+      throw;
+    }
+    return;
+  }
+
+  if (memcmp(header.magic, "DBoW2JNL", 8) != 0 || header.version != 1 || header.byte_order != 0x01020304) {
+    fclose(m_file);
+    throw std::string("Invalid journal file: ") + filename;
+  }
+
+  // the records end at the first incomplete one
+  uint64_t file_size = 0;
+#ifdef _WIN32
+  if (_fseeki64(m_file, 0, SEEK_END) == 0)
+    file_size = _ftelli64(m_file);
+#else
+  if (fseeko(m_file, 0, SEEK_END) == 0)
+    file_size = ftello(m_file);
+#endif
+
+  m_size = sizeof(FileHeader);
+  seek(m_size);
+
+  Record record;
+  uint64_t record_size;
+  while (readRecord(record, file_size - m_size, record_size)) {
+    m_size += record_size;
+  }
+
+  if (!truncateFile(m_file, m_size)) {
+    fclose(m_file);
+    throw std::string("Could not write file: ") + filename;
+  }
+  seek(m_size);
+}
+
+// --------------------------------------------------------------------------
+
+DatabaseJournal::~DatabaseJournal() {
+  try {
+    sync();
+  }
+  catch (...) {
+  }
+  fclose(m_file);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::replay(const std::function<void(const Record&)>& fn) {
+  sync();
+
+  seek(sizeof(FileHeader));
+
+  Record record;
+  uint64_t record_size;
+  for (uint64_t offset = sizeof(FileHeader); offset < m_size; offset += record_size) {
+    if (!readRecord(record, m_size - offset, record_size)) {
+      seek(m_size);
+      throw std::string("Could not read file: ") + m_filename;
+    }
+
+    fn(record);
+  }
+
+  seek(m_size);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::appendAddEntry(const uint64_t sequence, const BowVector& bow_vector,
+                                     const FlatFeatureVector& feature_vector) {
+  const size_t begin = beginRecord(ADD_ENTRY, sequence);
+  putWords(m_pending, bow_vector);
+  putFeatures(m_pending, feature_vector);
+  endRecord(begin);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::appendAddEntry(const uint64_t sequence, const FlatBowVector& bow_vector,
+                                     const FlatFeatureVector& feature_vector) {
+  const size_t begin = beginRecord(ADD_ENTRY, sequence);
+  putWords(m_pending, bow_vector);
+  putFeatures(m_pending, feature_vector);
+  endRecord(begin);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::appendEraseEntry(const uint64_t sequence, const EntryId entry_id) {
+  const size_t begin = beginRecord(ERASE_ENTRY, sequence);
+  put<uint32_t>(m_pending, entry_id);
+  endRecord(begin);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::appendCompact(const uint64_t sequence, const bool renumber) {
+  const size_t begin = beginRecord(COMPACT, sequence);
+  put<uint32_t>(m_pending, renumber ? 1 : 0);
+  endRecord(begin);
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::sync() {
+  if (m_pending.empty())
+    return;
+
+  if (fwrite(m_pending.data(), 1, m_pending.size(), m_file) != m_pending.size() || !FileSync::flush(m_file)) {
+    // the records are kept pending, and a partial write is removed
+    truncateFile(m_file, m_size);
+    seek(m_size);
+    throw std::string("Could not write file: ") + m_filename;
+  }
+
+  m_size += m_pending.size();
+  m_pending.clear();
+  m_n_pending = 0;
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::clear() {
+  m_pending.clear();
+  m_n_pending = 0;
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DBoW2JNL", 8);
+  header.version = 1;
+  header.byte_order = 0x01020304;
+
+  if (!truncateFile(m_file, 0))
+    throw std::string("Could not write file: ") + m_filename;
+
+  seek(0);
+  if (fwrite(&header, sizeof(header), 1, m_file) != 1 || !FileSync::flush(m_file))
+    throw std::string("Could not write file: ") + m_filename;
+
+  m_size = sizeof(header);
+}
+
+// --------------------------------------------------------------------------
+
+size_t DatabaseJournal::beginRecord(const RecordType type, const uint64_t sequence) {
+  const size_t begin = m_pending.size();
+
+  RecordHeader header;
+  header.type = type;
+  header.size = 0;
+  header.sequence = sequence;
+  put(m_pending, header);
+
+  return begin;
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::endRecord(const size_t begin) {
+  RecordHeader header;
+  memcpy(&header, &m_pending[begin], sizeof(header));
+  header.size = m_pending.size() - begin - sizeof(header);
+  memcpy(&m_pending[begin], &header, sizeof(header));
+
+  put<uint32_t>(m_pending, checksum(&m_pending[begin], m_pending.size() - begin));
+
+  if (++m_n_pending >= m_records_per_sync) {
+    try {
+      sync();
+    }
+    catch (...) {
+      // the change is not applied to the database, so its record is
+      // dropped and its sequence number is given to the next change
+      m_pending.resize(begin);
+      --m_n_pending;
+      throw;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+bool DatabaseJournal::readRecord(Record& record, const uint64_t available, uint64_t& record_size) {
+  RecordHeader header;
+  if (available < sizeof(header) || fread(&header, sizeof(header), 1, m_file) != 1)
+    return false;
+
+  // the size is checked before allocating, since it may be corrupted
+  record_size = sizeof(header) + (uint64_t)header.size + sizeof(uint32_t);
+  if (record_size > available)
+    return false;
+
+  m_buffer.resize(header.size);
+  uint32_t sum;
+  if ((header.size > 0 && fread(m_buffer.data(), header.size, 1, m_file) != 1)
+      || fread(&sum, sizeof(sum), 1, m_file) != 1)
+    return false;
+
+  if (checksum(m_buffer.data(), m_buffer.size(), checksum(&header, sizeof(header))) != sum)
+    return false;
+
+  record.type = static_cast<RecordType>(header.type);
+  record.sequence = header.sequence;
+  record.bow_vector.clear();
+  record.feature_vector.clear();
+
+  const unsigned char* p = m_buffer.data();
+  const unsigned char* payload_end = p + m_buffer.size();
+  uint32_t n, value = 0;
+
+  switch (header.type) {
+    case ADD_ENTRY: {
+      if (!get(p, payload_end, n))
+        return false;
+      for (uint32_t i = 0; i < n; ++i) {
+        uint32_t word_id;
+        double weight;
+        if (!get(p, payload_end, word_id) || !get(p, payload_end, weight))
+          return false;
+        record.bow_vector.insert(record.bow_vector.end(), std::make_pair(word_id, weight));
+      }
+
+      // the nodes are counted first, to fill the feature vector at once
+      if (!get(p, payload_end, n))
+        return false;
+
+      const unsigned char* nodes = p;
+      uint64_t n_features = 0;
+      for (uint32_t i = 0; i < n; ++i) {
+        uint32_t node_id, node_features;
+        if (!get(p, payload_end, node_id) || !get(p, payload_end, node_features)
+            || (size_t)(payload_end - p) < (size_t)node_features * sizeof(uint32_t))
+          return false;
+        p += (size_t)node_features * sizeof(uint32_t);
+        n_features += node_features;
+      }
+
+      record.feature_vector.resize(n, n_features);
+      NodeId* node_ids = record.feature_vector.nodeIds();
+      unsigned int* offsets = record.feature_vector.offsets();
+      unsigned int* features = record.feature_vector.features();
+
+      p = nodes;
+      unsigned int f = 0;
+      for (uint32_t i = 0; i < n; ++i) {
+        uint32_t node_features = 0;
+        get(p, payload_end, value);
+        get(p, payload_end, node_features);
+        node_ids[i] = value;
+        offsets[i] = f;
+        for (uint32_t k = 0; k < node_features; ++k) {
+          get(p, payload_end, value);
+          features[f++] = value;
+        }
+      }
+      if (n > 0)
+        offsets[n] = f;
+      break;
+    }
+
+    case ERASE_ENTRY:
+      if (!get(p, payload_end, value))
+        return false;
+      record.entry_id = value;
+      break;
+
+    case COMPACT:
+      if (!get(p, payload_end, value))
+        return false;
+      record.renumber = value != 0;
+      break;
+
+    default:
+      return false;
+  }
+
+  return p == payload_end;
+}
+
+// --------------------------------------------------------------------------
+
+void DatabaseJournal::seek(const uint64_t offset) {
+#ifdef _WIN32
+  _fseeki64(m_file, (__int64)offset, SEEK_SET);
+#else
+  fseeko(m_file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
@@ -0,0 +1,177 @@
+/**
+ * File: DescriptorFile.cpp
+ * Date: October 2026
+ * Description: compact files of training descriptors
+ * License: see the LICENSE.txt file
+ */
+
+#include <cstring>
+
+#include "DBoW2/DescriptorFile.h"
+
+namespace DBoW2 {
+
+namespace {
+
+//! Header of the file
+struct FileHeader {
+  //! "DBoW2DSC"
+  char magic[8];
+  //! Version of the format
+  uint32_t version;
+  //! 0x01020304 in the byte order of the writer
+  uint32_t byte_order;
+  //! Bytes per descriptor
+  uint32_t descriptor_size;
+  //! Unused (0)
+  uint32_t reserved;
+  //! Number of images and of descriptors
+  uint64_t n_images, n_descriptors;
+};
+
+const char file_magic[8] = {'D', 'B', 'o', 'W', '2', 'D', 'S', 'C'};
+const uint32_t file_version = 1;
+const uint32_t file_byte_order = 0x01020304;
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+DescriptorFileWriter::DescriptorFileWriter(const std::string& filename, const unsigned int descriptor_size)
+    : m_filename(filename), m_file(nullptr), m_descriptor_size(descriptor_size), m_n_images(0),
+      m_n_descriptors(0) {
+  if (descriptor_size == 0)
+    throw std::string("Invalid descriptor size");
+
+  m_file = fopen(filename.c_str(), "wb");
+  if (m_file == nullptr)
+    throw std::string("Could not open file: ") + filename;
+
+  // the counts are written when the file is closed
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+    fclose(m_file);
+    m_file = nullptr;
+    throw std::string("Could not write file: ") + filename;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+DescriptorFileWriter::~DescriptorFileWriter() {
+  if (m_file != nullptr) {
+    try {
+      close();
+    }
+    catch (const std::string&) {
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void DescriptorFileWriter::addImage(const unsigned char* descriptors, const unsigned int n) {
+  if (m_file == nullptr)
+    throw std::string("Descriptor file already closed: ") + m_filename;
+
+  const uint32_t count = n;
+  if (fwrite(&count, sizeof(count), 1, m_file) != 1
+      || (n > 0 && fwrite(descriptors, m_descriptor_size, n, m_file) != n)) {
+    throw std::string("Could not write file: ") + m_filename;
+  }
+
+  ++m_n_images;
+  m_n_descriptors += n;
+}
+
+// --------------------------------------------------------------------------
+
+void DescriptorFileWriter::close() {
+  if (m_file == nullptr)
+    return;
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, file_magic, sizeof(header.magic));
+  header.version = file_version;
+  header.byte_order = file_byte_order;
+  header.descriptor_size = m_descriptor_size;
+  header.n_images = m_n_images;
+  header.n_descriptors = m_n_descriptors;
+
+  // the magic is only written here, so that incomplete files are not valid
+  const bool ok = fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, m_file) == 1;
+  const bool closed = fclose(m_file) == 0;
+  m_file = nullptr;
+
+  if (!ok || !closed)
+    throw std::string("Could not write file: ") + m_filename;
+}
+
+// --------------------------------------------------------------------------
+
+DescriptorFileReader::DescriptorFileReader(const std::string& filename)
+    : m_filename(filename), m_file(nullptr), m_descriptor_size(0), m_n_images(0), m_n_descriptors(0),
+      m_n_read(0) {
+  m_file = fopen(filename.c_str(), "rb");
+  if (m_file == nullptr)
+    throw std::string("Could not open file: ") + filename;
+
+  FileHeader header;
+  if (fread(&header, sizeof(header), 1, m_file) != 1
+      || memcmp(header.magic, file_magic, sizeof(header.magic)) != 0 || header.descriptor_size == 0) {
+    fclose(m_file);
+    throw std::string("Invalid descriptor file: ") + filename;
+  }
+  if (header.version != file_version) {
+    fclose(m_file);
+    throw std::string("Unsupported descriptor file version: ") + filename;
+  }
+  if (header.byte_order != file_byte_order) {
+    fclose(m_file);
+    throw std::string("Descriptor file saved with another byte order: ") + filename;
+  }
+
+  m_descriptor_size = header.descriptor_size;
+  m_n_images = header.n_images;
+  m_n_descriptors = header.n_descriptors;
+}
+
+// --------------------------------------------------------------------------
+
+DescriptorFileReader::~DescriptorFileReader() {
+  fclose(m_file);
+}
+
+// --------------------------------------------------------------------------
+
+void DescriptorFileReader::rewind() {
+  if (fseek(m_file, sizeof(FileHeader), SEEK_SET) != 0)
+    throw std::string("Could not read file: ") + m_filename;
+
+  m_n_read = 0;
+}
+
+// --------------------------------------------------------------------------
+
+bool DescriptorFileReader::nextImage(std::vector<unsigned char>& descriptors) {
+  // the images after the count of the header are ignored
+  if (m_n_read == m_n_images)
+    return false;
+
+  uint32_t n;
+  if (fread(&n, sizeof(n), 1, m_file) != 1)
+    throw std::string("Truncated descriptor file: ") + m_filename;
+
+  descriptors.resize((size_t)n * m_descriptor_size);
+  if (n > 0 && fread(descriptors.data(), m_descriptor_size, n, m_file) != n)
+    throw std::string("Truncated descriptor file: ") + m_filename;
+
+  ++m_n_read;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
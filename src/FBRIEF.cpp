@@ -9,13 +9,20 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 #include "DBoW2/FBRIEF.h"
+#include "DBoW2/Hamming.h"
 
 using namespace std;
 
 namespace DBoW2 {
 
+// The bits of the bitsets are stored in machine words, with no other data,
+// so the bits can be counted on the object bytes
+static_assert(sizeof(FBRIEF::TDescriptor) == FBRIEF::byte_size,
+              "std::bitset has an unexpected size");
+
 // --------------------------------------------------------------------------
 
 void FBRIEF::meanValue(const std::vector<FBRIEF::pDescriptor>& descriptors, FBRIEF::TDescriptor& mean) {
@@ -24,29 +31,64 @@ void FBRIEF::meanValue(const std::vector<FBRIEF::pDescriptor>& descriptors, FBRI
   if (descriptors.empty())
     return;
 
-  const int N2 = descriptors.size() / 2;
+  vector<const unsigned char*> strings(descriptors.size());
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    strings[i] = reinterpret_cast<const unsigned char*>(descriptors[i]);
+  }
+
+  // a bit is set if it is set in more than half of the descriptors
+  const size_t N2 = descriptors.size() / 2;
+  Hamming::majority(strings.data(), strings.size(), sizeof(FBRIEF::TDescriptor), N2 + 1,
+                    reinterpret_cast<unsigned char*>(&mean));
+}
 
-  vector<int> counters(FBRIEF::L, 0);
+// --------------------------------------------------------------------------
 
-  vector<FBRIEF::pDescriptor>::const_iterator it;
-  for (it = descriptors.begin(); it != descriptors.end(); ++it) {
-    const FBRIEF::TDescriptor& desc = **it;
-    for (int i = 0; i < FBRIEF::L; ++i) {
-      if (desc[i])
-        counters[i]++;
+double FBRIEF::distance(const FBRIEF::TDescriptor& a, const FBRIEF::TDescriptor& b) {
+  return Hamming::distance(reinterpret_cast<const unsigned char*>(&a),
+                           reinterpret_cast<const unsigned char*>(&b), sizeof(FBRIEF::TDescriptor));
+}
+
+// --------------------------------------------------------------------------
+
+double FBRIEF::distance(const unsigned char* a, const unsigned char* b) {
+  return Hamming::distance(a, b, FBRIEF::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+void FBRIEF::distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d) {
+  // the kernel compares the query with a chunk of descriptors at once
+  unsigned int buf[64];
+  for (unsigned int i = 0; i < n; i += 64) {
+    const unsigned int m = std::min(n - i, 64u);
+    Hamming::distances(a, b + i * FBRIEF::byte_size, FBRIEF::byte_size, m, buf);
+    for (unsigned int j = 0; j < m; ++j) {
+      d[i + j] = buf[j];
     }
   }
+}
+
+// --------------------------------------------------------------------------
 
-  for (int i = 0; i < FBRIEF::L; ++i) {
-    if (counters[i] > N2)
-      mean.set(i);
+void FBRIEF::toBytes(const FBRIEF::TDescriptor& a, unsigned char* buf) {
+  for (int i = 0; i < FBRIEF::byte_size; ++i, ++buf) {
+    *buf = 0;
+    for (int j = 0; j < 8; ++j) {
+      if (a[i * 8 + j])
+        *buf |= 1 << j;
+    }
   }
 }
 
 // --------------------------------------------------------------------------
 
-double FBRIEF::distance(const FBRIEF::TDescriptor& a, const FBRIEF::TDescriptor& b) {
-  return (double)(a ^ b).count();
+void FBRIEF::fromBytes(FBRIEF::TDescriptor& a, const unsigned char* buf) {
+  for (int i = 0; i < FBRIEF::byte_size; ++i, ++buf) {
+    for (int j = 0; j < 8; ++j) {
+      a[i * 8 + j] = (*buf >> j) & 1;
+    }
+  }
 }
 
 // --------------------------------------------------------------------------
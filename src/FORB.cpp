@@ -6,13 +6,16 @@
  * License: see the LICENSE.txt file
  */
 
+#include <cassert>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <sstream>
-#include <stdint.h>
-#include <limits.h>
+#include <cstring>
+#include <algorithm>
 
 #include "DBoW2/FORB.h"
+#include "DBoW2/Hamming.h"
 
 using namespace std;
 
@@ -30,69 +33,61 @@ void FORB::meanValue(const std::vector<FORB::pDescriptor>& descriptors,
     mean = descriptors[0]->clone();
   }
   else {
-    vector<int> sum(FORB::L * 8, 0);
-
+    vector<const unsigned char*> strings(descriptors.size());
     for (size_t i = 0; i < descriptors.size(); ++i) {
-      const cv::Mat& d = *descriptors[i];
-      const unsigned char* p = d.ptr<unsigned char>();
-
-      for (int j = 0; j < d.cols; ++j, ++p) {
-        if (*p & (1 << 7))
-          ++sum[j * 8];
-        if (*p & (1 << 6))
-          ++sum[j * 8 + 1];
-        if (*p & (1 << 5))
-          ++sum[j * 8 + 2];
-        if (*p & (1 << 4))
-          ++sum[j * 8 + 3];
-        if (*p & (1 << 3))
-          ++sum[j * 8 + 4];
-        if (*p & (1 << 2))
-          ++sum[j * 8 + 5];
-        if (*p & (1 << 1))
-          ++sum[j * 8 + 6];
-        if (*p & (1))
-          ++sum[j * 8 + 7];
-      }
+      strings[i] = descriptors[i]->ptr<unsigned char>();
     }
 
-    mean = cv::Mat::zeros(1, FORB::L, CV_8U);
-    unsigned char* p = mean.ptr<unsigned char>();
-
-    const int N2 = (int)descriptors.size() / 2 + descriptors.size() % 2;
-    for (size_t i = 0; i < sum.size(); ++i) {
-      if (sum[i] >= N2) {
-        // set bit
-        *p |= 1 << (7 - (i % 8));
-      }
+    // the mean may share its data with a descriptor, so it is not reused
+    mean = cv::Mat(1, FORB::L, CV_8U);
 
-      if (i % 8 == 7)
-        ++p;
-    }
+    // a bit is set if it is set in at least half of the descriptors
+    const size_t N2 = descriptors.size() / 2 + descriptors.size() % 2;
+    Hamming::majority(strings.data(), strings.size(), FORB::L, N2, mean.ptr<unsigned char>());
   }
 }
 
 // --------------------------------------------------------------------------
 
 double FORB::distance(const FORB::TDescriptor& a, const FORB::TDescriptor& b) {
-  // Bit count function got from:
-  // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetKernighan
-  // This implementation assumes that a.cols (CV_8U) % sizeof(uint64_t) == 0
-
-  const uint64_t *pa, *pb;
-  pa = a.ptr<uint64_t>(); // a & b are actually CV_8U
-  pb = b.ptr<uint64_t>();
-
-  uint64_t v, ret = 0;
-  for (size_t i = 0; i < a.cols / sizeof(uint64_t); ++i, ++pa, ++pb) {
-    v = *pa ^ *pb;
-    v = v - ((v >> 1) & (uint64_t) ~(uint64_t)0 / 3);
-    v = (v & (uint64_t) ~(uint64_t)0 / 15 * 3) + ((v >> 2) & (uint64_t) ~(uint64_t)0 / 15 * 3);
-    v = (v + (v >> 4)) & (uint64_t) ~(uint64_t)0 / 255 * 15;
-    ret += (uint64_t)(v * ((uint64_t) ~(uint64_t)0 / 255)) >> (sizeof(uint64_t) - 1) * CHAR_BIT;
+  // the length is the one of the matrices, not FORB::L: as before, the
+  // 64-bit words of a.cols (CV_8U) bytes are compared
+  assert(a.type() == CV_8U && b.type() == CV_8U && a.cols == b.cols);
+  return Hamming::distance(a.ptr<unsigned char>(), b.ptr<unsigned char>(),
+                           a.cols / sizeof(uint64_t) * sizeof(uint64_t));
+}
+
+// --------------------------------------------------------------------------
+
+double FORB::distance(const unsigned char* a, const unsigned char* b) {
+  return Hamming::distance(a, b, FORB::L);
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d) {
+  // the kernel compares the query with a chunk of descriptors at once
+  unsigned int buf[64];
+  for (unsigned int i = 0; i < n; i += 64) {
+    const unsigned int m = std::min(n - i, 64u);
+    Hamming::distances(a, b + i * FORB::L, FORB::L, m, buf);
+    for (unsigned int j = 0; j < m; ++j) {
+      d[i + j] = buf[j];
+    }
   }
+}
+
+// --------------------------------------------------------------------------
 
-  return ret;
+void FORB::toBytes(const FORB::TDescriptor& a, unsigned char* buf) {
+  memcpy(buf, a.ptr<unsigned char>(), FORB::L);
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::fromBytes(FORB::TDescriptor& a, const unsigned char* buf) {
+  a.create(1, FORB::L, CV_8U);
+  memcpy(a.ptr<unsigned char>(), buf, FORB::L);
 }
 
 // --------------------------------------------------------------------------
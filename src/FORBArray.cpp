@@ -0,0 +1,195 @@
+/**
+ * File: FORBArray.cpp
+ * Date: October 2026
+ * Description: functions for ORB descriptors stored in fixed-size arrays
+ * License: see the LICENSE.txt file
+ */
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "DBoW2/FORBArray.h"
+#include "DBoW2/Hamming.h"
+
+using namespace std;
+
+namespace DBoW2 {
+
+// The descriptors are copied as raw memory, in arrays with no padding
+static_assert(sizeof(FORBArray::TDescriptor) == FORBArray::byte_size,
+              "std::array has an unexpected size");
+static_assert(std::is_trivially_copyable<FORBArray::TDescriptor>::value,
+              "std::array must be trivially copyable");
+
+// --------------------------------------------------------------------------
+
+void FORBArray::meanValue(const std::vector<FORBArray::pDescriptor>& descriptors,
+                          FORBArray::TDescriptor& mean) {
+  mean.fill(0);
+
+  if (descriptors.empty()) {
+    return;
+  }
+  else if (descriptors.size() == 1) {
+    mean = *descriptors[0];
+    return;
+  }
+
+  // the majority of each bit does not depend on the byte order of the words
+  vector<const unsigned char*> strings(descriptors.size());
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    strings[i] = reinterpret_cast<const unsigned char*>(descriptors[i]->data());
+  }
+
+  const size_t N2 = descriptors.size() / 2 + descriptors.size() % 2;
+  Hamming::majority(strings.data(), strings.size(), FORBArray::byte_size, N2,
+                    reinterpret_cast<unsigned char*>(mean.data()));
+}
+
+// --------------------------------------------------------------------------
+
+double FORBArray::distance(const FORBArray::TDescriptor& a, const FORBArray::TDescriptor& b) {
+  return Hamming::distance(reinterpret_cast<const unsigned char*>(a.data()),
+                           reinterpret_cast<const unsigned char*>(b.data()), FORBArray::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+double FORBArray::distance(const unsigned char* a, const unsigned char* b) {
+  return Hamming::distance(a, b, FORBArray::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::distances(const unsigned char* a, const unsigned char* b, const unsigned int n, double* d) {
+  // the kernel compares the query with a chunk of descriptors at once
+  unsigned int buf[64];
+  for (unsigned int i = 0; i < n; i += 64) {
+    const unsigned int m = std::min(n - i, 64u);
+    Hamming::distances(a, b + i * FORBArray::byte_size, FORBArray::byte_size, m, buf);
+    for (unsigned int j = 0; j < m; ++j) {
+      d[i + j] = buf[j];
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::toBytes(const FORBArray::TDescriptor& a, unsigned char* buf) {
+  memcpy(buf, a.data(), FORBArray::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::fromBytes(FORBArray::TDescriptor& a, const unsigned char* buf) {
+  memcpy(a.data(), buf, FORBArray::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+std::string FORBArray::toString(const FORBArray::TDescriptor& a) {
+  unsigned char bytes[FORBArray::byte_size];
+  toBytes(a, bytes);
+
+  stringstream ss;
+  for (int i = 0; i < FORBArray::L; ++i) {
+    ss << (int)bytes[i] << " ";
+  }
+
+  return ss.str();
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::fromString(FORBArray::TDescriptor& a, const std::string& s) {
+  unsigned char bytes[FORBArray::byte_size] = {};
+
+  stringstream ss(s);
+  for (int i = 0; i < FORBArray::L; ++i) {
+    int n;
+    ss >> n;
+
+    if (!ss.fail())
+      bytes[i] = (unsigned char)n;
+  }
+
+  fromBytes(a, bytes);
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::fromMat8U(const cv::Mat& mat, std::vector<FORBArray::TDescriptor>& descriptors) {
+  if (mat.empty()) {
+    descriptors.clear();
+    return;
+  }
+
+  if (mat.cols != FORBArray::L || mat.type() != CV_8U)
+    throw std::string("ORB descriptors must be rows of 32 bytes (CV_8U)");
+
+  descriptors.resize(mat.rows);
+
+  if (mat.isContinuous()) {
+    memcpy(descriptors.data(), mat.ptr<unsigned char>(), (size_t)mat.rows * FORBArray::byte_size);
+  }
+  else {
+    for (int i = 0; i < mat.rows; ++i) {
+      fromBytes(descriptors[i], mat.ptr<unsigned char>(i));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::toMat8U(const std::vector<FORBArray::TDescriptor>& descriptors, cv::Mat& mat) {
+  mat.create(descriptors.size(), FORBArray::L, CV_8U);
+  if (!descriptors.empty())
+    memcpy(mat.ptr<unsigned char>(), descriptors.data(), descriptors.size() * FORBArray::byte_size);
+}
+
+// --------------------------------------------------------------------------
+
+cv::Mat FORBArray::wrapMat8U(const std::vector<FORBArray::TDescriptor>& descriptors) {
+  if (descriptors.empty())
+    return cv::Mat();
+
+  return cv::Mat(descriptors.size(), FORBArray::L, CV_8U, const_cast<FORBArray::TDescriptor*>(descriptors.data()));
+}
+
+// --------------------------------------------------------------------------
+
+void FORBArray::toMat32F(const std::vector<FORBArray::TDescriptor>& descriptors, cv::Mat& mat) {
+  if (descriptors.empty()) {
+    mat.release();
+    return;
+  }
+
+  const size_t N = descriptors.size();
+
+  mat.create(N, FORBArray::L * 8, CV_32F);
+  float* p = mat.ptr<float>();
+
+  unsigned char desc[FORBArray::byte_size];
+  for (size_t i = 0; i < N; ++i) {
+    toBytes(descriptors[i], desc);
+
+    for (int j = 0; j < FORBArray::L; ++j, p += 8) {
+      p[0] = (desc[j] & (1 << 7) ? 1 : 0);
+      p[1] = (desc[j] & (1 << 6) ? 1 : 0);
+      p[2] = (desc[j] & (1 << 5) ? 1 : 0);
+      p[3] = (desc[j] & (1 << 4) ? 1 : 0);
+      p[4] = (desc[j] & (1 << 3) ? 1 : 0);
+      p[5] = (desc[j] & (1 << 2) ? 1 : 0);
+      p[6] = (desc[j] & (1 << 1) ? 1 : 0);
+      p[7] = desc[j] & (1);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
@@ -0,0 +1,45 @@
+/**
+ * File: FileSync.cpp
+ * Date: October 2026
+ * Description: waits until the data written to files are on disk
+ * License: see the LICENSE.txt file
+ */
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "DBoW2/FileSync.h"
+
+namespace DBoW2 {
+
+// --------------------------------------------------------------------------
+
+bool FileSync::flush(FILE* file) {
+  if (fflush(file) != 0)
+    return false;
+#ifdef _WIN32
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+void FileSync::sync(const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "r+b");
+  if (file == nullptr)
+    throw std::string("Could not open file: ") + filename;
+
+  const bool synced = flush(file);
+  fclose(file);
+  if (!synced)
+    throw std::string("Could not write file: ") + filename;
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
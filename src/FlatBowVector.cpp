@@ -0,0 +1,140 @@
+/**
+ * File: FlatBowVector.cpp
+ * Date: October 2026
+ * Description: bag of words vector stored in a sorted array
+ * License: see the LICENSE.txt file
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "DBoW2/FlatBowVector.h"
+
+namespace DBoW2 {
+
+namespace {
+
+//! Compares words by id
+struct LessId {
+  inline bool operator()(const FlatBowVector::value_type& a, const FlatBowVector::value_type& b) const {
+    return a.first < b.first;
+  }
+
+  inline bool operator()(const FlatBowVector::value_type& a, const WordId id) const {
+    return a.first < id;
+  }
+};
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::FlatBowVector() {}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::FlatBowVector(const BowVector& v)
+    : std::vector<std::pair<WordId, WordValue>>(v.begin(), v.end()) {}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::~FlatBowVector() {}
+
+// --------------------------------------------------------------------------
+
+void FlatBowVector::toBowVector(BowVector& v) const {
+  v.clear();
+  for (const_iterator vit = begin(); vit != end(); ++vit) {
+    v.insert(v.end(), BowVector::value_type(vit->first, vit->second));
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void FlatBowVector::sort() {
+  // stable, so that the values of a word are added in the order they came
+  std::stable_sort(begin(), end(), LessId());
+
+  if (empty())
+    return;
+
+  iterator last = begin();
+  for (iterator vit = begin() + 1; vit != end(); ++vit) {
+    if (vit->first == last->first) {
+      last->second += vit->second;
+    }
+    else {
+      *(++last) = *vit;
+    }
+  }
+
+  erase(last + 1, end());
+}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::const_iterator FlatBowVector::lower_bound(const WordId id) const {
+  return std::lower_bound(begin(), end(), id, LessId());
+}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::iterator FlatBowVector::lower_bound(const WordId id) {
+  return std::lower_bound(begin(), end(), id, LessId());
+}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::const_iterator FlatBowVector::find(const WordId id) const {
+  const_iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id) ? vit : end();
+}
+
+// --------------------------------------------------------------------------
+
+FlatBowVector::iterator FlatBowVector::find(const WordId id) {
+  iterator vit = lower_bound(id);
+  return (vit != end() && vit->first == id) ? vit : end();
+}
+
+// --------------------------------------------------------------------------
+
+void FlatBowVector::normalize(const LNorm norm_type) {
+  double norm = 0.0;
+  iterator it;
+
+  if (norm_type == DBoW2::L1) {
+    for (it = begin(); it != end(); ++it)
+      norm += fabs(it->second);
+  }
+  else {
+    for (it = begin(); it != end(); ++it)
+      norm += it->second * it->second;
+    norm = sqrt(norm);
+  }
+
+  if (norm > 0.0) {
+    for (it = begin(); it != end(); ++it)
+      it->second /= norm;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+std::ostream& operator<<(std::ostream& out, const FlatBowVector& v) {
+  FlatBowVector::const_iterator vit;
+  unsigned int i = 0;
+  const unsigned int N = v.size();
+  for (vit = v.begin(); vit != v.end(); ++vit, ++i) {
+    out << "<" << vit->first << ", " << vit->second << ">";
+
+    if (i < N - 1)
+      out << ", ";
+  }
+  return out;
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
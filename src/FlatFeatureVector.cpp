@@ -0,0 +1,185 @@
+/**
+ * File: FlatFeatureVector.cpp
+ * Date: October 2026
+ * Description: feature vector stored in a single buffer
+ * License: see the LICENSE.txt file
+ */
+
+#include <algorithm>
+#include <iostream>
+
+#include "DBoW2/FlatFeatureVector.h"
+
+namespace DBoW2 {
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector::FlatFeatureVector()
+    : m_n_nodes(0), m_values(nullptr) {}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector::FlatFeatureVector(const FeatureVector& fv)
+    : m_n_nodes(0), m_values(nullptr) {
+  size_t n_features = 0;
+  FeatureVector::const_iterator fit;
+  for (fit = fv.begin(); fit != fv.end(); ++fit) {
+    n_features += fit->second.size();
+  }
+
+  resize(fv.size(), n_features);
+
+  NodeId* node_ids = nodeIds();
+  unsigned int* offsets = this->offsets();
+  unsigned int* features = this->features();
+
+  unsigned int i = 0, n = 0;
+  for (fit = fv.begin(); fit != fv.end(); ++fit, ++i) {
+    node_ids[i] = fit->first;
+    offsets[i] = n;
+    std::copy(fit->second.begin(), fit->second.end(), features + n);
+    n += fit->second.size();
+  }
+  if (!empty())
+    offsets[i] = n;
+}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector::FlatFeatureVector(const FlatFeatureVector& v)
+    : m_n_nodes(v.m_n_nodes), m_data(v.m_values, v.m_values + v.valueCount()) {
+  m_values = m_data.data();
+}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector::FlatFeatureVector(FlatFeatureVector&& v) noexcept
+    : m_n_nodes(v.m_n_nodes), m_values(v.m_values), m_data(std::move(v.m_data)) {
+  v.m_n_nodes = 0;
+  v.m_values = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector& FlatFeatureVector::operator=(const FlatFeatureVector& v) {
+  if (this != &v) {
+    m_data.assign(v.m_values, v.m_values + v.valueCount());
+    m_n_nodes = v.m_n_nodes;
+    m_values = m_data.data();
+  }
+  return *this;
+}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector& FlatFeatureVector::operator=(FlatFeatureVector&& v) noexcept {
+  if (this != &v) {
+    m_n_nodes = v.m_n_nodes;
+    m_values = v.m_values;
+    m_data = std::move(v.m_data);
+    v.m_n_nodes = 0;
+    v.m_values = nullptr;
+    v.m_data.clear();
+  }
+  return *this;
+}
+
+// ---------------------------------------------------------------------------
+
+void FlatFeatureVector::toFeatureVector(FeatureVector& fv) const {
+  fv.clear();
+  for (const_iterator fit = begin(); fit != end(); ++fit) {
+    fv.insert(fv.end(), FeatureVector::value_type(fit->first, std::vector<unsigned int>(fit->second.begin(),
+                                                                                        fit->second.end())));
+  }
+}
+
+// ---------------------------------------------------------------------------
+
+void FlatFeatureVector::assign(const std::vector<std::pair<NodeId, unsigned int>>& entries) {
+  size_t n_nodes = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i == 0 || entries[i].first != entries[i - 1].first)
+      ++n_nodes;
+  }
+
+  resize(n_nodes, entries.size());
+
+  NodeId* node_ids = nodeIds();
+  unsigned int* offsets = this->offsets();
+  unsigned int* features = this->features();
+
+  unsigned int n = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i == 0 || entries[i].first != entries[i - 1].first) {
+      node_ids[n] = entries[i].first;
+      offsets[n++] = i;
+    }
+    features[i] = entries[i].second;
+  }
+  if (!empty())
+    offsets[n] = entries.size();
+}
+
+// ---------------------------------------------------------------------------
+
+void FlatFeatureVector::resize(const size_t n_nodes, const size_t n_features) {
+  m_n_nodes = n_nodes;
+  if (n_nodes == 0)
+    m_data.clear();
+  else
+    m_data.resize(2 * n_nodes + 1 + n_features);
+  m_values = m_data.data();
+}
+
+// ---------------------------------------------------------------------------
+
+void FlatFeatureVector::attach(unsigned int* data, const size_t n_nodes) {
+  std::vector<unsigned int>().swap(m_data);
+  m_n_nodes = n_nodes;
+  m_values = n_nodes == 0 ? nullptr : data;
+}
+
+// ---------------------------------------------------------------------------
+
+void FlatFeatureVector::clear() {
+  m_n_nodes = 0;
+  m_data.clear();
+  m_values = nullptr;
+}
+
+// ---------------------------------------------------------------------------
+
+FlatFeatureVector::const_iterator FlatFeatureVector::find(const NodeId id) const {
+  const NodeId* node_ids = nodeIds();
+  const NodeId* nit = std::lower_bound(node_ids, node_ids + m_n_nodes, id);
+  if (nit == node_ids + m_n_nodes || *nit != id)
+    return end();
+
+  return const_iterator(this, nit - node_ids);
+}
+
+// ---------------------------------------------------------------------------
+
+std::ostream& operator<<(std::ostream& out, const FlatFeatureVector& v) {
+  for (FlatFeatureVector::const_iterator vit = v.begin(); vit != v.end(); ++vit) {
+    const FlatFeatureVector::FeatureRange& f = vit->second;
+
+    if (vit != v.begin())
+      out << ", ";
+
+    out << "<" << vit->first << ": [";
+    for (size_t i = 0; i < f.size(); ++i) {
+      if (i > 0)
+        out << ", ";
+      out << f[i];
+    }
+    out << "]>";
+  }
+
+  return out;
+}
+
+// ---------------------------------------------------------------------------
+
+} // namespace DBoW2
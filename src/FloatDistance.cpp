@@ -0,0 +1,603 @@
+/**
+ * File: FloatDistance.cpp
+ * Date: October 2026
+ * Description: squared Euclidean distance kernels with run-time dispatch
+ * License: see the LICENSE.txt file
+ */
+
+#include <string>
+#include <stdint.h>
+
+#include "DBoW2/FloatDistance.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DBOW2_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Functions with instructions that the compiler is not told to use by
+// default. They are only called after checking the CPU at run time.
+// FMA is left out on purpose: every kernel rounds each product and each sum
+// as the generic one does
+#if defined(__GNUC__) || defined(__clang__)
+#define DBOW2_TARGET(x) __attribute__((target(x)))
+#else
+#define DBOW2_TARGET(x)
+#endif
+
+// AVX-512 intrinsics need a recent compiler
+#if defined(DBOW2_X86_64)                                 \
+    && ((defined(__clang__) && __clang_major__ >= 6)      \
+        || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) \
+        || (defined(_MSC_VER) && _MSC_VER >= 1920))
+#define DBOW2_AVX512_KERNEL
+#endif
+
+namespace DBoW2 {
+
+namespace {
+
+//! Signature of the kernels of distance
+typedef float (*DistanceFunction)(const float*, const float*, size_t);
+
+//! Signature of the kernels of distances
+typedef void (*DistancesFunction)(const float*, const float*, size_t, unsigned int, float*);
+
+//! Signature of the kernels of mean
+typedef void (*MeanFunction)(const float* const*, size_t, size_t, float*);
+
+// The terms of a distance are added up in 16 lanes: term j goes to lane
+// j % 16, and the lanes are added at the end in a fixed order. This is the
+// order of one AVX-512 register or two AVX2 registers, so the generic
+// kernel gives the same result as the vectorized ones
+static constexpr size_t LANES = 16;
+
+// The means are computed in blocks of elements, each one with its own sums
+static constexpr size_t MEAN_BLOCK = 32;
+
+// --------------------------------------------------------------------------
+
+//! Adds the last elements of two vectors to the lanes
+inline void addTail(const float* a, const float* b, size_t i, const size_t n, float* lanes) {
+  for (size_t l = 0; i < n; ++i, ++l) {
+    const float d = a[i] - b[i];
+    lanes[l] += d * d;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+//! Adds up the lanes pairwise
+inline float reduceLanes(float* lanes) {
+  for (size_t s = LANES / 2; s > 0; s /= 2) {
+    for (size_t l = 0; l < s; ++l) {
+      lanes[l] += lanes[l + s];
+    }
+  }
+  return lanes[0];
+}
+
+// --------------------------------------------------------------------------
+
+float distanceGeneric(const float* a, const float* b, size_t n) {
+  float lanes[LANES] = {};
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    for (size_t l = 0; l < LANES; ++l) {
+      const float d = a[i + l] - b[i + l];
+      lanes[l] += d * d;
+    }
+  }
+  addTail(a, b, i, n, lanes);
+  return reduceLanes(lanes);
+}
+
+// --------------------------------------------------------------------------
+
+void distancesGeneric(const float* a, const float* b, size_t n, unsigned int k, float* d) {
+  for (unsigned int i = 0; i < k; ++i, b += n) {
+    d[i] = distanceGeneric(a, b, n);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+//! Computes the mean of the elements [j, j + m) of the vectors
+inline void meanBlock(const float* const* vectors, const size_t k, const size_t j,
+                      const size_t m, float* mean) {
+  double sum[MEAN_BLOCK] = {};
+  for (size_t i = 0; i < k; ++i) {
+    const float* v = vectors[i] + j;
+    for (size_t l = 0; l < m; ++l) {
+      sum[l] += v[l];
+    }
+  }
+  for (size_t l = 0; l < m; ++l) {
+    mean[j + l] = (float)(sum[l] / k);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void meanGeneric(const float* const* vectors, size_t k, size_t n, float* mean) {
+  for (size_t j = 0; j < n; j += MEAN_BLOCK) {
+    meanBlock(vectors, k, j, n - j < MEAN_BLOCK ? n - j : MEAN_BLOCK, mean);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+#ifdef DBOW2_X86_64
+
+// Adds the squares of the differences of 16 elements to two accumulators
+DBOW2_TARGET("avx2")
+inline void accumulateAVX2(const float* a, const float* b, __m256& acc0, __m256& acc1) {
+  const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+  const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + 8), _mm256_loadu_ps(b + 8));
+  acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+  acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+}
+
+// --------------------------------------------------------------------------
+
+// Adds the last r (< 16) elements. The masked lanes are not read, and adding
+// 0 leaves them as they are
+DBOW2_TARGET("avx2")
+inline void accumulateTailAVX2(const float* a, const float* b, const size_t r,
+                               __m256& acc0, __m256& acc1) {
+  const __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i m0 = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)r), idx);
+  const __m256i m1 = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)r - 8), idx);
+  const __m256 d0 = _mm256_sub_ps(_mm256_maskload_ps(a, m0), _mm256_maskload_ps(b, m0));
+  const __m256 d1 = _mm256_sub_ps(_mm256_maskload_ps(a + 8, m1), _mm256_maskload_ps(b + 8, m1));
+  acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+  acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+}
+
+// --------------------------------------------------------------------------
+
+// Adds up the 16 lanes of two registers in the same order as reduceLanes
+DBOW2_TARGET("avx2")
+inline float reduceAVX2(const __m256 acc0, const __m256 acc1) {
+  const __m256 s8 = _mm256_add_ps(acc0, acc1);
+  const __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+  const __m128 s2 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+  return _mm_cvtss_f32(_mm_add_ss(s2, _mm_shuffle_ps(s2, s2, 1)));
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2")
+float distanceAVX2(const float* a, const float* b, size_t n) {
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    accumulateAVX2(a + i, b + i, acc0, acc1);
+  }
+  if (i < n) {
+    accumulateTailAVX2(a + i, b + i, n - i, acc0, acc1);
+  }
+  return reduceAVX2(acc0, acc1);
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2")
+void distancesAVX2(const float* a, const float* b, size_t n, unsigned int k, float* d) {
+  unsigned int i = 0;
+  // 4 vectors at a time, so that their sums overlap
+  for (; i + 4 <= k; i += 4, b += 4 * n) {
+    __m256 acc00 = _mm256_setzero_ps(), acc01 = _mm256_setzero_ps();
+    __m256 acc10 = _mm256_setzero_ps(), acc11 = _mm256_setzero_ps();
+    __m256 acc20 = _mm256_setzero_ps(), acc21 = _mm256_setzero_ps();
+    __m256 acc30 = _mm256_setzero_ps(), acc31 = _mm256_setzero_ps();
+    size_t j = 0;
+    for (; j + LANES <= n; j += LANES) {
+      accumulateAVX2(a + j, b + j, acc00, acc01);
+      accumulateAVX2(a + j, b + n + j, acc10, acc11);
+      accumulateAVX2(a + j, b + 2 * n + j, acc20, acc21);
+      accumulateAVX2(a + j, b + 3 * n + j, acc30, acc31);
+    }
+    if (j < n) {
+      accumulateTailAVX2(a + j, b + j, n - j, acc00, acc01);
+      accumulateTailAVX2(a + j, b + n + j, n - j, acc10, acc11);
+      accumulateTailAVX2(a + j, b + 2 * n + j, n - j, acc20, acc21);
+      accumulateTailAVX2(a + j, b + 3 * n + j, n - j, acc30, acc31);
+    }
+    d[i] = reduceAVX2(acc00, acc01);
+    d[i + 1] = reduceAVX2(acc10, acc11);
+    d[i + 2] = reduceAVX2(acc20, acc21);
+    d[i + 3] = reduceAVX2(acc30, acc31);
+  }
+  for (; i < k; ++i, b += n) {
+    d[i] = distanceAVX2(a, b, n);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2")
+void meanAVX2(const float* const* vectors, size_t k, size_t n, float* mean) {
+  const __m256d div = _mm256_set1_pd((double)k);
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    for (size_t i = 0; i < k; ++i) {
+      const __m256 v0 = _mm256_loadu_ps(vectors[i] + j);
+      const __m256 v1 = _mm256_loadu_ps(vectors[i] + j + 8);
+      s0 = _mm256_add_pd(s0, _mm256_cvtps_pd(_mm256_castps256_ps128(v0)));
+      s1 = _mm256_add_pd(s1, _mm256_cvtps_pd(_mm256_extractf128_ps(v0, 1)));
+      s2 = _mm256_add_pd(s2, _mm256_cvtps_pd(_mm256_castps256_ps128(v1)));
+      s3 = _mm256_add_pd(s3, _mm256_cvtps_pd(_mm256_extractf128_ps(v1, 1)));
+    }
+    _mm_storeu_ps(mean + j, _mm256_cvtpd_ps(_mm256_div_pd(s0, div)));
+    _mm_storeu_ps(mean + j + 4, _mm256_cvtpd_ps(_mm256_div_pd(s1, div)));
+    _mm_storeu_ps(mean + j + 8, _mm256_cvtpd_ps(_mm256_div_pd(s2, div)));
+    _mm_storeu_ps(mean + j + 12, _mm256_cvtpd_ps(_mm256_div_pd(s3, div)));
+  }
+  if (j < n) {
+    meanBlock(vectors, k, j, n - j, mean);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+#ifdef DBOW2_AVX512_KERNEL
+
+// Some versions of GCC give false warnings inside the AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// AVX-512F includes FMA, and the compiler may fuse a product and a sum.
+// The product with explicit rounding is never fused
+DBOW2_TARGET("avx512f,avx2")
+inline __m512 mul512(const __m512 a, const __m512 b) {
+  return _mm512_mul_round_ps(a, b, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+// --------------------------------------------------------------------------
+
+// Adds the squares of the differences of 16 elements to an accumulator
+DBOW2_TARGET("avx512f,avx2")
+inline void accumulateAVX512(const float* a, const float* b, __m512& acc) {
+  const __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a), _mm512_loadu_ps(b));
+  acc = _mm512_add_ps(acc, mul512(d, d));
+}
+
+// --------------------------------------------------------------------------
+
+// Adds the last r (< 16) elements. The masked lanes are not read, and adding
+// 0 leaves them as they are
+DBOW2_TARGET("avx512f,avx2")
+inline void accumulateTailAVX512(const float* a, const float* b, const size_t r, __m512& acc) {
+  const __mmask16 mask = (__mmask16)((1u << r) - 1);
+  const __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a), _mm512_maskz_loadu_ps(mask, b));
+  acc = _mm512_add_ps(acc, mul512(d, d));
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx512f,avx2")
+inline float reduceAVX512(const __m512 acc) {
+  return reduceAVX2(_mm512_castps512_ps256(acc), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1)));
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx512f,avx2")
+float distanceAVX512(const float* a, const float* b, size_t n) {
+  __m512 acc = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    accumulateAVX512(a + i, b + i, acc);
+  }
+  if (i < n) {
+    accumulateTailAVX512(a + i, b + i, n - i, acc);
+  }
+  return reduceAVX512(acc);
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx512f,avx2")
+void distancesAVX512(const float* a, const float* b, size_t n, unsigned int k, float* d) {
+  unsigned int i = 0;
+  // 4 vectors at a time, so that their sums overlap
+  for (; i + 4 <= k; i += 4, b += 4 * n) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    size_t j = 0;
+    for (; j + LANES <= n; j += LANES) {
+      accumulateAVX512(a + j, b + j, acc0);
+      accumulateAVX512(a + j, b + n + j, acc1);
+      accumulateAVX512(a + j, b + 2 * n + j, acc2);
+      accumulateAVX512(a + j, b + 3 * n + j, acc3);
+    }
+    if (j < n) {
+      accumulateTailAVX512(a + j, b + j, n - j, acc0);
+      accumulateTailAVX512(a + j, b + n + j, n - j, acc1);
+      accumulateTailAVX512(a + j, b + 2 * n + j, n - j, acc2);
+      accumulateTailAVX512(a + j, b + 3 * n + j, n - j, acc3);
+    }
+    d[i] = reduceAVX512(acc0);
+    d[i + 1] = reduceAVX512(acc1);
+    d[i + 2] = reduceAVX512(acc2);
+    d[i + 3] = reduceAVX512(acc3);
+  }
+  for (; i < k; ++i, b += n) {
+    d[i] = distanceAVX512(a, b, n);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx512f,avx2")
+void meanAVX512(const float* const* vectors, size_t k, size_t n, float* mean) {
+  const __m512d div = _mm512_set1_pd((double)k);
+  size_t j = 0;
+  for (; j + MEAN_BLOCK <= n; j += MEAN_BLOCK) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    for (size_t i = 0; i < k; ++i) {
+      const float* v = vectors[i] + j;
+      s0 = _mm512_add_pd(s0, _mm512_cvtps_pd(_mm256_loadu_ps(v)));
+      s1 = _mm512_add_pd(s1, _mm512_cvtps_pd(_mm256_loadu_ps(v + 8)));
+      s2 = _mm512_add_pd(s2, _mm512_cvtps_pd(_mm256_loadu_ps(v + 16)));
+      s3 = _mm512_add_pd(s3, _mm512_cvtps_pd(_mm256_loadu_ps(v + 24)));
+    }
+    _mm256_storeu_ps(mean + j, _mm512_cvtpd_ps(_mm512_div_pd(s0, div)));
+    _mm256_storeu_ps(mean + j + 8, _mm512_cvtpd_ps(_mm512_div_pd(s1, div)));
+    _mm256_storeu_ps(mean + j + 16, _mm512_cvtpd_ps(_mm512_div_pd(s2, div)));
+    _mm256_storeu_ps(mean + j + 24, _mm512_cvtpd_ps(_mm512_div_pd(s3, div)));
+  }
+  if (j < n) {
+    meanBlock(vectors, k, j, n - j, mean);
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // DBOW2_AVX512_KERNEL
+
+// --------------------------------------------------------------------------
+
+void cpuid(const unsigned int leaf, const unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; ++i)
+    regs[i] = (unsigned int)r[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+// Returns the state components enabled by the OS (XCR0)
+uint64_t xgetbv0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv"
+                       : "=a"(eax), "=d"(edx)
+                       : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // DBOW2_X86_64
+
+// --------------------------------------------------------------------------
+
+//! Features of the CPU, checked once
+struct CPUFeatures {
+  bool avx2;
+  bool avx512f;
+
+  CPUFeatures()
+      : avx2(false), avx512f(false) {
+#ifdef DBOW2_X86_64
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (!osxsave || max_leaf < 7)
+      return;
+
+    // the OS must save the YMM (and ZMM) registers
+    const uint64_t xcr0 = xgetbv0();
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    avx2 = ymm && (regs[1] & (1u << 5)) != 0;
+    avx512f = avx2 && zmm && (regs[1] & (1u << 16)) != 0;
+#endif
+  }
+};
+
+// --------------------------------------------------------------------------
+
+const CPUFeatures& getCPUFeatures() {
+  static const CPUFeatures features;
+  return features;
+}
+
+// --------------------------------------------------------------------------
+
+DistanceFunction distanceFunction(const FloatDistance::Kernel kernel) {
+  switch (kernel) {
+#ifdef DBOW2_X86_64
+    case FloatDistance::AVX2:
+      return distanceAVX2;
+#ifdef DBOW2_AVX512_KERNEL
+    case FloatDistance::AVX512:
+      return distanceAVX512;
+#endif
+#endif
+    default:
+      return distanceGeneric;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+DistancesFunction distancesFunction(const FloatDistance::Kernel kernel) {
+  switch (kernel) {
+#ifdef DBOW2_X86_64
+    case FloatDistance::AVX2:
+      return distancesAVX2;
+#ifdef DBOW2_AVX512_KERNEL
+    case FloatDistance::AVX512:
+      return distancesAVX512;
+#endif
+#endif
+    default:
+      return distancesGeneric;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+MeanFunction meanFunction(const FloatDistance::Kernel kernel) {
+  switch (kernel) {
+#ifdef DBOW2_X86_64
+    case FloatDistance::AVX2:
+      return meanAVX2;
+#ifdef DBOW2_AVX512_KERNEL
+    case FloatDistance::AVX512:
+      return meanAVX512;
+#endif
+#endif
+    default:
+      return meanGeneric;
+  }
+}
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+// The generic kernel is usable before the CPU is checked
+FloatDistance::Kernel FloatDistance::m_kernel = FloatDistance::GENERIC;
+FloatDistance::DistanceFunction FloatDistance::m_distance = distanceGeneric;
+FloatDistance::DistancesFunction FloatDistance::m_distances = distancesGeneric;
+FloatDistance::MeanFunction FloatDistance::m_mean = meanGeneric;
+
+namespace {
+
+//! Selects the fastest kernel at startup
+struct KernelSelector {
+  KernelSelector() {
+    FloatDistance::setKernel(FloatDistance::detectKernel());
+  }
+};
+
+const KernelSelector kernel_selector;
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+float FloatDistance::distance(const Kernel kernel, const float* a, const float* b, const size_t n) {
+  return distanceFunction(kernel)(a, b, n);
+}
+
+// --------------------------------------------------------------------------
+
+void FloatDistance::distances(const Kernel kernel, const float* a, const float* b, const size_t n,
+                              const unsigned int k, float* d) {
+  distancesFunction(kernel)(a, b, n, k, d);
+}
+
+// --------------------------------------------------------------------------
+
+void FloatDistance::mean(const Kernel kernel, const float* const* vectors, const size_t k,
+                         const size_t n, float* mean) {
+  meanFunction(kernel)(vectors, k, n, mean);
+}
+
+// --------------------------------------------------------------------------
+
+FloatDistance::Kernel FloatDistance::getKernel() {
+  return m_kernel;
+}
+
+// --------------------------------------------------------------------------
+
+void FloatDistance::setKernel(const Kernel kernel) {
+  if (!isSupported(kernel)) {
+    throw std::string("Float distance kernel not supported: ") + getKernelName(kernel);
+  }
+
+  m_kernel = kernel;
+  m_distance = distanceFunction(kernel);
+  m_distances = distancesFunction(kernel);
+  m_mean = meanFunction(kernel);
+}
+
+// --------------------------------------------------------------------------
+
+bool FloatDistance::isSupported(const Kernel kernel) {
+  const CPUFeatures& cpu = getCPUFeatures();
+
+  switch (kernel) {
+    case GENERIC:
+      return true;
+#ifdef DBOW2_X86_64
+    case AVX2:
+      return cpu.avx2;
+#ifdef DBOW2_AVX512_KERNEL
+    case AVX512:
+      return cpu.avx512f;
+#endif
+#endif
+    default:
+      (void)cpu;
+      return false;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+FloatDistance::Kernel FloatDistance::detectKernel() {
+  if (isSupported(AVX512))
+    return AVX512;
+  else if (isSupported(AVX2))
+    return AVX2;
+  else
+    return GENERIC;
+}
+
+// --------------------------------------------------------------------------
+
+const char* FloatDistance::getKernelName(const Kernel kernel) {
+  switch (kernel) {
+    case GENERIC:
+      return "generic";
+    case AVX2:
+      return "avx2";
+    case AVX512:
+      return "avx512f";
+  }
+  return "unknown";
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
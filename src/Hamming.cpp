@@ -0,0 +1,637 @@
+/**
+ * File: Hamming.cpp
+ * Date: October 2026
+ * Description: Hamming distance kernels with run-time dispatch
+ * License: see the LICENSE.txt file
+ */
+
+#include <cstring>
+#include <string>
+#include <stdint.h>
+#include <limits.h>
+
+#include "DBoW2/Hamming.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DBOW2_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Functions with instructions that the compiler is not told to use by
+// default. They are only called after checking the CPU at run time
+#if defined(__GNUC__) || defined(__clang__)
+#define DBOW2_TARGET(x) __attribute__((target(x)))
+#else
+#define DBOW2_TARGET(x)
+#endif
+
+// VPOPCNTDQ intrinsics need a recent compiler
+#if defined(DBOW2_X86_64)                                 \
+    && ((defined(__clang__) && __clang_major__ >= 6)      \
+        || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) \
+        || (defined(_MSC_VER) && _MSC_VER >= 1920))
+#define DBOW2_AVX512_KERNEL
+#endif
+
+namespace DBoW2 {
+
+namespace {
+
+//! Signature of the kernels of distance
+typedef unsigned int (*DistanceFunction)(const unsigned char*, const unsigned char*, size_t);
+
+//! Signature of the kernels of distances
+typedef void (*DistancesFunction)(const unsigned char*, const unsigned char*, size_t,
+                                  unsigned int, unsigned int*);
+
+// --------------------------------------------------------------------------
+
+inline uint64_t load64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// --------------------------------------------------------------------------
+
+// Bit count function got from:
+// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+inline unsigned int popcountGeneric(uint64_t v) {
+  v = v - ((v >> 1) & (uint64_t) ~(uint64_t)0 / 3);
+  v = (v & (uint64_t) ~(uint64_t)0 / 15 * 3) + ((v >> 2) & (uint64_t) ~(uint64_t)0 / 15 * 3);
+  v = (v + (v >> 4)) & (uint64_t) ~(uint64_t)0 / 255 * 15;
+  return (unsigned int)((uint64_t)(v * ((uint64_t) ~(uint64_t)0 / 255)) >> (sizeof(uint64_t) - 1) * CHAR_BIT);
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int distanceGeneric(const unsigned char* a, const unsigned char* b, size_t n) {
+  unsigned int ret = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    ret += popcountGeneric(load64(a + i) ^ load64(b + i));
+  }
+  for (; i < n; ++i) {
+    ret += popcountGeneric(a[i] ^ b[i]);
+  }
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+
+void distancesGeneric(const unsigned char* a, const unsigned char* b, size_t n,
+                      unsigned int k, unsigned int* d) {
+  for (unsigned int i = 0; i < k; ++i, b += n) {
+    d[i] = distanceGeneric(a, b, n);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+// The majority is computed on chunks of 4 words of the strings
+static constexpr size_t MAJORITY_WORDS = 4;
+
+//! Bits of a chunk of words
+typedef uint64_t Chunk[MAJORITY_WORDS];
+
+// --------------------------------------------------------------------------
+
+//! Loads a chunk of up to 32 bytes, padded with zeros
+inline void loadChunk(const unsigned char* p, const size_t bytes, Chunk& c) {
+  if (bytes == sizeof(Chunk)) {
+    memcpy(c, p, sizeof(Chunk));
+  }
+  else {
+    memset(c, 0, sizeof(Chunk));
+    memcpy(c, p, bytes);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+//! Carry-save adder: adds the bits of a, b and c into a sum l and a carry h
+inline void csa(Chunk& h, Chunk& l, const Chunk& a, const Chunk& b, const Chunk& c) {
+  for (size_t w = 0; w < MAJORITY_WORDS; ++w) {
+    const uint64_t u = a[w] ^ b[w];
+    const uint64_t carry = (a[w] & b[w]) | (u & c[w]);
+    l[w] = u ^ c[w];
+    h[w] = carry;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+//! Computes the majority of the bytes [offset, offset + bytes) of the strings
+void majorityChunk(const unsigned char* const* strings, const size_t k, const size_t offset,
+                   const size_t bytes, const size_t threshold, unsigned char* out) {
+  // the count of each bit is kept in binary, one bit per plane: the planes
+  // of 1, 2, 4 and 8 are updated in carry-save form, and the planes of the
+  // multiples of 16 (high) as a ripple counter
+  Chunk ones = {}, twos = {}, fours = {}, eights = {};
+  Chunk high[64 - 4] = {};
+  size_t n_high = 0;
+  while (n_high < 64 - 4 && ((k + 15) / 16) >> n_high)
+    ++n_high;
+
+  for (size_t i = 0; i < k; i += 16) {
+    Chunk d[16];
+    for (size_t j = 0; j < 16; ++j) {
+      if (i + j < k)
+        loadChunk(strings[i + j] + offset, bytes, d[j]);
+      else
+        memset(d[j], 0, sizeof(Chunk));
+    }
+
+    Chunk twos_a, twos_b, fours_a, fours_b, eights_a, eights_b, sixteens;
+    csa(twos_a, ones, ones, d[0], d[1]);
+    csa(twos_b, ones, ones, d[2], d[3]);
+    csa(fours_a, twos, twos, twos_a, twos_b);
+    csa(twos_a, ones, ones, d[4], d[5]);
+    csa(twos_b, ones, ones, d[6], d[7]);
+    csa(fours_b, twos, twos, twos_a, twos_b);
+    csa(eights_a, fours, fours, fours_a, fours_b);
+    csa(twos_a, ones, ones, d[8], d[9]);
+    csa(twos_b, ones, ones, d[10], d[11]);
+    csa(fours_a, twos, twos, twos_a, twos_b);
+    csa(twos_a, ones, ones, d[12], d[13]);
+    csa(twos_b, ones, ones, d[14], d[15]);
+    csa(fours_b, twos, twos, twos_a, twos_b);
+    csa(eights_b, fours, fours, fours_a, fours_b);
+    csa(sixteens, eights, eights, eights_a, eights_b);
+
+    for (size_t w = 0; w < MAJORITY_WORDS; ++w) {
+      uint64_t carry = sixteens[w];
+      for (size_t p = 0; p < n_high && carry; ++p) {
+        const uint64_t t = high[p][w] & carry;
+        high[p][w] ^= carry;
+        carry = t;
+      }
+    }
+  }
+
+  // compares the counts with the threshold from the most significant plane:
+  // gt marks the counts already greater, and eq the ones equal so far
+  Chunk result;
+  for (size_t w = 0; w < MAJORITY_WORDS; ++w) {
+    uint64_t gt = 0, eq = ~(uint64_t)0;
+    for (int p = 63; p >= 0; --p) {
+      uint64_t plane = 0;
+      if (p >= 4 && (size_t)p - 4 < n_high)
+        plane = high[p - 4][w];
+      else if (p == 3)
+        plane = eights[w];
+      else if (p == 2)
+        plane = fours[w];
+      else if (p == 1)
+        plane = twos[w];
+      else if (p == 0)
+        plane = ones[w];
+
+      if ((uint64_t)threshold >> p & 1) {
+        eq &= plane;
+      }
+      else {
+        gt |= eq & plane;
+        eq &= ~plane;
+      }
+    }
+    result[w] = gt | eq;
+  }
+
+  memcpy(out + offset, result, bytes);
+}
+
+// --------------------------------------------------------------------------
+
+#ifdef DBOW2_X86_64
+
+DBOW2_TARGET("popcnt")
+inline unsigned int popcount64(uint64_t v) {
+#ifdef _MSC_VER
+  return (unsigned int)__popcnt64(v);
+#else
+  return (unsigned int)__builtin_popcountll(v);
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("popcnt")
+unsigned int distancePopcnt(const unsigned char* a, const unsigned char* b, size_t n) {
+  unsigned int ret = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    ret += popcount64(load64(a + i) ^ load64(b + i));
+  }
+  for (; i < n; ++i) {
+    ret += popcount64(a[i] ^ b[i]);
+  }
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("popcnt")
+void distancesPopcnt(const unsigned char* a, const unsigned char* b, size_t n,
+                     unsigned int k, unsigned int* d) {
+  if (n == 32) {
+    // the query stays in registers
+    const uint64_t a0 = load64(a), a1 = load64(a + 8), a2 = load64(a + 16), a3 = load64(a + 24);
+    for (unsigned int i = 0; i < k; ++i, b += 32) {
+      d[i] = popcount64(a0 ^ load64(b)) + popcount64(a1 ^ load64(b + 8))
+             + popcount64(a2 ^ load64(b + 16)) + popcount64(a3 ^ load64(b + 24));
+    }
+  }
+  else {
+    for (unsigned int i = 0; i < k; ++i, b += n) {
+      d[i] = distancePopcnt(a, b, n);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+// Counts the bits of each byte with a lookup table of nibbles, and adds
+// them up in 4 64-bit lanes
+DBOW2_TARGET("avx2")
+inline __m256i popcount256(const __m256i v) {
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2")
+inline unsigned int sum256(const __m256i v) {
+  const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  return (unsigned int)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+// --------------------------------------------------------------------------
+
+// Adds up the 4 lanes of each of v0..v3, and stores the 4 sums in d
+DBOW2_TARGET("avx2")
+inline void sum4x256(const __m256i v0, const __m256i v1, const __m256i v2, const __m256i v3,
+                     unsigned int* d) {
+  const __m256i s01 = _mm256_add_epi64(_mm256_unpacklo_epi64(v0, v1), _mm256_unpackhi_epi64(v0, v1));
+  const __m256i s23 = _mm256_add_epi64(_mm256_unpacklo_epi64(v2, v3), _mm256_unpackhi_epi64(v2, v3));
+  const __m256i s = _mm256_add_epi64(_mm256_permute2x128_si256(s01, s23, 0x20),
+                                     _mm256_permute2x128_si256(s01, s23, 0x31));
+  // the sums fit in 32 bits
+  const __m256i packed = _mm256_permutevar8x32_epi32(s, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+  _mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(packed));
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2,popcnt")
+unsigned int distanceAVX2(const unsigned char* a, const unsigned char* b, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+    const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+    acc = _mm256_add_epi64(acc, popcount256(_mm256_xor_si256(va, vb)));
+  }
+  unsigned int ret = sum256(acc);
+  for (; i + 8 <= n; i += 8) {
+    ret += popcount64(load64(a + i) ^ load64(b + i));
+  }
+  for (; i < n; ++i) {
+    ret += popcount64(a[i] ^ b[i]);
+  }
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx2,popcnt")
+void distancesAVX2(const unsigned char* a, const unsigned char* b, size_t n,
+                   unsigned int k, unsigned int* d) {
+  unsigned int i = 0;
+  if (n == 32) {
+    // 4 descriptors at a time against the same query
+    const __m256i q = _mm256_loadu_si256((const __m256i*)a);
+    for (; i + 4 <= k; i += 4, b += 4 * 32) {
+      const __m256i v0 = popcount256(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)(b))));
+      const __m256i v1 = popcount256(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)(b + 32))));
+      const __m256i v2 = popcount256(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)(b + 64))));
+      const __m256i v3 = popcount256(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)(b + 96))));
+      sum4x256(v0, v1, v2, v3, d + i);
+    }
+    for (; i < k; ++i, b += 32) {
+      d[i] = sum256(popcount256(_mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)b))));
+    }
+  }
+  else {
+    for (; i < k; ++i, b += n) {
+      d[i] = distanceAVX2(a, b, n);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+#ifdef DBOW2_AVX512_KERNEL
+
+// Some versions of GCC give false warnings inside the AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+DBOW2_TARGET("avx512f,avx512vpopcntdq,avx2,popcnt")
+unsigned int distanceAVX512(const unsigned char* a, const unsigned char* b, size_t n) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    const __m512i va = _mm512_loadu_si512((const void*)(a + i));
+    const __m512i vb = _mm512_loadu_si512((const void*)(b + i));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_xor_si512(va, vb)));
+  }
+  if (i + 8 <= n) {
+    // the masked lanes are not read
+    const __mmask8 mask = (__mmask8)((1u << ((n - i) / 8)) - 1);
+    const __m512i va = _mm512_maskz_loadu_epi64(mask, (const void*)(a + i));
+    const __m512i vb = _mm512_maskz_loadu_epi64(mask, (const void*)(b + i));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_xor_si512(va, vb)));
+    i += (n - i) / 8 * 8;
+  }
+  unsigned int ret = (unsigned int)_mm512_reduce_add_epi64(acc);
+  for (; i < n; ++i) {
+    ret += popcount64(a[i] ^ b[i]);
+  }
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+
+DBOW2_TARGET("avx512f,avx512vpopcntdq,avx2,popcnt")
+void distancesAVX512(const unsigned char* a, const unsigned char* b, size_t n,
+                     unsigned int k, unsigned int* d) {
+  unsigned int i = 0;
+  if (n == 32) {
+    // 2 descriptors per register, 4 descriptors at a time
+    const __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i*)a));
+    for (; i + 4 <= k; i += 4, b += 4 * 32) {
+      const __m512i v01 = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_loadu_si512((const void*)b)));
+      const __m512i v23 = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_loadu_si512((const void*)(b + 64))));
+      sum4x256(_mm512_castsi512_si256(v01), _mm512_extracti64x4_epi64(v01, 1),
+               _mm512_castsi512_si256(v23), _mm512_extracti64x4_epi64(v23, 1), d + i);
+    }
+    for (; i < k; ++i, b += 32) {
+      d[i] = distanceAVX512(a, b, 32);
+    }
+  }
+  else {
+    for (; i < k; ++i, b += n) {
+      d[i] = distanceAVX512(a, b, n);
+    }
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // DBOW2_AVX512_KERNEL
+
+// --------------------------------------------------------------------------
+
+void cpuid(const unsigned int leaf, const unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; ++i)
+    regs[i] = (unsigned int)r[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+// Returns the state components enabled by the OS (XCR0)
+uint64_t xgetbv0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv"
+                       : "=a"(eax), "=d"(edx)
+                       : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // DBOW2_X86_64
+
+// --------------------------------------------------------------------------
+
+//! Features of the CPU, checked once
+struct CPUFeatures {
+  bool popcnt;
+  bool avx2;
+  bool avx512_vpopcntdq;
+
+  CPUFeatures()
+      : popcnt(false), avx2(false), avx512_vpopcntdq(false) {
+#ifdef DBOW2_X86_64
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    popcnt = (regs[2] & (1u << 23)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (!osxsave || max_leaf < 7)
+      return;
+
+    // the OS must save the YMM (and ZMM) registers
+    const uint64_t xcr0 = xgetbv0();
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    avx2 = popcnt && ymm && (regs[1] & (1u << 5)) != 0;
+    avx512_vpopcntdq = avx2 && zmm && (regs[1] & (1u << 16)) != 0 && (regs[2] & (1u << 14)) != 0;
+#endif
+  }
+};
+
+// --------------------------------------------------------------------------
+
+const CPUFeatures& getCPUFeatures() {
+  static const CPUFeatures features;
+  return features;
+}
+
+// --------------------------------------------------------------------------
+
+DistanceFunction distanceFunction(const Hamming::Kernel kernel) {
+  switch (kernel) {
+#ifdef DBOW2_X86_64
+    case Hamming::POPCNT:
+      return distancePopcnt;
+    case Hamming::AVX2:
+      return distanceAVX2;
+#ifdef DBOW2_AVX512_KERNEL
+    case Hamming::AVX512:
+      return distanceAVX512;
+#endif
+#endif
+    default:
+      return distanceGeneric;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+DistancesFunction distancesFunction(const Hamming::Kernel kernel) {
+  switch (kernel) {
+#ifdef DBOW2_X86_64
+    case Hamming::POPCNT:
+      return distancesPopcnt;
+    case Hamming::AVX2:
+      return distancesAVX2;
+#ifdef DBOW2_AVX512_KERNEL
+    case Hamming::AVX512:
+      return distancesAVX512;
+#endif
+#endif
+    default:
+      return distancesGeneric;
+  }
+}
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+// The generic kernel is usable before the CPU is checked
+Hamming::Kernel Hamming::m_kernel = Hamming::GENERIC;
+Hamming::DistanceFunction Hamming::m_distance = distanceGeneric;
+Hamming::DistancesFunction Hamming::m_distances = distancesGeneric;
+
+namespace {
+
+//! Selects the fastest kernel at startup
+struct KernelSelector {
+  KernelSelector() {
+    Hamming::setKernel(Hamming::detectKernel());
+  }
+};
+
+const KernelSelector kernel_selector;
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+unsigned int Hamming::distance(const Kernel kernel, const unsigned char* a, const unsigned char* b,
+                               const size_t n) {
+  return distanceFunction(kernel)(a, b, n);
+}
+
+// --------------------------------------------------------------------------
+
+void Hamming::distances(const Kernel kernel, const unsigned char* a, const unsigned char* b,
+                        const size_t n, const unsigned int k, unsigned int* d) {
+  distancesFunction(kernel)(a, b, n, k, d);
+}
+
+// --------------------------------------------------------------------------
+
+void Hamming::majority(const unsigned char* const* strings, const size_t k, const size_t n,
+                       const size_t threshold, unsigned char* out) {
+  for (size_t offset = 0; offset < n; offset += sizeof(Chunk)) {
+    const size_t bytes = n - offset < sizeof(Chunk) ? n - offset : sizeof(Chunk);
+    majorityChunk(strings, k, offset, bytes, threshold, out);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+Hamming::Kernel Hamming::getKernel() {
+  return m_kernel;
+}
+
+// --------------------------------------------------------------------------
+
+void Hamming::setKernel(const Kernel kernel) {
+  if (!isSupported(kernel)) {
+    throw std::string("Hamming kernel not supported: ") + getKernelName(kernel);
+  }
+
+  m_kernel = kernel;
+  m_distance = distanceFunction(kernel);
+  m_distances = distancesFunction(kernel);
+}
+
+// --------------------------------------------------------------------------
+
+bool Hamming::isSupported(const Kernel kernel) {
+  const CPUFeatures& cpu = getCPUFeatures();
+
+  switch (kernel) {
+    case GENERIC:
+      return true;
+#ifdef DBOW2_X86_64
+    case POPCNT:
+      return cpu.popcnt;
+    case AVX2:
+      return cpu.avx2;
+#ifdef DBOW2_AVX512_KERNEL
+    case AVX512:
+      return cpu.avx512_vpopcntdq;
+#endif
+#endif
+    default:
+      (void)cpu;
+      return false;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+Hamming::Kernel Hamming::detectKernel() {
+  if (isSupported(AVX512))
+    return AVX512;
+  else if (isSupported(AVX2))
+    return AVX2;
+  else if (isSupported(POPCNT))
+    return POPCNT;
+  else
+    return GENERIC;
+}
+
+// --------------------------------------------------------------------------
+
+const char* Hamming::getKernelName(const Kernel kernel) {
+  switch (kernel) {
+    case GENERIC:
+      return "generic";
+    case POPCNT:
+      return "popcnt";
+    case AVX2:
+      return "avx2";
+    case AVX512:
+      return "avx512-vpopcntdq";
+  }
+  return "unknown";
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
@@ -0,0 +1,96 @@
+/**
+ * File: MappedFile.cpp
+ * Date: October 2026
+ * Description: file mapped in memory
+ * License: see the LICENSE.txt file
+ */
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "DBoW2/MappedFile.h"
+
+namespace DBoW2 {
+
+// --------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+    : m_data(nullptr), m_size(0), m_mapping(nullptr) {
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::string("Could not open file: ") + filename;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    throw std::string("Could not map file: ") + filename;
+  }
+  m_size = (size_t)size.QuadPart;
+
+  // the mapping keeps the file open
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (m_mapping == nullptr)
+    throw std::string("Could not map file: ") + filename;
+
+  m_data = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0);
+  if (m_data == nullptr) {
+    CloseHandle(m_mapping);
+    throw std::string("Could not map file: ") + filename;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mapping);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+    : m_data(nullptr), m_size(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::string("Could not open file: ") + filename;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::string("Could not map file: ") + filename;
+  }
+  m_size = (size_t)st.st_size;
+
+  // the mapping keeps the file open
+  void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::string("Could not map file: ") + filename;
+
+  m_data = (unsigned char*)data;
+}
+
+// --------------------------------------------------------------------------
+
+MappedFile::~MappedFile() {
+  munmap(m_data, m_size);
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
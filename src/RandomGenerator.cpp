@@ -0,0 +1,69 @@
+/**
+ * File: RandomGenerator.cpp
+ * Date: October 2026
+ * Description: seedable generator of random numbers (xoshiro256**)
+ * License: see the LICENSE.txt file
+ */
+
+#include "DBoW2/RandomGenerator.h"
+
+namespace DBoW2 {
+
+namespace {
+
+/**
+ * Returns the next number of a splitmix64 sequence, which spreads the bits
+ * of close seeds over the whole state
+ * @param x (in/out) state of the sequence
+ * @return number
+ */
+uint64_t splitmix64(uint64_t& x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+RandomGenerator::RandomGenerator(const uint64_t seed) {
+  this->seed(seed);
+}
+
+// --------------------------------------------------------------------------
+
+void RandomGenerator::seed(const uint64_t seed) {
+  // the state is filled with splitmix64, as recommended for xoshiro
+  uint64_t x = seed;
+  for (int i = 0; i < 4; ++i) {
+    m_state[i] = splitmix64(x);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+RandomGenerator RandomGenerator::split() {
+  return RandomGenerator((*this)());
+}
+
+// --------------------------------------------------------------------------
+
+void RandomGenerator::getState(uint64_t state[4]) const {
+  for (int i = 0; i < 4; ++i) {
+    state[i] = m_state[i];
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void RandomGenerator::setState(const uint64_t state[4]) {
+  for (int i = 0; i < 4; ++i) {
+    m_state[i] = state[i];
+  }
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
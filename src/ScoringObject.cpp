@@ -6,10 +6,12 @@
  * License: see the LICENSE.txt file
  */
 
+#include <algorithm>
 #include <cfloat>
 
 #include "DBoW2/TemplatedVocabulary.h"
 #include "DBoW2/BowVector.h"
+#include "DBoW2/FlatBowVector.h"
 
 using namespace DBoW2;
 
@@ -17,12 +19,56 @@ using namespace DBoW2;
 // epsilon value (this is needed by the KL method)
 const double GeneralScoring::LOG_EPS = std::log(DBL_EPSILON);
 
+namespace {
+
+/**
+ * Returns the first word of a bow vector whose id is not lower than the given
+ * one, which must be greater than the id of the current word
+ * @param v bow vector
+ * @param it current word
+ * @param id word id
+ * @return iterator to the word, or v.end()
+ */
+inline BowVector::const_iterator lowerBound(const BowVector& v, BowVector::const_iterator, const WordId id) {
+  return v.lower_bound(id);
+}
+
+/**
+ * Returns the first word of a flat bow vector whose id is not lower than the
+ * given one, which must be greater than the id of the current word. The
+ * search gallops from the current word, so that the merge of two vectors
+ * costs what the shorter one allows
+ * @param v bow vector
+ * @param it current word
+ * @param id word id
+ * @return iterator to the word, or v.end()
+ */
+inline FlatBowVector::const_iterator lowerBound(const FlatBowVector& v, FlatBowVector::const_iterator it,
+                                               const WordId id) {
+  const FlatBowVector::const_iterator end = v.end();
+
+  // it stays lower than id while the step doubles
+  size_t step = 1;
+  while ((size_t)(end - it) > step && (it + step)->first < id) {
+    it += step;
+    step *= 2;
+  }
+
+  const FlatBowVector::const_iterator last = (size_t)(end - it) > step ? it + step + 1 : end;
+  return std::lower_bound(it, last, id,
+                          [](const FlatBowVector::value_type& w, const WordId wid) { return w.first < wid; });
+}
+
 // ---------------------------------------------------------------------------
 
-double L1Scoring::score(const BowVector& v1, const BowVector& v2) const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+// The scores are defined for both types of bow vector, which are merged in
+// the same way
+
+template<class TBowVector>
+double l1Score(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -41,12 +87,12 @@ double L1Scoring::score(const BowVector& v1, const BowVector& v2) const {
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = lowerBound(v1, v1_it, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -62,10 +108,11 @@ double L1Scoring::score(const BowVector& v1, const BowVector& v2) const {
 
 // ---------------------------------------------------------------------------
 
-double L2Scoring::score(const BowVector& v1, const BowVector& v2) const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+template<class TBowVector>
+double l2Score(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -84,12 +131,12 @@ double L2Scoring::score(const BowVector& v1, const BowVector& v2) const {
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = lowerBound(v1, v1_it, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -105,14 +152,13 @@ double L2Scoring::score(const BowVector& v1, const BowVector& v2) const {
   return score;
 }
 
-// ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
 
-double ChiSquareScoring::score(const BowVector& v1, const BowVector& v2)
-    const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+template<class TBowVector>
+double chiSquareScore(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -137,11 +183,11 @@ double ChiSquareScoring::score(const BowVector& v1, const BowVector& v2)
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = lowerBound(v1, v1_it, v2_it->first);
     }
     else {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
     }
   }
 
@@ -153,10 +199,11 @@ double ChiSquareScoring::score(const BowVector& v1, const BowVector& v2)
 
 // ---------------------------------------------------------------------------
 
-double KLScoring::score(const BowVector& v1, const BowVector& v2) const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+template<class TBowVector>
+double klScore(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -178,12 +225,12 @@ double KLScoring::score(const BowVector& v1, const BowVector& v2) const {
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      score += vi * (std::log(vi) - LOG_EPS);
+      score += vi * (std::log(vi) - GeneralScoring::LOG_EPS);
       ++v1_it;
     }
     else {
       // move v2_it forward, do not add any score
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -191,18 +238,18 @@ double KLScoring::score(const BowVector& v1, const BowVector& v2) const {
   // sum rest of items of v
   for (; v1_it != v1_end; ++v1_it)
     if (v1_it->second != 0)
-      score += v1_it->second * (std::log(v1_it->second) - LOG_EPS);
+      score += v1_it->second * (std::log(v1_it->second) - GeneralScoring::LOG_EPS);
 
   return score;
 }
 
 // ---------------------------------------------------------------------------
 
-double BhattacharyyaScoring::score(const BowVector& v1,
-                                   const BowVector& v2) const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+template<class TBowVector>
+double bhattacharyyaScore(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -221,12 +268,12 @@ double BhattacharyyaScoring::score(const BowVector& v1,
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = lowerBound(v1, v1_it, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -236,11 +283,11 @@ double BhattacharyyaScoring::score(const BowVector& v1,
 
 // ---------------------------------------------------------------------------
 
-double DotProductScoring::score(const BowVector& v1,
-                                const BowVector& v2) const {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
+template<class TBowVector>
+double dotProductScore(const TBowVector& v1, const TBowVector& v2) {
+  typename TBowVector::const_iterator v1_it, v2_it;
+  const typename TBowVector::const_iterator v1_end = v1.end();
+  const typename TBowVector::const_iterator v2_end = v2.end();
 
   v1_it = v1.begin();
   v2_it = v2.begin();
@@ -259,12 +306,12 @@ double DotProductScoring::score(const BowVector& v1,
     }
     else if (v1_it->first < v2_it->first) {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = lowerBound(v1, v1_it, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = lowerBound(v2, v2_it, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -272,4 +319,78 @@ double DotProductScoring::score(const BowVector& v1,
   return score;
 }
 
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+double L1Scoring::score(const BowVector& v1, const BowVector& v2) const {
+  return l1Score(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double L1Scoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return l1Score(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double L2Scoring::score(const BowVector& v1, const BowVector& v2) const {
+  return l2Score(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double L2Scoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return l2Score(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double ChiSquareScoring::score(const BowVector& v1, const BowVector& v2) const {
+  return chiSquareScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double ChiSquareScoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return chiSquareScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double KLScoring::score(const BowVector& v1, const BowVector& v2) const {
+  return klScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double KLScoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return klScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double BhattacharyyaScoring::score(const BowVector& v1, const BowVector& v2) const {
+  return bhattacharyyaScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double BhattacharyyaScoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return bhattacharyyaScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double DotProductScoring::score(const BowVector& v1, const BowVector& v2) const {
+  return dotProductScore(v1, v2);
+}
+
+// ---------------------------------------------------------------------------
+
+double DotProductScoring::score(const FlatBowVector& v1, const FlatBowVector& v2) const {
+  return dotProductScore(v1, v2);
+}
+
 // ---------------------------------------------------------------------------
@@ -0,0 +1,285 @@
+/**
+ * File: ThreadPool.cpp
+ * Date: October 2026
+ * Description: pool of threads to run parallel loops and tasks
+ * License: see the LICENSE.txt file
+ */
+
+#include <algorithm>
+
+#include "DBoW2/ThreadPool.h"
+
+namespace DBoW2 {
+
+namespace {
+
+//! Pool of the calling thread, if it is a worker
+thread_local const ThreadPool* t_pool = nullptr;
+
+//! Queue of the calling thread in t_pool
+thread_local unsigned int t_queue = 0;
+
+//! State of a parallel loop shared by the threads that work on it
+struct LoopState {
+  //! Body of the loop
+  const ThreadPool::RangeFunction* fn;
+  //! Range and chunk size
+  size_t begin, end, grain;
+  //! Number of chunks
+  size_t n_chunks;
+  //! Next chunk to run
+  std::atomic<size_t> next;
+  //! Number of chunks finished
+  size_t n_done;
+  //! First exception thrown by fn
+  std::exception_ptr error;
+  //! Protects n_done and error
+  std::mutex mutex;
+  //! Signals the end of the loop
+  std::condition_variable cond;
+
+  /**
+   * Runs chunks until there are no more left
+   */
+  void run() {
+    for (size_t c = next++; c < n_chunks; c = next++) {
+      const size_t b = begin + c * grain;
+      const size_t e = std::min(end, b + grain);
+
+      std::exception_ptr chunk_error;
+      try {
+        (*fn)(b, e);
+      }
+      catch (...) {
+        chunk_error = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (chunk_error && !error)
+        error = chunk_error;
+      if (++n_done == n_chunks)
+        cond.notify_all();
+    }
+  }
+};
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(const unsigned int n_threads)
+    : m_n_queued(0), m_stop(false) {
+  unsigned int n = n_threads;
+  if (n == 0)
+    n = std::max(1u, std::thread::hardware_concurrency());
+
+  // the last queue is shared by the threads that do not belong to the pool
+  for (unsigned int i = 0; i < n; ++i) {
+    m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+  }
+
+  m_workers.reserve(n - 1);
+  for (unsigned int i = 0; i + 1 < n; ++i) {
+    m_workers.push_back(std::thread(&ThreadPool::work, this, i));
+  }
+}
+
+// --------------------------------------------------------------------------
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    m_workers[i].join();
+  }
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int ThreadPool::getQueueIndex() const {
+  return t_pool == this ? t_queue : m_queues.size() - 1;
+}
+
+// --------------------------------------------------------------------------
+
+void ThreadPool::notify() {
+  // taking the mutex ensures that no waiting thread misses the change
+  { std::lock_guard<std::mutex> lock(m_mutex); }
+  m_cond.notify_all();
+}
+
+// --------------------------------------------------------------------------
+
+void ThreadPool::push(Task task) {
+  Queue& queue = *m_queues[getQueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  ++m_n_queued;
+
+  notify();
+}
+
+// --------------------------------------------------------------------------
+
+bool ThreadPool::runQueuedTask() {
+  if (m_n_queued == 0)
+    return false;
+
+  const unsigned int n = m_queues.size();
+  const unsigned int own = getQueueIndex();
+
+  Task task;
+
+  // newest task of this thread, which is likely to be in cache
+  {
+    Queue& queue = *m_queues[own];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      --m_n_queued;
+    }
+  }
+
+  // or oldest task of another one, which is likely to be the largest
+  for (unsigned int i = 1; !task && i < n; ++i) {
+    Queue& queue = *m_queues[(own + i) % n];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      --m_n_queued;
+    }
+  }
+
+  if (!task)
+    return false;
+
+  task();
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+void ThreadPool::work(const unsigned int index) {
+  t_pool = this;
+  t_queue = index;
+
+  while (true) {
+    if (runQueuedTask())
+      continue;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return m_stop || m_n_queued > 0; });
+
+    if (m_stop && m_n_queued == 0)
+      return;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void ThreadPool::parallelFor(const size_t begin, const size_t end, const size_t grain, const RangeFunction& fn) {
+  if (end <= begin)
+    return;
+
+  const size_t n_chunks = (end - begin + grain - 1) / grain;
+
+  if (m_workers.empty() || n_chunks == 1) {
+    for (size_t b = begin; b < end; b += grain) {
+      fn(b, std::min(end, b + grain));
+    }
+    return;
+  }
+
+  std::shared_ptr<LoopState> state = std::make_shared<LoopState>();
+  state->fn = &fn;
+  state->begin = begin;
+  state->end = end;
+  state->grain = grain;
+  state->n_chunks = n_chunks;
+  state->next = 0;
+  state->n_done = 0;
+
+  // the helpers that start when the loop is over just return
+  const size_t n_helpers = std::min(m_workers.size(), n_chunks - 1);
+  for (size_t i = 0; i < n_helpers; ++i) {
+    push([state] { state->run(); });
+  }
+
+  // this thread works too, so nested loops always progress. It waits only
+  // for the chunks that other threads are running
+  state->run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cond.wait(lock, [&state] { return state->n_done == state->n_chunks; });
+
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+// --------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+    : m_pool(pool), m_n_pending(0) {}
+
+// --------------------------------------------------------------------------
+
+TaskGroup::~TaskGroup() {
+  try {
+    wait();
+  }
+  catch (...) {
+  }
+}
+
+// --------------------------------------------------------------------------
+
+void TaskGroup::run(ThreadPool::Task task) {
+  ++m_n_pending;
+
+  m_pool.push([this, task] {
+    try {
+      task();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_error)
+        m_error = std::current_exception();
+    }
+
+    // the group may be destroyed as soon as m_n_pending reaches 0
+    ThreadPool& pool = m_pool;
+    if (--m_n_pending == 0)
+      pool.notify();
+  });
+}
+
+// --------------------------------------------------------------------------
+
+void TaskGroup::wait() {
+  while (m_n_pending > 0) {
+    if (m_pool.runQueuedTask())
+      continue;
+
+    std::unique_lock<std::mutex> lock(m_pool.m_mutex);
+    m_pool.m_cond.wait(lock, [this] { return m_n_pending == 0 || m_pool.m_n_queued > 0; });
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_error) {
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+} // namespace DBoW2
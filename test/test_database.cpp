@@ -0,0 +1,127 @@
+/**
+ * File: test_database.cpp
+ * Date: October 2026
+ * Description: checks that the entries of a database still find themselves
+ *   after being compacted
+ * License: see the LICENSE.txt file
+ */
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "DBoW2/DBoW2.h"
+
+using namespace DBoW2;
+
+namespace {
+
+/**
+ * Returns random ORB descriptors
+ * @param n number of descriptors
+ * @param rng
+ * @return descriptors
+ */
+std::vector<FORBArray::TDescriptor> randomFeatures(const unsigned int n, std::mt19937_64& rng) {
+  std::vector<FORBArray::TDescriptor> features(n);
+  for (size_t i = 0; i < features.size(); ++i) {
+    for (size_t j = 0; j < features[i].size(); ++j) {
+      features[i][j] = rng();
+    }
+  }
+  return features;
+}
+
+/**
+ * Checks that some entries get the best score against their own vector and
+ * come first
+ * @param db
+ * @param ids entry ids
+ * @param vecs bow vector of each entry
+ * @param best_score score of identical vectors
+ * @return number of entries that fail
+ */
+unsigned int checkSelfScores(const OrbArrayDatabase& db, const std::vector<EntryId>& ids,
+                             const std::vector<BowVector>& vecs, const double best_score) {
+  unsigned int n_errors = 0;
+
+  QueryResults ret;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    db.query(vecs[i], ret, 1);
+    if (ret.empty() || ret[0].Id != ids[i] || std::fabs(ret[0].Score - best_score) > 1e-6)
+      ++n_errors;
+  }
+
+  return n_errors;
+}
+
+} // namespace
+
+int main() {
+  const ScoringType scorings[] = {L1_NORM, L2_NORM, CHI_SQUARE, KL, BHATTACHARYYA};
+  const char* scoring_names[] = {"L1", "L2", "chi-square", "KL", "Bhattacharyya"};
+  // KL is a divergence
+  const double best_scores[] = {1, 1, 1, 0, 1};
+  const unsigned int n_entries = 10050;
+  const unsigned int n_added = 500;
+
+  std::mt19937_64 rng(1);
+
+  // the vocabulary is large enough to leave some rows of the inverted index
+  // without erased entries
+  std::vector<std::vector<FORBArray::TDescriptor>> training_features(300);
+  for (size_t i = 0; i < training_features.size(); ++i) {
+    training_features[i] = randomFeatures(50, rng);
+  }
+
+  OrbArrayVocabulary voc(10, 4);
+  voc.create(training_features, 1);
+
+  unsigned int n_errors = 0;
+
+  for (size_t s = 0; s < sizeof(scorings) / sizeof(scorings[0]); ++s) {
+    voc.setScoringType(scorings[s]);
+
+    std::vector<BowVector> vecs(n_entries + n_added);
+    for (size_t i = 0; i < vecs.size(); ++i) {
+      voc.transform(randomFeatures(10, rng), vecs[i]);
+    }
+
+    OrbArrayDatabase db(voc, false);
+    for (unsigned int i = 0; i < n_entries; ++i) {
+      db.add(vecs[i]);
+    }
+
+    // erase every 7th entry and renumber the others
+    for (EntryId id = 0; id < n_entries; id += 7) {
+      db.erase(id);
+    }
+    const std::vector<EntryId> new_ids = db.compact(true);
+
+    std::vector<EntryId> ids;
+    std::vector<BowVector> kept_vecs;
+    for (EntryId id = 0; id < n_entries; ++id) {
+      if (new_ids[id] != ERASED_ENTRY) {
+        ids.push_back(new_ids[id]);
+        kept_vecs.push_back(vecs[id]);
+      }
+    }
+
+    const unsigned int compact_errors = checkSelfScores(db, ids, kept_vecs, best_scores[s]);
+
+    // the entries added afterwards get the next ids
+    for (unsigned int i = n_entries; i < n_entries + n_added; ++i) {
+      ids.push_back(db.add(vecs[i]));
+      kept_vecs.push_back(vecs[i]);
+    }
+
+    const unsigned int add_errors = checkSelfScores(db, ids, kept_vecs, best_scores[s]);
+
+    std::cout << scoring_names[s] << ": " << compact_errors << " errors after compact, " << add_errors
+              << " errors after add" << std::endl;
+    n_errors += compact_errors + add_errors;
+  }
+
+  return n_errors == 0 ? 0 : 1;
+}
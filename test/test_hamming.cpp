@@ -0,0 +1,293 @@
+/**
+ * File: test_hamming.cpp
+ * Date: October 2026
+ * Description: checks the Hamming kernels against the previous byte-wise
+ *   distances of FORB and FBRIEF, and the majority against their previous
+ *   means
+ * License: see the LICENSE.txt file
+ */
+
+#include <bitset>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "DBoW2/FBRIEF.h"
+#include "DBoW2/FORB.h"
+#include "DBoW2/FORBArray.h"
+#include "DBoW2/Hamming.h"
+
+using namespace DBoW2;
+
+namespace {
+
+/**
+ * Previous FORB distance, which counts the bits of 64-bit words
+ * @param a n bytes
+ * @param b n bytes
+ * @param n length of the strings in bytes (multiple of 8)
+ * @return number of different bits
+ */
+unsigned int referenceWords(const unsigned char* a, const unsigned char* b, const size_t n) {
+  uint64_t ret = 0;
+  for (size_t i = 0; i < n; i += sizeof(uint64_t)) {
+    uint64_t pa, pb;
+    memcpy(&pa, a + i, sizeof(pa));
+    memcpy(&pb, b + i, sizeof(pb));
+
+    uint64_t v = pa ^ pb;
+    v = v - ((v >> 1) & (uint64_t) ~(uint64_t)0 / 3);
+    v = (v & (uint64_t) ~(uint64_t)0 / 15 * 3) + ((v >> 2) & (uint64_t) ~(uint64_t)0 / 15 * 3);
+    v = (v + (v >> 4)) & (uint64_t) ~(uint64_t)0 / 255 * 15;
+    ret += (uint64_t)(v * ((uint64_t) ~(uint64_t)0 / 255)) >> (sizeof(uint64_t) - 1) * CHAR_BIT;
+  }
+  return ret;
+}
+
+/**
+ * Counts the different bits one byte at a time
+ * @param a n bytes
+ * @param b n bytes
+ * @param n length of the strings in bytes
+ * @return number of different bits
+ */
+unsigned int referenceBytes(const unsigned char* a, const unsigned char* b, const size_t n) {
+  unsigned int ret = 0;
+  for (size_t i = 0; i < n; ++i) {
+    ret += std::bitset<8>(a[i] ^ b[i]).count();
+  }
+  return ret;
+}
+
+/**
+ * Previous FBRIEF distance, on the raw representation of two descriptors
+ * @param a FBRIEF::byte_size bytes
+ * @param b FBRIEF::byte_size bytes
+ * @return number of different bits
+ */
+unsigned int referenceBrief(const unsigned char* a, const unsigned char* b) {
+  FBRIEF::TDescriptor da, db;
+  FBRIEF::fromBytes(da, a);
+  FBRIEF::fromBytes(db, b);
+  return (da ^ db).count();
+}
+
+/**
+ * Previous FORB mean: a bit is set if it is set in at least half of the
+ * descriptors, rounded up
+ * @param strings k strings of FORB::L bytes
+ * @param out (out) FORB::L bytes
+ */
+void referenceOrbMean(const std::vector<std::vector<unsigned char>>& strings, unsigned char* out) {
+  std::vector<int> sum(FORB::L * 8, 0);
+  for (size_t i = 0; i < strings.size(); ++i) {
+    for (size_t b = 0; b < sum.size(); ++b) {
+      if (strings[i][b / 8] & (1 << (7 - b % 8)))
+        ++sum[b];
+    }
+  }
+
+  const int N2 = (int)strings.size() / 2 + strings.size() % 2;
+  memset(out, 0, FORB::L);
+  for (size_t b = 0; b < sum.size(); ++b) {
+    if (sum[b] >= N2)
+      out[b / 8] |= 1 << (7 - b % 8);
+  }
+}
+
+/**
+ * Previous FBRIEF mean: a bit is set if it is set in more than half of the
+ * descriptors
+ * @param descriptors
+ * @return mean
+ */
+FBRIEF::TDescriptor referenceBriefMean(const std::vector<FBRIEF::TDescriptor>& descriptors) {
+  std::vector<int> counters(FBRIEF::L, 0);
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    for (int b = 0; b < FBRIEF::L; ++b) {
+      if (descriptors[i][b])
+        ++counters[b];
+    }
+  }
+
+  const int N2 = descriptors.size() / 2;
+  FBRIEF::TDescriptor mean;
+  for (int b = 0; b < FBRIEF::L; ++b) {
+    if (counters[b] > N2)
+      mean.set(b);
+  }
+  return mean;
+}
+
+/**
+ * Checks the means of FORB, FORBArray and FBRIEF, computed with the
+ * majority, against the previous ones
+ * @param rng
+ * @param n_checks (in/out) number of checks
+ * @return number of mismatches
+ */
+size_t checkMeans(std::mt19937_64& rng, size_t& n_checks) {
+  size_t n_errors = 0;
+
+  // one and two descriptors, odd and even numbers, and more than the 16
+  // strings of a counter and the 64 of a high plane
+  const size_t sizes[] = {1, 2, 3, 4, 5, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 129, 200};
+
+  for (const size_t k : sizes) {
+    for (int t = 0; t < 20; ++t) {
+      std::vector<std::vector<unsigned char>> strings(k, std::vector<unsigned char>(FORB::L));
+      for (size_t i = 0; i < k; ++i) {
+        for (size_t j = 0; j < strings[i].size(); ++j) {
+          // the first trial has every bit set in exactly half of an even
+          // number of strings
+          if (t == 0 && i % 2 == 1)
+            strings[i][j] = ~strings[i - 1][j];
+          else
+            strings[i][j] = (unsigned char)rng();
+        }
+      }
+
+      std::vector<unsigned char> expected(FORB::L);
+      referenceOrbMean(strings, expected.data());
+
+      // FORB
+      std::vector<cv::Mat> mats(k);
+      std::vector<FORB::pDescriptor> orb(k);
+      for (size_t i = 0; i < k; ++i) {
+        mats[i] = cv::Mat(1, FORB::L, CV_8U);
+        memcpy(mats[i].ptr<unsigned char>(), strings[i].data(), FORB::L);
+        orb[i] = &mats[i];
+      }
+      cv::Mat orb_mean;
+      FORB::meanValue(orb, orb_mean);
+
+      ++n_checks;
+      if (memcmp(orb_mean.ptr<unsigned char>(), expected.data(), FORB::L) != 0)
+        ++n_errors;
+
+      // FORBArray, whose raw representation is the one of FORB
+      std::vector<FORBArray::TDescriptor> arrays(k);
+      std::vector<FORBArray::pDescriptor> orb_arrays(k);
+      for (size_t i = 0; i < k; ++i) {
+        FORBArray::fromBytes(arrays[i], strings[i].data());
+        orb_arrays[i] = &arrays[i];
+      }
+      FORBArray::TDescriptor array_mean;
+      FORBArray::meanValue(orb_arrays, array_mean);
+      std::vector<unsigned char> array_bytes(FORBArray::byte_size);
+      FORBArray::toBytes(array_mean, array_bytes.data());
+
+      ++n_checks;
+      if (memcmp(array_bytes.data(), expected.data(), FORB::L) != 0)
+        ++n_errors;
+
+      // FBRIEF
+      std::vector<FBRIEF::TDescriptor> briefs(k);
+      std::vector<FBRIEF::pDescriptor> brief(k);
+      for (size_t i = 0; i < k; ++i) {
+        FBRIEF::fromBytes(briefs[i], strings[i].data());
+        brief[i] = &briefs[i];
+      }
+      FBRIEF::TDescriptor brief_mean;
+      FBRIEF::meanValue(brief, brief_mean);
+
+      ++n_checks;
+      if (brief_mean != referenceBriefMean(briefs))
+        ++n_errors;
+    }
+  }
+
+  return n_errors;
+}
+
+} // namespace
+
+int main() {
+  const Hamming::Kernel kernels[] = {Hamming::GENERIC, Hamming::POPCNT, Hamming::AVX2, Hamming::AVX512};
+  const Hamming::Kernel default_kernel = Hamming::getKernel();
+
+  std::mt19937_64 rng(1);
+  std::vector<unsigned char> a, b;
+  std::vector<unsigned int> d;
+
+  size_t n_checks = 0, n_errors = 0;
+
+  for (const Hamming::Kernel kernel : kernels) {
+    if (!Hamming::isSupported(kernel)) {
+      std::cout << Hamming::getKernelName(kernel) << ": skipped (not supported)" << std::endl;
+      continue;
+    }
+
+    size_t kernel_errors = 0;
+
+    // lengths below and around the widths of the vectors, and ORB/BRIEF
+    for (size_t n = 1; n <= 300; n += (n < 80 ? 1 : 17)) {
+      for (unsigned int k = 0; k <= 33; k += (k < 10 ? 1 : 7)) {
+        a.resize(n);
+        b.resize(n * k + 1);
+        for (size_t i = 0; i < a.size(); ++i) a[i] = (unsigned char)rng();
+        for (size_t i = 0; i < b.size(); ++i) b[i] = (unsigned char)rng();
+
+        // some strings equal or complementary to a
+        if (k > 1)
+          memcpy(b.data(), a.data(), n);
+        if (k > 2) {
+          for (size_t i = 0; i < n; ++i) b[n + i] = ~a[i];
+        }
+
+        d.assign(k + 1, 0xffffffffu);
+        Hamming::distances(kernel, a.data(), b.data(), n, k, d.data());
+
+        for (unsigned int j = 0; j < k; ++j) {
+          const unsigned char* bj = b.data() + j * n;
+          const unsigned int expected = n % 8 == 0 ? referenceWords(a.data(), bj, n) : referenceBytes(a.data(), bj, n);
+
+          n_checks += 2;
+          if (d[j] != expected)
+            ++kernel_errors;
+          if (Hamming::distance(kernel, a.data(), bj, n) != expected)
+            ++kernel_errors;
+        }
+
+        // nothing is written past the k distances
+        if (d[k] != 0xffffffffu)
+          ++kernel_errors;
+      }
+    }
+
+    // FORB and FBRIEF through the kernel in use
+    Hamming::setKernel(kernel);
+    a.resize(FBRIEF::byte_size);
+    b.resize(FBRIEF::byte_size);
+    for (int t = 0; t < 10000; ++t) {
+      for (size_t i = 0; i < a.size(); ++i) a[i] = (unsigned char)rng();
+      for (size_t i = 0; i < b.size(); ++i) b[i] = (unsigned char)(t % 3 == 0 ? a[i] ^ (rng() & 1) : rng());
+
+      n_checks += 2;
+      if (Hamming::distance(a.data(), b.data(), 32) != referenceWords(a.data(), b.data(), 32))
+        ++kernel_errors;
+
+      FBRIEF::TDescriptor da, db;
+      FBRIEF::fromBytes(da, a.data());
+      FBRIEF::fromBytes(db, b.data());
+      if (FBRIEF::distance(da, db) != referenceBrief(a.data(), b.data())
+          || FBRIEF::distance(a.data(), b.data()) != referenceBrief(a.data(), b.data()))
+        ++kernel_errors;
+    }
+
+    std::cout << Hamming::getKernelName(kernel) << ": " << kernel_errors << " mismatches" << std::endl;
+    n_errors += kernel_errors;
+  }
+
+  Hamming::setKernel(default_kernel);
+
+  const size_t mean_errors = checkMeans(rng, n_checks);
+  std::cout << "means: " << mean_errors << " mismatches" << std::endl;
+  n_errors += mean_errors;
+
+  std::cout << n_checks << " checks, " << n_errors << " mismatches" << std::endl;
+  return n_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * File: test_journal.cpp
+ * Date: October 2026
+ * Description: checks that a database recovered from a checkpoint and its
+ *   journal is the same as the live one, even after a change that could not
+ *   be journaled
+ * License: see the LICENSE.txt file
+ */
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "DBoW2/DBoW2.h"
+
+using namespace DBoW2;
+
+namespace {
+
+/**
+ * Returns random ORB descriptors
+ * @param n number of descriptors
+ * @param rng
+ * @return descriptors
+ */
+std::vector<FORBArray::TDescriptor> randomFeatures(const unsigned int n, std::mt19937_64& rng) {
+  std::vector<FORBArray::TDescriptor> features(n);
+  for (size_t i = 0; i < features.size(); ++i) {
+    for (size_t j = 0; j < features[i].size(); ++j) {
+      features[i][j] = rng();
+    }
+  }
+  return features;
+}
+
+/**
+ * Limits the size of the files written by the process to the current size
+ * of a file, so that the next write to it fails
+ * @param filename
+ * @param limit (out) previous limit
+ * @return false if the platform cannot limit the size of files
+ */
+#ifndef _WIN32
+bool limitFileSize(const std::string& filename, struct rlimit& limit) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0 || getrlimit(RLIMIT_FSIZE, &limit) != 0)
+    return false;
+
+  // the write fails with EFBIG instead of killing the process
+  signal(SIGXFSZ, SIG_IGN);
+
+  struct rlimit new_limit = limit;
+  new_limit.rlim_cur = st.st_size;
+  return setrlimit(RLIMIT_FSIZE, &new_limit) == 0;
+}
+#endif
+
+/**
+ * Counts the differences between two databases: their sizes, sequence
+ * numbers, direct indexes and the results of some queries
+ * @param a
+ * @param b
+ * @param vecs query vectors
+ * @return number of differences
+ */
+unsigned int countDifferences(const OrbArrayDatabase& a, const OrbArrayDatabase& b, const std::vector<BowVector>& vecs) {
+  unsigned int n_differences = 0;
+
+  if (a.size() != b.size() || a.numErased() != b.numErased() || a.getSequence() != b.getSequence())
+    return 1;
+
+  for (EntryId id = 0; id < a.size(); ++id) {
+    if (a.isErased(id) != b.isErased(id) || !(a.retrieveFlatFeatures(id) == b.retrieveFlatFeatures(id)))
+      ++n_differences;
+  }
+
+  QueryResults ret_a, ret_b;
+  for (size_t i = 0; i < vecs.size(); ++i) {
+    a.query(vecs[i], ret_a, 5);
+    b.query(vecs[i], ret_b, 5);
+
+    bool same = ret_a.size() == ret_b.size();
+    for (size_t r = 0; same && r < ret_a.size(); ++r) {
+      same = ret_a[r].Id == ret_b[r].Id && ret_a[r].Score == ret_b[r].Score;
+    }
+    if (!same)
+      ++n_differences;
+  }
+
+  return n_differences;
+}
+
+} // namespace
+
+int main() {
+  const std::string snapshot_filename = "test_journal_snapshot.bin";
+  const std::string journal_filename = "test_journal.jnl";
+  std::remove(snapshot_filename.c_str());
+  std::remove(journal_filename.c_str());
+
+  std::mt19937_64 rng(1);
+
+  std::vector<std::vector<FORBArray::TDescriptor>> training_features(100);
+  for (size_t i = 0; i < training_features.size(); ++i) {
+    training_features[i] = randomFeatures(50, rng);
+  }
+
+  OrbArrayVocabulary voc(10, 3);
+  voc.create(training_features, 1);
+
+  std::vector<BowVector> vecs(400);
+  std::vector<FeatureVector> fvecs(vecs.size());
+  for (size_t i = 0; i < vecs.size(); ++i) {
+    voc.transform(randomFeatures(20, rng), vecs[i], fvecs[i], 1);
+  }
+
+  size_t next = 0;
+  unsigned int n_errors = 0;
+
+  {
+    OrbArrayDatabase db(voc, true, 1);
+    for (; next < 100; ++next) {
+      db.add(vecs[next], fvecs[next]);
+    }
+
+    db.openJournal(journal_filename);
+    for (; next < 150; ++next) {
+      db.add(vecs[next], fvecs[next]);
+    }
+    db.checkpoint(snapshot_filename);
+
+    // changes after the checkpoint, which are only in the journal
+    for (EntryId id = 0; id < db.size(); id += 5) {
+      db.erase(id);
+    }
+    db.compact(true);
+    for (; next < 200; ++next) {
+      db.add(vecs[next], fvecs[next]);
+    }
+
+#ifndef _WIN32
+    // a change that cannot be journaled is not applied
+    struct rlimit limit;
+    if (limitFileSize(journal_filename, limit)) {
+      const unsigned int size = db.size();
+      const uint64_t sequence = db.getSequence();
+
+      bool thrown = false;
+      try {
+        db.add(vecs[next], fvecs[next]);
+      }
+      catch (const std::string&) {
+        thrown = true;
+      }
+      setrlimit(RLIMIT_FSIZE, &limit);
+      ++next;
+
+      if (!thrown || db.size() != size || db.getSequence() != sequence) {
+        std::cout << "the failed add was applied" << std::endl;
+        ++n_errors;
+      }
+    }
+    else {
+      std::cout << "the size of the journal cannot be limited, skipping the write failure" << std::endl;
+    }
+#endif
+
+    // the changes after the failure are journaled as usual
+    for (; next < 250; ++next) {
+      db.add(vecs[next], fvecs[next]);
+    }
+    db.erase(db.size() - 1);
+    db.syncJournal();
+
+    OrbArrayDatabase recovered;
+    recovered.load(snapshot_filename);
+
+    // the journal can only be opened once at a time
+    db.closeJournal();
+    recovered.openJournal(journal_filename);
+
+    const unsigned int n_differences = countDifferences(db, recovered, vecs);
+    std::cout << n_differences << " differences between the live and the recovered database" << std::endl;
+    n_errors += n_differences;
+  }
+
+  std::remove(snapshot_filename.c_str());
+  std::remove(journal_filename.c_str());
+
+  return n_errors == 0 ? 0 : 1;
+}
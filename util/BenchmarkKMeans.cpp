@@ -0,0 +1,169 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "DBoW2/FORBArray.h"
+#include "DBoW2/RandomGenerator.h"
+#include "DBoW2/TemplatedDatabase.h"
+#include "DBoW2/TemplatedVocabulary.h"
+
+typedef DBoW2::TemplatedVocabulary<DBoW2::FORBArray::TDescriptor, DBoW2::FORBArray> ORBVocabulary;
+typedef DBoW2::TemplatedDatabase<DBoW2::FORBArray::TDescriptor, DBoW2::FORBArray> ORBDatabase;
+typedef std::vector<std::vector<DBoW2::FORBArray::TDescriptor>> Images;
+
+class Timer {
+public:
+  Timer() {
+    start_ = std::chrono::steady_clock::now();
+  }
+  virtual ~Timer() = default;
+
+  double getMilliSec() {
+    const auto dur = std::chrono::steady_clock::now() - start_;
+    return std::chrono::duration_cast<std::chrono::microseconds>(dur).count() / 1000.0;
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Synthetic ORB-like descriptors: each one is a noisy observation (each bit
+// flipped with some probability) of one of a fixed set of patterns
+class Scene {
+public:
+  Scene(const unsigned int n_patterns, const uint64_t seed)
+      : rng_(seed), patterns_(n_patterns) {
+    for (auto& pattern : patterns_) {
+      for (auto& word : pattern) {
+        word = rng_();
+      }
+    }
+  }
+
+  unsigned int randomPattern() {
+    return rng_() % patterns_.size();
+  }
+
+  DBoW2::FORBArray::TDescriptor observe(const unsigned int pattern, const unsigned int flip_per_256) {
+    DBoW2::FORBArray::TDescriptor d = patterns_[pattern];
+    for (unsigned int b = 0; b < 256; ++b) {
+      if (rng_() % 256 < flip_per_256)
+        d[b / 64] ^= (uint64_t)1 << (b % 64);
+    }
+    return d;
+  }
+
+  // images of random patterns
+  void images(const unsigned int n_images, const unsigned int n_features, Images& images,
+              std::vector<std::vector<unsigned int>>& image_patterns) {
+    images.resize(n_images);
+    image_patterns.resize(n_images);
+    for (unsigned int i = 0; i < n_images; ++i) {
+      images[i].resize(n_features);
+      image_patterns[i].resize(n_features);
+      for (unsigned int j = 0; j < n_features; ++j) {
+        image_patterns[i][j] = randomPattern();
+        images[i][j] = observe(image_patterns[i][j], flip_);
+      }
+    }
+  }
+
+  // new observations of the patterns of an image, with a part of them
+  // replaced by other patterns
+  void revisit(const std::vector<unsigned int>& patterns, const unsigned int replaced_per_100,
+               std::vector<DBoW2::FORBArray::TDescriptor>& image) {
+    image.resize(patterns.size());
+    for (size_t j = 0; j < patterns.size(); ++j) {
+      const unsigned int pattern = rng_() % 100 < replaced_per_100 ? randomPattern() : patterns[j];
+      image[j] = observe(pattern, flip_);
+    }
+  }
+
+private:
+  DBoW2::RandomGenerator rng_;
+  std::vector<DBoW2::FORBArray::TDescriptor> patterns_;
+  const unsigned int flip_ = 24;
+};
+
+struct Setting {
+  const char* name;
+  DBoW2::TemplatedVocabulary<DBoW2::FORBArray::TDescriptor, DBoW2::FORBArray>::KMeansParams params;
+};
+
+// fraction of queries whose first result is the image they revisit
+double recallAt1(const ORBVocabulary& vocab, const Images& database_images, const Images& queries) {
+  ORBDatabase db(vocab, false);
+  DBoW2::BowVector v;
+  for (const auto& image : database_images) {
+    vocab.transform(image, v);
+    db.add(v);
+  }
+
+  unsigned int n_hits = 0;
+  DBoW2::QueryResults ret;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    vocab.transform(queries[i], v);
+    db.query(v, ret, 1);
+    if (!ret.empty() && ret[0].Id == i)
+      ++n_hits;
+  }
+  return (double)n_hits / queries.size();
+}
+
+int main(int argc, char** argv) {
+  const unsigned int n_training = argc > 1 ? atoi(argv[1]) : 10000;
+  const unsigned int n_features = 100;
+  const unsigned int n_database = 2000;
+  const uint64_t seed = 1;
+
+  Scene scene(20000, seed);
+  Images training, database_images, queries;
+  std::vector<std::vector<unsigned int>> training_patterns, database_patterns;
+  scene.images(n_training, n_features, training, training_patterns);
+  scene.images(n_database, n_features, database_images, database_patterns);
+  queries.resize(n_database);
+  for (unsigned int i = 0; i < n_database; ++i) {
+    scene.revisit(database_patterns[i], 40, queries[i]);
+  }
+
+  printf("%u training descriptors, recall@1 of %u queries\n", n_training * n_features, n_database);
+  printf("%-28s %12s %12s %10s\n", "setting", "top step ms", "k10 L5 ms", "recall@1");
+
+  std::vector<Setting> settings(1);
+  settings[0].name = "no batch";
+  const unsigned int batch_sizes[] = {50000, 20000, 10000, 5000};
+  const unsigned int full_iterations[] = {1, 2};
+  std::vector<std::string> names;
+  names.reserve(16);
+  for (const unsigned int batch_size : batch_sizes) {
+    for (const unsigned int max_full_iterations : full_iterations) {
+      names.push_back("batch " + std::to_string(batch_size) + ", full it. " + std::to_string(max_full_iterations));
+      Setting setting;
+      setting.name = names.back().c_str();
+      setting.params.batch_size = batch_size;
+      setting.params.max_full_iterations = max_full_iterations;
+      settings.push_back(setting);
+    }
+  }
+
+  for (const Setting& setting : settings) {
+    // the top step is the whole creation of a tree with one level
+    ORBVocabulary top(10, 1);
+    top.setKMeansParams(setting.params);
+    Timer top_timer;
+    top.create(training, seed);
+    const double top_ms = top_timer.getMilliSec();
+
+    ORBVocabulary vocab(10, 5);
+    vocab.setKMeansParams(setting.params);
+    Timer timer;
+    vocab.create(training, seed);
+    const double ms = timer.getMilliSec();
+
+    printf("%-28s %12.0f %12.0f %10.4f\n", setting.name, top_ms, ms, recallAt1(vocab, database_images, queries));
+    fflush(stdout);
+  }
+
+  return 0;
+}